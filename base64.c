@@ -0,0 +1,204 @@
+/* base64.c -- table driven base64 with SIMD kernels where available
+ *
+ * The kernels in base64_x86.c encode the bulk of the input; the scalar
+ * code here does what they leave over (and everything on other CPUs).
+ */
+
+#include <string.h>
+
+#include "base64.h"
+#include "cpu.h"
+
+static const char base64_enc[64] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+	"abcdefghijklmnopqrstuvwxyz"
+	"0123456789+/";
+
+/* decoding: 0..63 for the alphabet, else one of these */
+#define B64_INVALID	0xff
+#define B64_SPACE	0xfe
+#define B64_PAD		0xfd
+
+static const unsigned char base64_dec[256] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe, 0xfe, 0xfe, 0xfe, 0xfe, 0xff, 0xff,	// \t \n \v \f \r
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xfe, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,   62, 0xff, 0xff, 0xff,   63,	// ' ' + /
+	  52,   53,   54,   55,   56,   57,   58,   59,   60,   61, 0xff, 0xff, 0xff, 0xfd, 0xff, 0xff,	// 0-9 =
+	0xff,    0,    1,    2,    3,    4,    5,    6,    7,    8,    9,   10,   11,   12,   13,   14,	// A-O
+	  15,   16,   17,   18,   19,   20,   21,   22,   23,   24,   25, 0xff, 0xff, 0xff, 0xff, 0xff,	// P-Z
+	0xff,   26,   27,   28,   29,   30,   31,   32,   33,   34,   35,   36,   37,   38,   39,   40,	// a-o
+	  41,   42,   43,   44,   45,   46,   47,   48,   49,   50,   51, 0xff, 0xff, 0xff, 0xff, 0xff,	// p-z
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static int base64_selected = 0;
+static oauth_base64_encode_func base64_encode_kernel = NULL;	///< NULL: scalar only
+static oauth_base64_decode_func base64_decode_kernel = NULL;
+static const char *base64_backend = "scalar";
+
+static void base64_select_backend(void)
+{
+	oauth_base64_encode_func enc = NULL;
+	oauth_base64_decode_func dec = NULL;
+#ifdef OAUTH_X86
+	unsigned int features = oauth_cpu_features();
+
+	if (features & OAUTH_CPU_AVX2) {
+		enc = oauth_base64_encode_avx2;
+		dec = oauth_base64_decode_avx2;
+		base64_backend = "avx2";
+	} else if (features & OAUTH_CPU_SSSE3) {
+		enc = oauth_base64_encode_ssse3;
+		dec = oauth_base64_decode_ssse3;
+		base64_backend = "ssse3";
+	}
+#endif
+
+	base64_encode_kernel = enc;
+	base64_decode_kernel = dec;
+	base64_selected = 1;
+}
+
+const char *oauth_base64_backend(void)
+{
+	if (!base64_selected) {
+		base64_select_backend();
+	}
+
+	return base64_backend;
+}
+
+size_t oauth_base64_encode_raw(char *dst, const unsigned char *src, size_t len)
+{
+	char *p = dst;
+	size_t done;
+
+	if (!base64_selected) {
+		base64_select_backend();
+	}
+
+	if (base64_encode_kernel) {
+		done = base64_encode_kernel(p, src, len);
+		p += done / 3 * 4;
+		src += done;
+		len -= done;
+	}
+
+	for (; len >= 3; len -= 3, src += 3) {
+		p[0] = base64_enc[src[0] >> 2];
+		p[1] = base64_enc[(src[0] & 0x03) << 4 | src[1] >> 4];
+		p[2] = base64_enc[(src[1] & 0x0f) << 2 | src[2] >> 6];
+		p[3] = base64_enc[src[2] & 0x3f];
+		p += 4;
+	}
+
+	if (len) {
+		p[0] = base64_enc[src[0] >> 2];
+		if (len == 2) {
+			p[1] = base64_enc[(src[0] & 0x03) << 4 | src[1] >> 4];
+			p[2] = base64_enc[(src[1] & 0x0f) << 2];
+		} else {
+			p[1] = base64_enc[(src[0] & 0x03) << 4];
+			p[2] = '=';
+		}
+		p[3] = '=';
+		p += 4;
+	}
+
+	return p - dst;
+}
+
+size_t oauth_base64_decode_raw(unsigned char *dst, size_t size, const char *src, size_t len, int mode)
+{
+	const unsigned char *s = (const unsigned char *)src;
+	const unsigned char *end = s + len;
+	size_t o = 0, n;
+	unsigned long acc = 0;
+	int q = 0;			///< alphabet chars in the current group
+	int pad = -1;		///< '=' still expected after a short group, -1 before any
+	int lenient = (mode == OAUTH_BASE64_LENIENT);
+	int canonical = (mode == OAUTH_BASE64_CANONICAL);
+	unsigned char v;
+
+	if (!base64_selected) {
+		base64_select_backend();
+	}
+
+	while (s < end) {
+		if (base64_decode_kernel && q == 0 && pad < 0) {
+			n = (size_t)(end - s);
+			if (n / 4 > (size - o) / 3) n = (size - o) / 3 * 4;
+			n = base64_decode_kernel(dst + o, (const char *)s, n);
+			s += n;
+			o += n / 4 * 3;
+			if (s == end) break;
+		}
+
+		// the kernel stopped in front of a block it can not take (whitespace,
+		// padding, junk or a full 'dst'): go through it here, then realign
+		for (n = 0; s < end && (n < 16 || q != 0); n++) {
+			v = base64_dec[*s++];
+
+			if (v < 64) {
+				if (pad >= 0) {
+					// data after the padding
+					if (!lenient) return OAUTH_BASE64_ERROR;
+					pad = -1;
+				}
+				acc = acc << 6 | v;
+				if (++q == 4) {
+					if (size - o < 3) return OAUTH_BASE64_ERROR;
+					dst[o++] = (unsigned char)(acc >> 16);
+					dst[o++] = (unsigned char)(acc >> 8);
+					dst[o++] = (unsigned char)acc;
+					q = 0;
+				}
+			} else if (v == B64_PAD) {
+				if (q >= 2) {
+					// "xx=" or "xxx": flush the short group
+					if (size - o < (size_t)(q - 1)) return OAUTH_BASE64_ERROR;
+					// the bits below the last byte must be 0
+					if (canonical && (acc & (q == 2 ? 0xf : 0x3))) return OAUTH_BASE64_ERROR;
+					acc <<= 6 * (4 - q);
+					dst[o++] = (unsigned char)(acc >> 16);
+					if (q == 3) dst[o++] = (unsigned char)(acc >> 8);
+					pad = 3 - q;
+					q = 0;
+				} else if (pad > 0) {
+					pad--;
+				} else if (!lenient) {
+					return OAUTH_BASE64_ERROR;
+				}
+			} else if ((v != B64_SPACE || canonical) && !lenient) {
+				return OAUTH_BASE64_ERROR;
+			}
+		}
+	}
+
+	// a dangling char carries less than a byte. oauth_decode_base64()
+	// always returned what came before it
+	if (q == 1) {
+		if (!lenient) return OAUTH_BASE64_ERROR;
+		q = 0;
+	}
+
+	// padding cut short, or none after a short group
+	if (canonical && (pad > 0 || q)) return OAUTH_BASE64_ERROR;
+
+	// unpadded short group
+	if (q) {
+		if (size - o < (size_t)(q - 1)) return OAUTH_BASE64_ERROR;
+		acc <<= 6 * (4 - q);
+		dst[o++] = (unsigned char)(acc >> 16);
+		if (q == 3) dst[o++] = (unsigned char)(acc >> 8);
+	}
+
+	return o;
+}
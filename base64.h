@@ -0,0 +1,73 @@
+#ifndef _OAUTH_BASE64_H
+#define _OAUTH_BASE64_H      1
+
+/*
+ * internal: base64 (RFC 4648, with padding) on caller provided buffers.
+ * The public, allocating wrappers live in oauth.c.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* length of the encoding of 'len' bytes, without a terminating zero */
+#define OAUTH_BASE64_ENCODED_LEN(len) ((((len) + 2) / 3) * 4)
+
+/* upper bound of the decoded size of 'len' chars of base64 */
+#define OAUTH_BASE64_DECODED_MAX(len) ((((len) + 3) / 4) * 3)
+
+/* returned by oauth_base64_decode_raw() for invalid input or a short 'dst' */
+#define OAUTH_BASE64_ERROR ((size_t)-1)
+
+/*
+ * encode 'len' bytes of 'src' into OAUTH_BASE64_ENCODED_LEN(len) chars
+ * at 'dst' (no terminating zero). returns the number of chars written.
+ * dispatches to AVX2 / SSSE3 kernels when the CPU has them.
+ */
+size_t oauth_base64_encode_raw(char *dst, const unsigned char *src, size_t len);
+const char *oauth_base64_backend(void);
+
+/* 'mode' of oauth_base64_decode_raw() */
+#define OAUTH_BASE64_PLAIN		0	///< whitespace skipped, padding optional
+#define OAUTH_BASE64_LENIENT	1	///< any junk skipped, the old oauth_decode_base64()
+#define OAUTH_BASE64_CANONICAL	2	///< only the one encoding of the data: padded, unused bits 0, no whitespace
+
+/*
+ * decode 'len' chars of 'src' into at most 'size' bytes at 'dst' in one
+ * pass. OAUTH_BASE64_PLAIN skips whitespace and takes the trailing '='
+ * padding as optional; any other non-alphabet char is an error.
+ * OAUTH_BASE64_LENIENT skips those chars and a dangling last char too.
+ * OAUTH_BASE64_CANONICAL accepts nothing but the padded encoding with
+ * zero unused bits, so that no two strings decode to the same data.
+ * returns the number of bytes written or OAUTH_BASE64_ERROR. nothing
+ * is written past dst + size, and no terminating zero is added.
+ */
+size_t oauth_base64_decode_raw(unsigned char *dst, size_t size, const char *src, size_t len, int mode);
+
+/*
+ * encoding kernels: handle a prefix of whole blocks without padding and
+ * return how many bytes of 'src' they consumed (a multiple of 3).
+ */
+typedef size_t (*oauth_base64_encode_func)(char *dst, const unsigned char *src, size_t len);
+
+size_t oauth_base64_encode_ssse3(char *dst, const unsigned char *src, size_t len);
+size_t oauth_base64_encode_avx2(char *dst, const unsigned char *src, size_t len);
+
+/*
+ * decoding kernels: decode a prefix of 'src' made of whole 4 char groups
+ * from the alphabet only, and stop in front of the first block holding
+ * anything else. return the number of chars consumed (a multiple of 4);
+ * the caller has room for 3 bytes per 4 chars of 'len'.
+ */
+typedef size_t (*oauth_base64_decode_func)(unsigned char *dst, const char *src, size_t len);
+
+size_t oauth_base64_decode_ssse3(unsigned char *dst, const char *src, size_t len);
+size_t oauth_base64_decode_avx2(unsigned char *dst, const char *src, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _OAUTH_BASE64_H
@@ -0,0 +1,226 @@
+/* base64_x86.c -- SSSE3 and AVX2 base64 kernels
+ *
+ * Encoding follows Wojciech Muła's method: pshufb spreads every 3 input
+ * bytes over a 32 bit lane, two multiplies move the four 6 bit fields
+ * into separate bytes, and a second pshufb maps each 6 bit value to the
+ * offset that turns it into its ASCII character.
+ *
+ * Decoding uses the same author's range check: two pshufb lookups on the
+ * low and high nibble of each char flag anything outside the alphabet,
+ * a third one yields the offset back to the 6 bit value, and pmaddubsw /
+ * pmaddwd pack four values into three bytes.
+ *
+ * The kernels are only called after oauth_cpu_features() has reported
+ * the extension they are compiled for.
+ */
+
+#include "base64.h"
+#include "cpu.h"
+
+#ifdef OAUTH_X86
+
+#include <string.h>
+#include <immintrin.h>
+
+/* 12 input bytes -> 16 six bit indices, one per byte */
+OAUTH_TARGET("ssse3")
+static __inline __m128i base64_enc_indices128(__m128i in)
+{
+	const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+	__m128i t0, t1;
+
+	in = _mm_shuffle_epi8(in, spread);
+	t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+	t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+	return _mm_or_si128(t0, t1);
+}
+
+/* 6 bit values -> ASCII: value + offset, offset picked by range with pshufb */
+OAUTH_TARGET("ssse3")
+static __inline __m128i base64_enc_ascii128(__m128i idx)
+{
+	const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'+' - 62, '/' - 63, 'A', 0, 0);
+	__m128i sel;
+
+	// 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+	sel = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+	sel = _mm_or_si128(sel, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), idx), _mm_set1_epi8(13)));
+	return _mm_add_epi8(idx, _mm_shuffle_epi8(offsets, sel));
+}
+
+OAUTH_TARGET("ssse3")
+size_t oauth_base64_encode_ssse3(char *dst, const unsigned char *src, size_t len)
+{
+	size_t done = 0;
+	__m128i v;
+
+	// each step reads 16 bytes but consumes only 12
+	while (len - done >= 16) {
+		v = _mm_loadu_si128((const __m128i *)(src + done));
+		v = base64_enc_ascii128(base64_enc_indices128(v));
+		_mm_storeu_si128((__m128i *)dst, v);
+		dst += 16;
+		done += 12;
+	}
+
+	return done;
+}
+
+OAUTH_TARGET("avx2")
+static __inline __m256i base64_enc_indices256(__m256i in)
+{
+	const __m256i spread = _mm256_set_epi8(
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+		10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+	__m256i t0, t1;
+
+	in = _mm256_shuffle_epi8(in, spread);
+	t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+	t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+	return _mm256_or_si256(t0, t1);
+}
+
+OAUTH_TARGET("avx2")
+static __inline __m256i base64_enc_ascii256(__m256i idx)
+{
+	const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'+' - 62, '/' - 63, 'A', 0, 0,
+		'a' - 26, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'+' - 62, '/' - 63, 'A', 0, 0);
+	__m256i sel;
+
+	sel = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+	sel = _mm256_or_si256(sel, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx), _mm256_set1_epi8(13)));
+	return _mm256_add_epi8(idx, _mm256_shuffle_epi8(offsets, sel));
+}
+
+OAUTH_TARGET("avx2")
+size_t oauth_base64_encode_avx2(char *dst, const unsigned char *src, size_t len)
+{
+	size_t done = 0;
+	__m256i v;
+
+	// 24 bytes per step: 12 into each 128 bit lane, reading 28
+	while (len - done >= 28) {
+		v = _mm256_inserti128_si256(
+			_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + done))),
+			_mm_loadu_si128((const __m128i *)(src + done + 12)), 1);
+		v = base64_enc_ascii256(base64_enc_indices256(v));
+		_mm256_storeu_si256((__m256i *)dst, v);
+		dst += 32;
+		done += 24;
+	}
+
+	// one 128 bit step for what is left (digests are 20 and 32 bytes), in
+	// legacy SSE encoding: run with the upper YMM halves dirty, every SSE
+	// instruction would stall, and the compiler does not always clear them
+	// across the target() boundary
+	_mm256_zeroupper();
+	return done + oauth_base64_encode_ssse3(dst, src + done, len - done);
+}
+
+/* ASCII -> 6 bit values; nonzero 'bad' lanes mark chars outside the alphabet */
+OAUTH_TARGET("ssse3")
+static __inline __m128i base64_dec_values128(__m128i in, __m128i *bad)
+{
+	const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0);
+	const __m128i mask_2f = _mm_set1_epi8(0x2f);
+	__m128i hi, lo;
+
+	hi = _mm_and_si128(_mm_srli_epi32(in, 4), mask_2f);
+	lo = _mm_and_si128(in, mask_2f);
+	*bad = _mm_and_si128(_mm_shuffle_epi8(lut_lo, lo), _mm_shuffle_epi8(lut_hi, hi));
+
+	// '/' shares its high nibble with '+', step it to its own offset
+	hi = _mm_add_epi8(hi, _mm_cmpeq_epi8(in, mask_2f));
+	return _mm_add_epi8(in, _mm_shuffle_epi8(lut_roll, hi));
+}
+
+/* 16 values -> 12 bytes in the low part of the register */
+OAUTH_TARGET("ssse3")
+static __inline __m128i base64_dec_pack128(__m128i v)
+{
+	v = _mm_maddubs_epi16(v, _mm_set1_epi32(0x01400140));
+	v = _mm_madd_epi16(v, _mm_set1_epi32(0x00011000));
+	return _mm_shuffle_epi8(v, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+OAUTH_TARGET("ssse3")
+size_t oauth_base64_decode_ssse3(unsigned char *dst, const char *src, size_t len)
+{
+	size_t done = 0;
+	__m128i v, bad;
+	unsigned int tail;
+
+	while (len - done >= 16) {
+		v = base64_dec_values128(_mm_loadu_si128((const __m128i *)(src + done)), &bad);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(bad, _mm_setzero_si128())) != 0xffff) break;
+		v = base64_dec_pack128(v);
+
+		// exactly 12 bytes: 'dst' may end right here
+		_mm_storel_epi64((__m128i *)dst, v);
+		tail = (unsigned int)_mm_cvtsi128_si32(_mm_srli_si128(v, 8));
+		memcpy(dst + 8, &tail, 4);
+		dst += 12;
+		done += 16;
+	}
+
+	return done;
+}
+
+OAUTH_TARGET("avx2")
+size_t oauth_base64_decode_avx2(unsigned char *dst, const char *src, size_t len)
+{
+	const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a,
+		0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+		0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+	const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+		0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+		0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+	const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0,
+		0, 16, 19, 4, -65, -65, -71, -71,
+		0, 0, 0, 0, 0, 0, 0, 0);
+	const __m256i mask_2f = _mm256_set1_epi8(0x2f);
+	const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+		2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+	size_t done = 0;
+	__m256i in, hi, lo, v;
+
+	while (len - done >= 32) {
+		in = _mm256_loadu_si256((const __m256i *)(src + done));
+		hi = _mm256_and_si256(_mm256_srli_epi32(in, 4), mask_2f);
+		lo = _mm256_and_si256(in, mask_2f);
+		if (!_mm256_testz_si256(_mm256_shuffle_epi8(lut_lo, lo), _mm256_shuffle_epi8(lut_hi, hi))) break;
+
+		hi = _mm256_add_epi8(hi, _mm256_cmpeq_epi8(in, mask_2f));
+		v = _mm256_add_epi8(in, _mm256_shuffle_epi8(lut_roll, hi));
+		v = _mm256_maddubs_epi16(v, _mm256_set1_epi32(0x01400140));
+		v = _mm256_madd_epi16(v, _mm256_set1_epi32(0x00011000));
+		v = _mm256_shuffle_epi8(v, pack);
+
+		// 12 bytes per lane -> 24 contiguous bytes, stored exactly
+		v = _mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+		_mm_storeu_si128((__m128i *)dst, _mm256_castsi256_si128(v));
+		_mm_storel_epi64((__m128i *)(dst + 16), _mm256_extracti128_si256(v, 1));
+		dst += 24;
+		done += 32;
+	}
+
+	// clear the upper halves for the SSSE3 tail, as in the encoder
+	_mm256_zeroupper();
+	return done + oauth_base64_decode_ssse3(dst, src + done, len - done);
+}
+
+#endif // OAUTH_X86
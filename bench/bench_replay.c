@@ -0,0 +1,152 @@
+/* bench_replay.c -- oauth_replay_check throughput by thread count
+ *
+ * Every thread records its own fresh nonces in one shared cache
+ * (inserts), then checks all of them again (lookups, each one a replay).
+ * Timestamps are spread evenly over the window, as the capacity given
+ * to oauth_replay_cache_new assumes.
+ * Both phases start together behind a barrier and are timed from the
+ * first thread in to the last one out. The same run with every call
+ * under one mutex is printed next to it for comparison.
+ *
+ * Scaling can only show on a host with several cores. Rows with more
+ * threads than the OS reports online cores are marked '*': they
+ * measure time slicing, and their scaling column says nothing about
+ * how the cache scales.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "oauth.h"
+
+#define RUNS 3
+#define PER_THREAD 200000	///< nonces per thread and phase
+#define MAX_THREADS 16
+#define NOW 1300000000L
+#define WINDOW 300
+
+typedef struct {
+	int locked;
+	char (*nonce)[24];
+	long bad;				///< unexpected results, must stay 0
+} worker;
+
+static OAuthReplayCache *cache;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t barrier;
+static double phase_start[2], phase_end[2];
+
+static double now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static OAuthReplayResult check(const worker *w, int i)
+{
+	OAuthReplayResult r;
+
+	if (w->locked) pthread_mutex_lock(&lock);
+	r = oauth_replay_check(cache, "xvz1evFS4wEEPTGEFPHBog", NOW - WINDOW + i % (2 * WINDOW + 1),
+		w->nonce[i], NOW);
+	if (w->locked) pthread_mutex_unlock(&lock);
+	return r;
+}
+
+static void *run(void *arg)
+{
+	worker *w = (worker *)arg;
+	int phase, i;
+
+	for (phase = 0; phase < 2; phase++) {
+		if (pthread_barrier_wait(&barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+			phase_start[phase] = now();
+		}
+		for (i = 0; i < PER_THREAD; i++) {
+			if (check(w, i) != (phase ? OA_REPLAY_SEEN : OA_REPLAY_OK)) w->bad++;
+		}
+		if (pthread_barrier_wait(&barrier) == PTHREAD_BARRIER_SERIAL_THREAD) {
+			phase_end[phase] = now();
+		}
+	}
+	return NULL;
+}
+
+/* best inserts/s and lookups/s of RUNS runs with 'n' threads */
+static long measure(int n, int locked, char (*nonces)[24], double best[2])
+{
+	pthread_t tid[MAX_THREADS];
+	worker w[MAX_THREADS];
+	long bad = 0;
+	int r, i, phase;
+
+	best[0] = best[1] = 0;
+	for (r = 0; r < RUNS; r++) {
+		cache = oauth_replay_cache_new((size_t)n * PER_THREAD, WINDOW);
+		pthread_barrier_init(&barrier, NULL, n);
+
+		for (i = 0; i < n; i++) {
+			w[i].locked = locked;
+			w[i].nonce = nonces + (size_t)i * PER_THREAD;
+			w[i].bad = 0;
+			pthread_create(&tid[i], NULL, run, &w[i]);
+		}
+		for (i = 0; i < n; i++) {
+			pthread_join(tid[i], NULL);
+			bad += w[i].bad;
+		}
+
+		for (phase = 0; phase < 2; phase++) {
+			double rate = (double)n * PER_THREAD / (phase_end[phase] - phase_start[phase]);
+			if (rate > best[phase]) best[phase] = rate;
+		}
+
+		pthread_barrier_destroy(&barrier);
+		oauth_replay_cache_free(cache);
+	}
+	return bad;
+}
+
+int main(void)
+{
+	static const int counts[] = { 1, 2, 4, 8, 16 };
+	char (*nonces)[24] = malloc((size_t)MAX_THREADS * PER_THREAD * sizeof(*nonces));
+	double free_[2], locked[2], base[2] = { 0, 0 };
+	long bad = 0, cores = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t i;
+
+	for (i = 0; i < (size_t)MAX_THREADS * PER_THREAD; i++) {
+		snprintf(nonces[i], sizeof(nonces[i]), "n%luq%lx", (unsigned long)i, (unsigned long)(i * 2654435761u));
+	}
+
+	printf("%ld online cores, %d nonces per thread, best of %d\n\n", cores, PER_THREAD, RUNS);
+	printf("%7s %14s %14s %8s %14s %14s\n", "threads", "insert/s", "lookup/s", "scaling",
+		"locked ins/s", "locked look/s");
+
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		bad += measure(counts[i], 0, nonces, free_);
+		bad += measure(counts[i], 1, nonces, locked);
+		if (i == 0) {
+			base[0] = free_[0];
+			base[1] = free_[1];
+		}
+		printf("%6d%c %14.0f %14.0f %7.2fx %14.0f %14.0f\n", counts[i], counts[i] > cores ? '*' : ' ',
+			free_[0], free_[1], (free_[0] + free_[1]) / (base[0] + base[1]), locked[0], locked[1]);
+	}
+	if (cores < counts[sizeof(counts) / sizeof(counts[0]) - 1]) {
+		printf("\n* more threads than online cores, not a scaling result\n");
+	}
+
+	free(nonces);
+	if (bad) {
+		printf("\n%ld unexpected results\n", bad);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,70 @@
+/* bench_serialize.c -- oauth_serialize_url_sep time by parameter count
+ *
+ * Serializes a URL with 10, 100 and 1000 parameters, a quarter of them
+ * with spaces to escape, in the three forms the library writes: query
+ * string, only the oauth_ parameters quoted for an Authorization header,
+ * and the others. Only the public API is used, so building with SRC at
+ * an older checkout gives the numbers to compare with.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "oauth.h"
+
+#define RUNS 5
+#define MIN_PARAMS 2000000	///< serialize at least this many parameters per size and run
+
+static double now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/* microseconds per call, best of RUNS */
+static double measure(int argc, char **argv, char *sep, int mod)
+{
+	int reps = MIN_PARAMS / argc, run, r;
+	double t, best = 0;
+
+	for (run = 0; run < RUNS; run++) {
+		t = now();
+		for (r = 0; r < reps; r++) {
+			free(oauth_serialize_url_sep(argc, 0, argv, sep, mod));
+		}
+		t = now() - t;
+		if (best == 0 || t / reps < best) best = t / reps;
+	}
+	return best * 1e6;
+}
+
+int main(void)
+{
+	static const int counts[] = { 10, 100, 1000 };
+	char **argv;
+	int i, n, argc;
+
+	printf("%7s %14s %14s %14s\n", "params", "query us", "header us", "others us");
+	for (i = 0; i < (int)(sizeof(counts) / sizeof(counts[0])); i++) {
+		argc = counts[i] + 1;
+		argv = (char **)malloc(argc * sizeof(char *));
+		argv[0] = strdup("http://api.example.com/1/some path/with spaces.json");
+		for (n = 1; n < argc; n++) {
+			argv[n] = (char *)malloc(64);
+			if (n % 4 == 0) snprintf(argv[n], 64, "q%d=hello world & more %d", n, n);
+			else if (n % 4 == 1) snprintf(argv[n], 64, "oauth_p%d=kYjzVBB8Y0ZFabxSWbWovY3uYSQ2pTg", n);
+			else snprintf(argv[n], 64, "param%d=value%d", n, n * 7);
+		}
+
+		printf("%7d %14.2f %14.2f %14.2f\n", counts[i], measure(argc, argv, "&", 0),
+			measure(argc, argv, ", ", 6), measure(argc, argv, "&", 1));
+
+		for (n = 0; n < argc; n++) free(argv[n]);
+		free(argv);
+	}
+	return 0;
+}
@@ -0,0 +1,57 @@
+/* bench_sha1.c -- oauth_body_hash_data throughput
+ *
+ * Hashes buffers from 4 KB to 64 MB and prints MB/s, best of several
+ * runs. Only the public API is used, so the same program built with
+ * SRC pointing at an older checkout gives the numbers to compare with.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "oauth.h"
+
+#define RUNS 5
+#define MIN_BYTES (256 << 20)	///< hash at least this much per size and run
+
+static double now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main(void)
+{
+	static const size_t sizes[] = { 4 << 10, 64 << 10, 1 << 20, 16 << 20, 64 << 20 };
+	size_t i, j, reps, max = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+	char *data = (char *)malloc(max);
+	double t, best;
+	int run;
+
+	for (j = 0; j < max; j++) {
+		data[j] = (char)(j * 131 + (j >> 9));
+	}
+
+	printf("%10s %12s\n", "bytes", "MB/s");
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		reps = MIN_BYTES / sizes[i];
+		if (reps < 1) reps = 1;
+
+		best = 0;
+		for (run = 0; run < RUNS; run++) {
+			t = now();
+			for (j = 0; j < reps; j++) {
+				free(oauth_body_hash_data(sizes[i], data));
+			}
+			t = now() - t;
+			if (reps * (double)sizes[i] / t > best) best = reps * (double)sizes[i] / t;
+		}
+		printf("%10lu %12.1f\n", (unsigned long)sizes[i], best / 1e6);
+	}
+
+	free(data);
+	return 0;
+}
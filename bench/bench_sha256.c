@@ -0,0 +1,128 @@
+/* bench_sha256.c -- SHA-256 against SHA-1, bulk and per signature
+ *
+ * Three views for capacity planning before switching to HMAC-SHA256:
+ * the compression backends the CPU supports in MB/s, single HMAC
+ * signatures of a typical base string, and whole requests signed by
+ * oauth_sign_url2 with OA_HMAC and OA_HMAC_SHA256.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "oauth.h"
+#include "sha1.h"
+#include "sha256.h"
+#include "cpu.h"
+
+#define RUNS 5
+#define BULK (1 << 20)		///< bytes per compression call
+#define BULK_REPS 64
+#define SIGS 200000
+
+static double now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+typedef struct {
+	const char *name;
+	SHA1CompressFunc sha1;
+	SHA256CompressFunc sha256;
+	unsigned int need;	///< OAUTH_CPU_* flags the backend needs
+} backend;
+
+static const backend backends[] = {
+	{ "sha1 generic", SHA1CompressGeneric, NULL, 0 },
+	{ "sha1 ssse3", SHA1CompressSSSE3, NULL, OAUTH_CPU_SSSE3 },
+	{ "sha1 sha-ni", SHA1CompressSHANI, NULL, OAUTH_CPU_SHA | OAUTH_CPU_SSE41 },
+	{ "sha256 generic", NULL, SHA256CompressGeneric, 0 },
+	{ "sha256 avx2", NULL, SHA256CompressAVX2, OAUTH_CPU_AVX2 | OAUTH_CPU_BMI2 },
+	{ "sha256 sha-ni", NULL, SHA256CompressSHANI, OAUTH_CPU_SHA | OAUTH_CPU_SSE41 }
+};
+
+static void bench_bulk(const unsigned char *buf)
+{
+	uint32_t s1[5], s256[8];
+	double t, best;
+	size_t i;
+	int run, r;
+
+	for (i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+		if ((oauth_cpu_features() & backends[i].need) != backends[i].need) {
+			printf("%-16s %10s\n", backends[i].name, "-");
+			continue;
+		}
+
+		best = 0;
+		for (run = 0; run < RUNS; run++) {
+			memset(s1, 0, sizeof(s1));
+			memset(s256, 0, sizeof(s256));
+			t = now();
+			for (r = 0; r < BULK_REPS; r++) {
+				if (backends[i].sha1) backends[i].sha1(s1, buf, BULK / 64);
+				else backends[i].sha256(s256, buf, BULK / 64);
+			}
+			t = now() - t;
+			if (BULK_REPS * (double)BULK / t > best) best = BULK_REPS * (double)BULK / t;
+		}
+		printf("%-16s %10.1f MB/s\n", backends[i].name, best / 1e6);
+	}
+}
+
+int main(void)
+{
+	const char *base = "GET&http%3A%2F%2Fapi.example.com%2F1%2Fstatuses%2Fhome_timeline.json"
+		"&count%3D50%26oauth_consumer_key%3Dxvz1evFS4wEEPTGEFPHBog%26oauth_nonce%3DkYjzVBB8Y0ZFabxSWbWovY3uYSQ2pTgmZeNu2VS4cg"
+		"%26oauth_signature_method%3DHMAC-SHA1%26oauth_timestamp%3D1318622958%26oauth_token%3D370773112-GmHxMAgYyLbNEtIKZeRNFsMKPR9EyMZeS9weJAEb"
+		"%26oauth_version%3D1.0";
+	const char *key = "kAcSOqF21Fu85e7zjz7ZN2U4ZRhfV3WpwPAoE3Z7kBw&LswwdoUaIvS8ltyTt5jkRh4J50vUPVVHtR2YPi5kE";
+	const char *url = "http://api.example.com/1/statuses/home_timeline.json?count=50&include_entities=true";
+	size_t bl = strlen(base), kl = strlen(key);
+	unsigned char *buf = (unsigned char *)malloc(BULK);
+	double t, best[2];
+	int i, m, run;
+
+	for (i = 0; i < BULK; i++) buf[i] = (unsigned char)(i * 7);
+
+	printf("compression, %d x %d KB\n", BULK_REPS, BULK >> 10);
+	bench_bulk(buf);
+	printf("dispatch: sha1 %s, sha256 %s\n\n", SHA1BackendName(), SHA256BackendName());
+
+	printf("signatures of a %lu byte base string\n", (unsigned long)bl);
+	best[0] = best[1] = 0;
+	for (run = 0; run < RUNS; run++) {
+		for (m = 0; m < 2; m++) {
+			t = now();
+			for (i = 0; i < SIGS; i++) {
+				free(m ? oauth_sign_hmac_sha256_raw(base, bl, key, kl) : oauth_sign_hmac_sha1_raw(base, bl, key, kl));
+			}
+			t = now() - t;
+			if (SIGS / t > best[m]) best[m] = SIGS / t;
+		}
+	}
+	printf("%-16s %10.0f sig/s\n%-16s %10.0f sig/s\n\n", "hmac-sha1", best[0], "hmac-sha256", best[1]);
+
+	printf("oauth_sign_url2\n");
+	best[0] = best[1] = 0;
+	for (run = 0; run < RUNS; run++) {
+		for (m = 0; m < 2; m++) {
+			t = now();
+			for (i = 0; i < SIGS / 4; i++) {
+				free(oauth_sign_url2(url, NULL, m ? OA_HMAC_SHA256 : OA_HMAC, NULL,
+					"xvz1evFS4wEEPTGEFPHBog", "kAcSOqF21Fu85e7zjz7ZN2U4ZRhfV3WpwPAoE3Z7kBw",
+					"370773112-GmHxMAgYyLbNEtIKZeRNFsMKPR9EyMZeS9weJAEb", "LswwdoUaIvS8ltyTt5jkRh4J50vUPVVHtR2YPi5kE"));
+			}
+			t = now() - t;
+			if (SIGS / 4 / t > best[m]) best[m] = SIGS / 4 / t;
+		}
+	}
+	printf("%-16s %10.0f req/s\n%-16s %10.0f req/s\n", "OA_HMAC", best[0], "OA_HMAC_SHA256", best[1]);
+
+	free(buf);
+	return 0;
+}
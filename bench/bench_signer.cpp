@@ -0,0 +1,137 @@
+/* bench_signer.cpp -- oauth::signer against the C entry points
+ *
+ * Signs the same request with HMAC-SHA1 in each output form, once
+ * through the C functions an application would call for it and once
+ * through the oauth.hpp signer, and prints ns per request, best of
+ * several runs. The Authorization header has no single C entry point:
+ * it is the split, sign and two oauth_serialize_url_sep() calls of the
+ * usual recipe.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "oauth.hpp"
+
+#define RUNS 30
+#define REPS 20000
+
+static const char *url = "http://api.example.com/1/statuses/update.json"
+	"?status=Hello%20Ladies%20%2B%20Gentlemen%2C%20a%20signed%20OAuth%20request%21"
+	"&include_entities=true&lat=37.78&long=-122.40&display_coordinates=true&trim_user=1";
+static const char *c_key = "xvz1evFS4wEEPTGEFPHBog";
+static const char *c_secret = "kAcSOqF21Fu85e7zjz7ZN2U4ZRhfV3WpwPAoE3Z7kBw";
+static const char *t_key = "370773112-GmHxMAgYyLbNEtIKZeRNFsMKPR9EyMZeS9weJAEb";
+static const char *t_secret = "LswwdoUaIvS8ltyTt5jkRh4J50vUPVVHtR2YPi5kE";
+
+static double now(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static OAuthSigner *c_signer;
+static oauth::request r;
+static char **base_argv; ///< the URL split once, for the OAuthParams cases
+static int base_argc;
+
+static void c_query(void)
+{
+	free(oauth_signer_sign_url(c_signer, url, NULL, NULL));
+}
+
+static void c_post(void)
+{
+	char *postargs = NULL;
+
+	free(oauth_signer_sign_url(c_signer, url, &postargs, NULL));
+	free(postargs);
+}
+
+static void c_header(void)
+{
+	char **argv = NULL;
+	int argc = oauth_split_url_parameters(url, &argv);
+
+	oauth_signer_sign_array_process(c_signer, &argc, &argv, NULL, NULL);
+	free(oauth_serialize_url_sep(argc, 1, argv, (char *)", ", 6));
+	free(oauth_serialize_url_sep(argc, 0, argv, (char *)"&", 1));
+	oauth_free_array(&argc, &argv);
+}
+
+static void c_params(void)
+{
+	OAuthParams p = OAUTH_PARAMS_INIT;
+
+	oauth_params_add_array(&p, base_argc - 1, base_argv + 1);
+	free(oauth_signer_sign_params(c_signer, &p, base_argv[0], NULL, NULL));
+	oauth_params_free(&p);
+}
+
+template <class Form> static void cpp_url(void)
+{
+	static const oauth::signer<oauth::hmac_sha1, Form> s(c_key, c_secret, t_key, t_secret);
+
+	s.sign(r, url);
+}
+
+static void cpp_params(void)
+{
+	static const oauth::signer<oauth::hmac_sha1> s(c_key, c_secret, t_key, t_secret);
+	OAuthParams p = OAUTH_PARAMS_INIT;
+
+	oauth_params_add_array(&p, base_argc - 1, base_argv + 1);
+	s.sign(r, base_argv[0], p);
+	oauth_params_free(&p);
+}
+
+struct bench {
+	const char *name;
+	void (*c)(void);
+	void (*cpp)(void);
+};
+
+static const bench benches[] = {
+	{ "query string", c_query, cpp_url<oauth::query_string> },
+	{ "post body", c_post, cpp_url<oauth::post_body> },
+	{ "auth header", c_header, cpp_url<oauth::auth_header> },
+	{ "OAuthParams", c_params, cpp_params }
+};
+
+/* ns per call, best of RUNS */
+static double measure(void (*f)(void))
+{
+	double t, best = 0;
+	int run, i;
+
+	for (run = 0; run < RUNS; run++) {
+		t = now();
+		for (i = 0; i < REPS; i++) f();
+		t = now() - t;
+		if (best == 0 || t < best) best = t;
+	}
+	return best / REPS * 1e9;
+}
+
+int main(void)
+{
+	double c, cpp;
+	size_t i;
+
+	c_signer = oauth_signer_new(OA_HMAC, c_key, c_secret, t_key, t_secret);
+	base_argc = oauth_split_url_parameters(url, &base_argv);
+
+	printf("%-14s %10s %10s %8s\n", "HMAC-SHA1", "C ns", "C++ ns", "speedup");
+	for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		c = measure(benches[i].c);
+		cpp = measure(benches[i].cpp);
+		printf("%-14s %10.0f %10.0f %7.2fx\n", benches[i].name, c, cpp, c / cpp);
+	}
+
+	oauth_free_array(&base_argc, &base_argv);
+	oauth_signer_free(c_signer);
+	return 0;
+}
@@ -0,0 +1,99 @@
+/* cpu.c -- runtime detection of x86 instruction set extensions
+ *
+ * The result is used to pick the SIMD kernels in sha1_x86.c and friends.
+ */
+
+#include "cpu.h"
+
+#ifdef OAUTH_X86
+#ifdef _MSC_VER
+	#include <intrin.h>
+#else
+	#include <cpuid.h>
+#endif
+
+static void cpu_cpuid(unsigned int leaf, unsigned int subleaf, unsigned int r[4])
+{
+#ifdef _MSC_VER
+	int regs[4];
+	__cpuidex(regs, (int)leaf, (int)subleaf);
+	r[0] = regs[0]; r[1] = regs[1]; r[2] = regs[2]; r[3] = regs[3];
+#else
+	__cpuid_count(leaf, subleaf, r[0], r[1], r[2], r[3]);
+#endif
+}
+
+static unsigned long long cpu_xgetbv(void)
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int lo, hi;
+	__asm__ __volatile__ ("xgetbv" : "=a" (lo), "=d" (hi) : "c" (0));
+	return ((unsigned long long)hi << 32) | lo;
+#endif
+}
+
+static unsigned int cpu_detect(void)
+{
+	unsigned int r[4];
+	unsigned int max_leaf;
+	unsigned int features = 0;
+	unsigned long long xcr0 = 0;
+
+	cpu_cpuid(0, 0, r);
+	max_leaf = r[0];
+	if (max_leaf < 1) {
+		return 0;
+	}
+
+	cpu_cpuid(1, 0, r);
+	if (r[2] & (1u << 9))  features |= OAUTH_CPU_SSSE3;
+	if (r[2] & (1u << 19)) features |= OAUTH_CPU_SSE41;
+
+	// OSXSAVE: the OS saves extended register state, so XCR0 may be read
+	if (r[2] & (1u << 27)) {
+		xcr0 = cpu_xgetbv();
+	}
+
+	if (max_leaf < 7) {
+		return features;
+	}
+
+	cpu_cpuid(7, 0, r);
+	if (r[1] & (1u << 8))  features |= OAUTH_CPU_BMI2;
+	if (r[1] & (1u << 29)) features |= OAUTH_CPU_SHA;
+
+	// XMM and YMM state enabled
+	if ((xcr0 & 0x06) == 0x06 && (r[1] & (1u << 5))) {
+		features |= OAUTH_CPU_AVX2;
+	}
+
+	// XMM, YMM, opmask and ZMM state enabled; AVX-512 F, BW and VL
+	if ((xcr0 & 0xe6) == 0xe6 &&
+		(r[1] & (1u << 16)) && (r[1] & (1u << 30)) && (r[1] & (1u << 31)))
+	{
+		features |= OAUTH_CPU_AVX512;
+	}
+
+	return features;
+}
+#endif // OAUTH_X86
+
+unsigned int oauth_cpu_features(void)
+{
+#ifdef OAUTH_X86
+	// the high bit marks the cached value as valid; detection is idempotent,
+	// so a racing first call just computes the same value twice.
+	static unsigned int cached = 0;
+	unsigned int features = cached;
+
+	if (!features) {
+		features = cpu_detect() | 0x80000000u;
+		cached = features;
+	}
+	return features & ~0x80000000u;
+#else
+	return 0;
+#endif
+}
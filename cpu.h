@@ -0,0 +1,43 @@
+#ifndef _OAUTH_CPU_H
+#define _OAUTH_CPU_H      1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * x86 SIMD kernels are compiled in whenever the target is x86 (never on PSP).
+ * Each kernel carries its own target attribute, so the rest of the library
+ * is still built for the baseline ISA and the kernels are only entered after
+ * oauth_cpu_features() has confirmed the CPU supports them.
+ */
+#if !defined(PSP) && (defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86))
+#define OAUTH_X86 1
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define OAUTH_TARGET(isa) __attribute__((target(isa)))
+#else
+#define OAUTH_TARGET(isa)
+#endif
+
+enum {
+	OAUTH_CPU_SSSE3  = 0x0001,
+	OAUTH_CPU_SSE41  = 0x0002,
+	OAUTH_CPU_AVX2   = 0x0004,	///< AVX2 and OS support for the YMM state
+	OAUTH_CPU_BMI2   = 0x0008,
+	OAUTH_CPU_SHA    = 0x0010,	///< SHA extensions (SHA-NI)
+	OAUTH_CPU_AVX512 = 0x0020	///< AVX-512 F+BW+VL and OS support for the ZMM state
+};
+
+/**
+ * return a bitmask of OAUTH_CPU_* flags for the running CPU.
+ * The result is computed once and cached; it is always 0 on non-x86 builds.
+ */
+unsigned int oauth_cpu_features(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _OAUTH_CPU_H
@@ -0,0 +1,212 @@
+/* escape.c -- table driven RFC3986 percent-encoding and decoding
+ *
+ * The kernels in escape_x86.c classify and escape 16 or 32 bytes at a
+ * time, and copy the runs between '%' chars when decoding; the tables
+ * here do the tails (and everything on other CPUs).
+ */
+
+#include <string.h>
+
+#include "escape.h"
+#include "cpu.h"
+
+const unsigned char oauth_escape_safe[256] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 0x00
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 0x10
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0,	// 0x20  - .
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,	// 0x30  0-9
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	// 0x40  A-O
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,	// 0x50  P-Z _
+	0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,	// 0x60  a-o
+	1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0,	// 0x70  p-z ~
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,	// 0x80
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+};
+
+const unsigned char oauth_escape_hexval[256] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	   0,    1,    2,    3,    4,    5,    6,    7,    8,    9, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,	// 0-9
+	0xff,   10,   11,   12,   13,   14,   15, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,	// A-F
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff,   10,   11,   12,   13,   14,   15, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,	// a-f
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static const char escape_hex[] = "0123456789ABCDEF";
+
+static int escape_selected = 0;
+static oauth_escape_count_func escape_count_kernel = NULL;	///< NULL: scalar only
+static oauth_escape_write_func escape_write_kernel = NULL;
+static oauth_unescape_func unescape_kernel = NULL;
+static const char *escape_backend = "scalar";
+
+static void escape_select_backend(void)
+{
+	oauth_escape_count_func count = NULL;
+	oauth_escape_write_func write = NULL;
+	oauth_unescape_func unescape = NULL;
+#ifdef OAUTH_X86
+	unsigned int features = oauth_cpu_features();
+
+	if (features & OAUTH_CPU_AVX2) {
+		count = oauth_escape_count_avx2;
+		write = oauth_escape_write_avx2;
+		unescape = oauth_unescape_avx2;
+		escape_backend = "avx2";
+	} else if (features & OAUTH_CPU_SSSE3) {
+		count = oauth_escape_count_ssse3;
+		write = oauth_escape_write_ssse3;
+		unescape = oauth_unescape_ssse3;
+		escape_backend = "ssse3";
+	}
+#endif
+	escape_count_kernel = count;
+	escape_write_kernel = write;
+	unescape_kernel = unescape;
+	escape_selected = 1;
+}
+
+const char *oauth_escape_backend(void)
+{
+	if (!escape_selected) {
+		escape_select_backend();
+	}
+
+	return escape_backend;
+}
+
+size_t oauth_escape_count(const char *src, size_t len)
+{
+	const unsigned char *s = (const unsigned char *)src;
+	size_t unsafe = 0, done;
+
+	if (!escape_selected) {
+		escape_select_backend();
+	}
+
+	if (escape_count_kernel) {
+		done = escape_count_kernel(s, len, &unsafe);
+		s += done;
+		len -= done;
+	}
+
+	while (len--) {
+		unsafe += !oauth_escape_safe[*s++];
+	}
+
+	return unsafe;
+}
+
+size_t oauth_escape_raw(char *dst, const char *src, size_t len)
+{
+	const unsigned char *s = (const unsigned char *)src;
+	char *p = dst;
+	size_t done;
+	unsigned char in;
+
+	if (!escape_selected) {
+		escape_select_backend();
+	}
+
+	if (escape_write_kernel) {
+		done = escape_write_kernel(&p, s, len);
+		s += done;
+		len -= done;
+	}
+
+	while (len--) {
+		in = *s++;
+		if (oauth_escape_safe[in]) {
+			*p++ = in;
+		} else {
+			p[0] = '%';
+			p[1] = escape_hex[in >> 4];
+			p[2] = escape_hex[in & 15];
+			p += 3;
+		}
+	}
+
+	return p - dst;
+}
+
+/* '%' at s[-1]: decode "XX" at s[0..1] if there are two hex digits before 'end' */
+static __inline int unescape_hex(const unsigned char *s, const unsigned char *end)
+{
+	unsigned char h, l;
+
+	if (end - s < 2) return -1;
+	if ((h = oauth_escape_hexval[s[0]]) == 0xff) return -1;
+	if ((l = oauth_escape_hexval[s[1]]) == 0xff) return -1;
+	return h << 4 | l;
+}
+
+size_t oauth_unescape_count(const char *src, size_t len)
+{
+	const unsigned char *s = (const unsigned char *)src;
+	const unsigned char *end = s + len;
+	size_t n = 0;
+
+	while (s < end && (s = (const unsigned char *)memchr(s, '%', end - s))) {
+		s++;
+		if (unescape_hex(s, end) >= 0) {
+			s += 2;
+			n++;
+		}
+	}
+
+	return n;
+}
+
+size_t oauth_unescape_raw(char *dst, const char *src, size_t len)
+{
+	const unsigned char *s = (const unsigned char *)src;
+	const unsigned char *end = s + len;
+	const unsigned char *pct;
+	char *p = dst;
+	size_t run;
+	int c;
+
+	if (!escape_selected) {
+		escape_select_backend();
+	}
+
+	if (unescape_kernel) {
+		s += unescape_kernel(&p, s, len);
+	}
+
+	// copy the runs up to each '%' in bulk
+	while (s < end) {
+		pct = (const unsigned char *)memchr(s, '%', end - s);
+		run = (pct ? pct : end) - s;
+		if (p != (const char *)s) memmove(p, s, run);
+		p += run;
+		s += run;
+		if (!pct) break;
+
+		s++;
+		if ((c = unescape_hex(s, end)) >= 0) {
+			*p++ = (char)c;
+			s += 2;
+		} else {
+			*p++ = '%';
+		}
+	}
+
+	return p - dst;
+}
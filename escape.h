@@ -0,0 +1,73 @@
+#ifndef _OAUTH_ESCAPE_H
+#define _OAUTH_ESCAPE_H      1
+
+/*
+ * internal: RFC3986 percent-encoding and decoding on caller provided
+ * buffers. The public oauth_url_(un)escape* functions in oauth.c are
+ * built on these.
+ */
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* 1 for the RFC3986 unreserved chars [A-Za-z0-9-._~], 0 for all others */
+extern const unsigned char oauth_escape_safe[256];
+
+/* value of a hex digit [0-9A-Fa-f], 0xff for all other chars */
+extern const unsigned char oauth_escape_hexval[256];
+
+/* number of bytes among the 'len' of 'src' that need escaping as %XX */
+size_t oauth_escape_count(const char *src, size_t len);
+
+/*
+ * escape 'len' bytes of 'src' into exactly len + 2 * oauth_escape_count()
+ * chars at 'dst' (no terminating zero). returns the number written.
+ */
+size_t oauth_escape_raw(char *dst, const char *src, size_t len);
+
+/* number of valid %XX sequences oauth_unescape_raw() would decode */
+size_t oauth_unescape_count(const char *src, size_t len);
+
+/*
+ * decode the %XX sequences in 'len' bytes of 'src' into 'dst', which
+ * needs room for len - 2 * oauth_unescape_count() bytes. a '%' without
+ * two hex digits is copied as is; no terminating zero is added.
+ * 'dst' may be 'src' itself (in place), but may not overlap it otherwise.
+ * returns the number of bytes written.
+ */
+size_t oauth_unescape_raw(char *dst, const char *src, size_t len);
+
+const char *oauth_escape_backend(void);
+
+/*
+ * kernels: handle a prefix of whole blocks of 'src' and return how many
+ * bytes they consumed. the count kernels add the number of bytes that
+ * need escaping to '*unsafe', the write kernels advance '*dst' past what
+ * they wrote (never more than the escaped size of the consumed prefix).
+ */
+typedef size_t (*oauth_escape_count_func)(const unsigned char *src, size_t len, size_t *unsafe);
+typedef size_t (*oauth_escape_write_func)(char **dst, const unsigned char *src, size_t len);
+
+size_t oauth_escape_count_ssse3(const unsigned char *src, size_t len, size_t *unsafe);
+size_t oauth_escape_count_avx2(const unsigned char *src, size_t len, size_t *unsafe);
+size_t oauth_escape_write_ssse3(char **dst, const unsigned char *src, size_t len);
+size_t oauth_escape_write_avx2(char **dst, const unsigned char *src, size_t len);
+
+/*
+ * decoding kernels: same contract as the write kernels, with 'dst' either
+ * 'src' itself or not overlapping it. they stop once fewer than a block
+ * of bytes is left.
+ */
+typedef size_t (*oauth_unescape_func)(char **dst, const unsigned char *src, size_t len);
+
+size_t oauth_unescape_ssse3(char **dst, const unsigned char *src, size_t len);
+size_t oauth_unescape_avx2(char **dst, const unsigned char *src, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _OAUTH_ESCAPE_H
@@ -0,0 +1,300 @@
+/* escape_x86.c -- SSSE3 and AVX2 percent-encoding kernels
+ *
+ * A byte is unreserved when the pshufb lookups on its high and low
+ * nibble share a class bit (one bit per run of unreserved chars within a
+ * row of the ASCII table). Blocks without anything to escape are copied
+ * as they are, blocks with nothing but are expanded to "%XX" triples by
+ * three shuffles, and mixed blocks are written byte by byte from
+ * precomputed hex digits.
+ *
+ * Decoding copies whole blocks until one holds a '%', copies the bytes
+ * in front of it, decodes the escape through the hex table and carries
+ * on from right behind it.
+ *
+ * The kernels are only called after oauth_cpu_features() has reported
+ * the extension they are compiled for. The AVX2 ones clear the upper
+ * halves of the YMM registers before leaving the tail to the SSSE3 ones:
+ * the compiler does not always do so across the target() boundary, and
+ * legacy SSE code run with them dirty stalls on every instruction.
+ */
+
+#include "escape.h"
+#include "cpu.h"
+
+#ifdef OAUTH_X86
+
+#include <string.h>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*
+ * class bits: 0x01 "-."  0x02 "0-9"  0x04 "A-O" / "a-o"  0x08 "P-Z_"  0x10 "p-z~"
+ * indexed by high nibble and by low nibble respectively.
+ */
+#define ESCAPE_LUT_HI 0, 0, 0x01, 0x02, 0x04, 0x08, 0x04, 0x10, 0, 0, 0, 0, 0, 0, 0, 0
+#define ESCAPE_LUT_LO 0x1a, 0x1e, 0x1e, 0x1e, 0x1e, 0x1e, 0x1e, 0x1e, \
+	0x1e, 0x1e, 0x1c, 0x04, 0x04, 0x05, 0x15, 0x0c
+#define ESCAPE_HEX '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F'
+
+static __inline unsigned int escape_popcount(unsigned int m)
+{
+	m = m - ((m >> 1) & 0x55555555);
+	m = (m & 0x33333333) + ((m >> 2) & 0x33333333);
+	return (((m + (m >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+}
+
+static __inline unsigned int escape_ctz(unsigned int m)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward(&i, m);
+	return i;
+#else
+	return __builtin_ctz(m);
+#endif
+}
+
+/* 0xff in every lane that needs escaping */
+OAUTH_TARGET("ssse3")
+static __inline __m128i escape_unsafe128(__m128i v, __m128i *hi, __m128i *lo)
+{
+	const __m128i lut_hi = _mm_setr_epi8(ESCAPE_LUT_HI);
+	const __m128i lut_lo = _mm_setr_epi8(ESCAPE_LUT_LO);
+	__m128i cls;
+
+	*hi = _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f));
+	*lo = _mm_and_si128(v, _mm_set1_epi8(0x0f));
+	cls = _mm_and_si128(_mm_shuffle_epi8(lut_hi, *hi), _mm_shuffle_epi8(lut_lo, *lo));
+	return _mm_cmpeq_epi8(cls, _mm_setzero_si128());
+}
+
+/* write one 16 byte block whose unsafe lanes are flagged in 'mask' */
+OAUTH_TARGET("ssse3")
+static __inline char *escape_block128(char *p, __m128i v, __m128i hi, __m128i lo, unsigned int mask)
+{
+	const __m128i hex = _mm_setr_epi8(ESCAPE_HEX);
+	unsigned char raw[16], dh[16], dl[16];
+	__m128i h, l, hl0, hl1, pct;
+	int i;
+
+	if (!mask) {
+		_mm_storeu_si128((__m128i *)p, v);
+		return p + 16;
+	}
+
+	h = _mm_shuffle_epi8(hex, hi);
+	l = _mm_shuffle_epi8(hex, lo);
+
+	if (mask == 0xffff) {
+		// 48 chars "%h0l0%h1l1..." from the interleaved digits
+		hl0 = _mm_unpacklo_epi8(h, l);
+		hl1 = _mm_unpackhi_epi8(h, l);
+		pct = _mm_setr_epi8('%', 0, 0, '%', 0, 0, '%', 0, 0, '%', 0, 0, '%', 0, 0, '%');
+		_mm_storeu_si128((__m128i *)p, _mm_or_si128(pct,
+			_mm_shuffle_epi8(hl0, _mm_setr_epi8(-1, 0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7, -1, 8, 9, -1))));
+		pct = _mm_setr_epi8(0, 0, '%', 0, 0, '%', 0, 0, '%', 0, 0, '%', 0, 0, '%', 0);
+		_mm_storeu_si128((__m128i *)(p + 16), _mm_or_si128(pct, _mm_or_si128(
+			_mm_shuffle_epi8(hl0, _mm_setr_epi8(10, 11, -1, 12, 13, -1, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1)),
+			_mm_shuffle_epi8(hl1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 1, -1, 2, 3, -1, 4)))));
+		pct = _mm_setr_epi8(0, '%', 0, 0, '%', 0, 0, '%', 0, 0, '%', 0, 0, '%', 0, 0);
+		_mm_storeu_si128((__m128i *)(p + 32), _mm_or_si128(pct,
+			_mm_shuffle_epi8(hl1, _mm_setr_epi8(5, -1, 6, 7, -1, 8, 9, -1, 10, 11, -1, 12, 13, -1, 14, 15))));
+		return p + 48;
+	}
+
+	_mm_storeu_si128((__m128i *)raw, v);
+	_mm_storeu_si128((__m128i *)dh, h);
+	_mm_storeu_si128((__m128i *)dl, l);
+	for (i = 0; i < 16; i++, mask >>= 1) {
+		if (mask & 1) {
+			p[0] = '%';
+			p[1] = dh[i];
+			p[2] = dl[i];
+			p += 3;
+		} else {
+			*p++ = raw[i];
+		}
+	}
+	return p;
+}
+
+OAUTH_TARGET("ssse3")
+size_t oauth_escape_count_ssse3(const unsigned char *src, size_t len, size_t *unsafe)
+{
+	size_t done = 0, n = 0;
+	__m128i hi, lo;
+
+	for (; len - done >= 16; done += 16) {
+		n += escape_popcount(_mm_movemask_epi8(
+			escape_unsafe128(_mm_loadu_si128((const __m128i *)(src + done)), &hi, &lo)));
+	}
+
+	*unsafe += n;
+	return done;
+}
+
+OAUTH_TARGET("ssse3")
+size_t oauth_escape_write_ssse3(char **dst, const unsigned char *src, size_t len)
+{
+	char *p = *dst;
+	size_t done = 0;
+	__m128i v, hi, lo;
+	unsigned int mask;
+
+	for (; len - done >= 16; done += 16) {
+		v = _mm_loadu_si128((const __m128i *)(src + done));
+		mask = _mm_movemask_epi8(escape_unsafe128(v, &hi, &lo));
+		p = escape_block128(p, v, hi, lo, mask);
+	}
+
+	*dst = p;
+	return done;
+}
+
+OAUTH_TARGET("avx2")
+static __inline __m256i escape_unsafe256(__m256i v)
+{
+	const __m256i lut_hi = _mm256_setr_epi8(ESCAPE_LUT_HI, ESCAPE_LUT_HI);
+	const __m256i lut_lo = _mm256_setr_epi8(ESCAPE_LUT_LO, ESCAPE_LUT_LO);
+	const __m256i nib = _mm256_set1_epi8(0x0f);
+	__m256i cls;
+
+	cls = _mm256_and_si256(
+		_mm256_shuffle_epi8(lut_hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nib)),
+		_mm256_shuffle_epi8(lut_lo, _mm256_and_si256(v, nib)));
+	return _mm256_cmpeq_epi8(cls, _mm256_setzero_si256());
+}
+
+OAUTH_TARGET("avx2")
+size_t oauth_escape_count_avx2(const unsigned char *src, size_t len, size_t *unsafe)
+{
+	size_t done = 0, n = 0;
+
+	for (; len - done >= 32; done += 32) {
+		n += escape_popcount((unsigned int)_mm256_movemask_epi8(
+			escape_unsafe256(_mm256_loadu_si256((const __m256i *)(src + done)))));
+	}
+
+	*unsafe += n;
+	_mm256_zeroupper();
+	return done + oauth_escape_count_ssse3(src + done, len - done, unsafe);
+}
+
+OAUTH_TARGET("avx2")
+size_t oauth_escape_write_avx2(char **dst, const unsigned char *src, size_t len)
+{
+	char *p = *dst;
+	size_t done = 0;
+	__m256i v;
+	__m128i half, hi, lo;
+	unsigned int mask;
+
+	for (; len - done >= 32; done += 32) {
+		v = _mm256_loadu_si256((const __m256i *)(src + done));
+		mask = (unsigned int)_mm256_movemask_epi8(escape_unsafe256(v));
+		if (!mask) {
+			_mm256_storeu_si256((__m256i *)p, v);
+			p += 32;
+			continue;
+		}
+
+		half = _mm256_castsi256_si128(v);
+		escape_unsafe128(half, &hi, &lo);
+		p = escape_block128(p, half, hi, lo, mask & 0xffff);
+		half = _mm256_extracti128_si256(v, 1);
+		escape_unsafe128(half, &hi, &lo);
+		p = escape_block128(p, half, hi, lo, mask >> 16);
+	}
+
+	*dst = p;
+	_mm256_zeroupper();
+	return done + oauth_escape_write_ssse3(dst, src + done, len - done);
+}
+
+/*
+ * the bytes in front of the first '%' in a block ('m' its bit mask),
+ * then the escape itself. returns the number of source bytes used.
+ * byte by byte: a full store could clobber unread input when in place,
+ * or run past the end of an exactly sized 'dst'.
+ */
+static __inline size_t unescape_step(char **dst, const unsigned char *s, size_t left, unsigned int m)
+{
+	char *p = *dst;
+	unsigned int i, n = escape_ctz(m);
+	unsigned char h, l;
+
+	if (p != (const char *)s) {
+		for (i = 0; i < n; i++) p[i] = s[i];
+	}
+	p += n;
+
+	if (left - n >= 3 &&
+		(h = oauth_escape_hexval[s[n + 1]]) != 0xff &&
+		(l = oauth_escape_hexval[s[n + 2]]) != 0xff)
+	{
+		*p++ = (char)(h << 4 | l);
+		n += 3;
+	} else {
+		*p++ = '%';
+		n += 1;
+	}
+
+	*dst = p;
+	return n;
+}
+
+OAUTH_TARGET("ssse3")
+size_t oauth_unescape_ssse3(char **dst, const unsigned char *src, size_t len)
+{
+	const __m128i pct = _mm_set1_epi8('%');
+	char *p = *dst;
+	size_t done = 0;
+	__m128i v;
+	unsigned int m;
+
+	while (len - done >= 16) {
+		v = _mm_loadu_si128((const __m128i *)(src + done));
+		m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, pct));
+		if (!m) {
+			// in place and nothing decoded yet: the bytes are already there
+			if (p != (const char *)src + done) _mm_storeu_si128((__m128i *)p, v);
+			p += 16;
+			done += 16;
+			continue;
+		}
+		done += unescape_step(&p, src + done, len - done, m);
+	}
+
+	*dst = p;
+	return done;
+}
+
+OAUTH_TARGET("avx2")
+size_t oauth_unescape_avx2(char **dst, const unsigned char *src, size_t len)
+{
+	const __m256i pct = _mm256_set1_epi8('%');
+	char *p = *dst;
+	size_t done = 0;
+	__m256i v;
+	unsigned int m;
+
+	while (len - done >= 32) {
+		v = _mm256_loadu_si256((const __m256i *)(src + done));
+		m = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pct));
+		if (!m) {
+			if (p != (const char *)src + done) _mm256_storeu_si256((__m256i *)p, v);
+			p += 32;
+			done += 32;
+			continue;
+		}
+		done += unescape_step(&p, src + done, len - done, m);
+	}
+
+	*dst = p;
+	_mm256_zeroupper();
+	return done + oauth_unescape_ssse3(dst, src + done, len - done);
+}
+
+#endif // OAUTH_X86
@@ -1,32 +1,34 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-#include "oauth.h" // base64 encode fn's.
-#include "xmalloc.h"
-#ifndef PSP
-	#include "sha1.h"
-	typedef SHA1Context SHA1Context_t;
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef WIN32
+	#include <io.h>
 #else
-	#include <psputils.h>
-	typedef SceKernelUtilsSha1Context SHA1Context_t;
-	#define SHA1Reset(ctx) 				sceKernelUtilsSha1BlockInit(ctx)
-	#define SHA1Input(ctx, key, len)	sceKernelUtilsSha1BlockUpdate(ctx, (u8 *)key, (u32)len)
-	#define SHA1Result(ctx, digest) 	sceKernelUtilsSha1BlockResult(ctx, (u8 *)digest)
+	#include <unistd.h>
+	#include <errno.h>
+#endif
+#if !defined(WIN32) && !defined(PSP)
+	#include <sys/mman.h>
+	#define HAVE_MMAP 1
 #endif
 
+#include "oauth.h" // base64 encode fn's.
+#include "xmalloc.h"
+#include "hash.h"
 
+/*
+ * copy the HMAC key into a zero padded 64 byte block XORed with 'pad'.
+ * keys longer than one block are replaced by their SHA-1 digest.
+ */
 static
-void hmac_sha1(const unsigned char *key, size_t keylen, const unsigned char *in, size_t inlen, unsigned char *resbuf)
+void hmac_sha1_pad_block(const unsigned char *key, size_t keylen, int pad, unsigned char *block)
 {
-	const int IPAD = 0x36;
-	const int OPAD = 0x5c;
-
-	SHA1Context_t inner;
-	SHA1Context_t outer;
 	SHA1Context_t keyhash;
 	unsigned char tmpkey[20];
-	unsigned char digest[20];
-	unsigned char block[64];
 	size_t i;
 
 	if (keylen > 64) {
@@ -37,18 +39,30 @@ void hmac_sha1(const unsigned char *key, size_t keylen, const unsigned char *in,
 		keylen = 20;
 	}
 
-	for (i = 0; i < sizeof(block); i++) {
-		block[i] = IPAD ^ (i < keylen ? key[i] : 0);
+	for (i = 0; i < 64; i++) {
+		block[i] = pad ^ (i < keylen ? key[i] : 0);
 	}
+}
+
+static
+void hmac_sha1(const unsigned char *key, size_t keylen, const unsigned char *in, size_t inlen, unsigned char *resbuf)
+{
+	const int IPAD = 0x36;
+	const int OPAD = 0x5c;
+
+	SHA1Context_t inner;
+	SHA1Context_t outer;
+	unsigned char digest[20];
+	unsigned char block[64];
+
+	hmac_sha1_pad_block(key, keylen, IPAD, block);
 
 	SHA1Reset(&inner);
 	SHA1Input(&inner, block, 64);
 	SHA1Input(&inner, in, inlen);
 	SHA1Result(&inner, digest);
 
-	for (i = 0; i < sizeof(block); i++) {
-		block[i] = OPAD ^ (i < keylen ? key[i] : 0);
-	}
+	hmac_sha1_pad_block(key, keylen, OPAD, block);
 
 	SHA1Reset(&outer);
 	SHA1Input(&outer, block, 64);
@@ -56,6 +70,67 @@ void hmac_sha1(const unsigned char *key, size_t keylen, const unsigned char *in,
 	SHA1Result(&outer, resbuf);
 }
 
+/*
+ * same as hmac_sha1_pad_block for HMAC-SHA256; long keys are replaced
+ * by their SHA-256 digest.
+ */
+static
+void hmac_sha256_pad_block(const unsigned char *key, size_t keylen, int pad, unsigned char *block)
+{
+	SHA256Context keyhash;
+	unsigned char tmpkey[SHA256HashSize];
+	size_t i;
+
+	if (keylen > 64) {
+		SHA256Reset(&keyhash);
+		SHA256Input(&keyhash, key, keylen);
+		SHA256Result(&keyhash, tmpkey);
+		key = tmpkey;
+		keylen = SHA256HashSize;
+	}
+
+	for (i = 0; i < 64; i++) {
+		block[i] = pad ^ (i < keylen ? key[i] : 0);
+	}
+}
+
+static
+void hmac_sha256(const unsigned char *key, size_t keylen, const unsigned char *in, size_t inlen, unsigned char *resbuf)
+{
+	SHA256Context ctx;
+	unsigned char digest[SHA256HashSize];
+	unsigned char block[64];
+
+	hmac_sha256_pad_block(key, keylen, 0x36, block);
+
+	SHA256Reset(&ctx);
+	SHA256Input(&ctx, block, 64);
+	SHA256Input(&ctx, in, inlen);
+	SHA256Result(&ctx, digest);
+
+	hmac_sha256_pad_block(key, keylen, 0x5c, block);
+
+	SHA256Reset(&ctx);
+	SHA256Input(&ctx, block, 64);
+	SHA256Input(&ctx, digest, SHA256HashSize);
+	SHA256Result(&ctx, resbuf);
+
+	memset(block, 0, sizeof(block));
+	memset(digest, 0, sizeof(digest));
+}
+
+char *oauth_sign_hmac_sha256_raw(const char *m, size_t ml, const char *k, size_t kl)
+{
+	unsigned char result[SHA256HashSize];
+	hmac_sha256((unsigned char *)k, kl, (unsigned char *)m, ml, result);
+	return oauth_encode_base64(SHA256HashSize, result);
+}
+
+char *oauth_sign_hmac_sha256(const char *m, const char *k)
+{
+	return oauth_sign_hmac_sha256_raw(m, strlen(m), k, strlen(k));
+}
+
 char *oauth_sign_hmac_sha1_raw(const char *m, size_t ml, const char *k, size_t kl)
 {
 	unsigned char result[20];
@@ -69,37 +144,402 @@ char *oauth_sign_hmac_sha1(const char *m, const char *k)
 }
 
 
-char *oauth_body_hash_file(char *filename)
+/*
+ * prepared HMAC key: SHA-1 contexts that have already absorbed the
+ * ipad and opad blocks. Signing copies them instead of re-hashing the
+ * pad blocks, which saves two compressions per signature.
+ */
+struct OAuthHmacKey {
+	SHA1Context_t inner;
+	SHA1Context_t outer;
+};
+
+OAuthHmacKey *oauth_hmac_sha1_prepare(const char *k, size_t kl)
+{
+	OAuthHmacKey *key;
+	unsigned char block[64];
+
+	key = (OAuthHmacKey *)xmalloc(sizeof(OAuthHmacKey));
+
+	hmac_sha1_pad_block((const unsigned char *)k, kl, 0x36, block);
+	SHA1Reset(&key->inner);
+	SHA1Input(&key->inner, block, 64);
+
+	hmac_sha1_pad_block((const unsigned char *)k, kl, 0x5c, block);
+	SHA1Reset(&key->outer);
+	SHA1Input(&key->outer, block, 64);
+
+	memset(block, 0, sizeof(block));
+	return key;
+}
+
+void oauth_hmac_key_free(OAuthHmacKey *key)
+{
+	if (!key) return;
+
+	memset(key, 0, sizeof(OAuthHmacKey));
+	xfree(key);
+}
+
+char *oauth_sign_hmac_sha1_prepared(const char *m, size_t ml, const OAuthHmacKey *key)
 {
-	size_t len = 0;
-	char data[4096];
 	SHA1Context_t ctx;
-	FILE *fp = NULL;
-	unsigned char *digest;
+	unsigned char digest[20];
 
-#ifdef WIN32
-	fp = fopen(filename, "rb");
+	ctx = key->inner;
+	SHA1Input(&ctx, (const unsigned char *)m, ml);
+	SHA1Result(&ctx, digest);
+
+	ctx = key->outer;
+	SHA1Input(&ctx, digest, 20);
+	SHA1Result(&ctx, digest);
+
+	memset(&ctx, 0, sizeof(ctx));
+	return oauth_encode_base64(20, digest);
+}
+
+int oauth_hmac_start(OAuthHmacCtx *ctx, OAuthMethod method, const char *k, size_t kl)
+{
+	unsigned char block[64];
+
+	if (method != OA_HMAC && method != OA_HMAC_SHA256) return 0;
+
+	ctx->method = method;
+
+	if (method == OA_HMAC_SHA256) {
+		hmac_sha256_pad_block((const unsigned char *)k, kl, 0x36, block);
+		SHA256Reset(&ctx->inner.sha256);
+		SHA256Input(&ctx->inner.sha256, block, 64);
+
+		hmac_sha256_pad_block((const unsigned char *)k, kl, 0x5c, block);
+		SHA256Reset(&ctx->outer.sha256);
+		SHA256Input(&ctx->outer.sha256, block, 64);
+	} else {
+		hmac_sha1_pad_block((const unsigned char *)k, kl, 0x36, block);
+		SHA1Reset(&ctx->inner.sha1);
+		SHA1Input(&ctx->inner.sha1, block, 64);
+
+		hmac_sha1_pad_block((const unsigned char *)k, kl, 0x5c, block);
+		SHA1Reset(&ctx->outer.sha1);
+		SHA1Input(&ctx->outer.sha1, block, 64);
+	}
+
+	memset(block, 0, sizeof(block));
+	return 1;
+}
+
+size_t oauth_hmac_finish(OAuthHmacCtx *ctx, unsigned char digest[OAUTH_HMAC_MAX_DIGEST])
+{
+	size_t size;
+
+	if (ctx->method == OA_HMAC_SHA256) {
+		size = SHA256HashSize;
+		SHA256Result(&ctx->inner.sha256, digest);
+		SHA256Input(&ctx->outer.sha256, digest, size);
+		SHA256Result(&ctx->outer.sha256, digest);
+	} else {
+		size = 20;
+		SHA1Result(&ctx->inner.sha1, digest);
+		SHA1Input(&ctx->outer.sha1, digest, size);
+		SHA1Result(&ctx->outer.sha1, digest);
+	}
+
+	memset(ctx, 0, sizeof(OAuthHmacCtx));
+	return size;
+}
+
+OAuthHmacCtx *oauth_hmac_init(OAuthMethod method, const char *k, size_t kl)
+{
+	OAuthHmacCtx *ctx;
+
+	if (method != OA_HMAC && method != OA_HMAC_SHA256) return NULL;
+
+	ctx = (OAuthHmacCtx *)xmalloc(sizeof(OAuthHmacCtx));
+	oauth_hmac_start(ctx, method, k, kl);
+	return ctx;
+}
+
+OAuthHmacCtx *oauth_hmac_init_prepared(const OAuthHmacKey *key)
+{
+	OAuthHmacCtx *ctx;
+
+	ctx = (OAuthHmacCtx *)xmalloc(sizeof(OAuthHmacCtx));
+	ctx->method = OA_HMAC;
+	ctx->inner.sha1 = key->inner;
+	ctx->outer.sha1 = key->outer;
+	return ctx;
+}
+
+void oauth_hmac_update(OAuthHmacCtx *ctx, const char *m, size_t ml)
+{
+	if (ml == 0) return;
+
+	if (ctx->method == OA_HMAC_SHA256) {
+		SHA256Input(&ctx->inner.sha256, (const unsigned char *)m, ml);
+	} else {
+		SHA1Input(&ctx->inner.sha1, (const unsigned char *)m, ml);
+	}
+}
+
+char *oauth_hmac_final(OAuthHmacCtx *ctx)
+{
+	unsigned char digest[OAUTH_HMAC_MAX_DIGEST];
+	size_t size;
+
+	size = oauth_hmac_finish(ctx, digest);
+	xfree(ctx);
+	return oauth_encode_base64(size, digest);
+}
+
+#ifndef PSP
+#define HMAC_BATCH_CHUNK 64 ///< messages per multi-buffer pass, bounds stack use
+
+/*
+ * HMAC-SHA1 over up to HMAC_BATCH_CHUNK messages with the multi-buffer
+ * engine: the pad blocks of all keys, then all inner hashes and finally
+ * all outer hashes are each computed side by side.
+ */
+static
+void hmac_sha1_multi(size_t n, const char **m, const size_t *ml, const char **k, const size_t *kl, char **sigs)
+{
+	static const uint32_t iv[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+
+	SHA1MultiJob inner[HMAC_BATCH_CHUNK];
+	SHA1MultiJob outer[HMAC_BATCH_CHUNK];
+	unsigned char pads[HMAC_BATCH_CHUNK * 2][64];
+	uint32_t *states[HMAC_BATCH_CHUNK * 2];
+	const uint8_t *blocks[HMAC_BATCH_CHUNK * 2];
+	size_t i, keylen;
+
+	for (i = 0; i < n; i++) {
+		keylen = kl ? kl[i] : strlen(k[i]);
+		hmac_sha1_pad_block((const unsigned char *)k[i], keylen, 0x36, pads[2 * i]);
+		hmac_sha1_pad_block((const unsigned char *)k[i], keylen, 0x5c, pads[2 * i + 1]);
+
+		memcpy(inner[i].state, iv, sizeof(iv));
+		memcpy(outer[i].state, iv, sizeof(iv));
+		states[2 * i] = inner[i].state;
+		states[2 * i + 1] = outer[i].state;
+		blocks[2 * i] = pads[2 * i];
+		blocks[2 * i + 1] = pads[2 * i + 1];
+	}
+
+	SHA1MultiCompress(states, blocks, 2 * n);
+
+	for (i = 0; i < n; i++) {
+		inner[i].data = (const uint8_t *)m[i];
+		inner[i].length = ml ? ml[i] : strlen(m[i]);
+		inner[i].prefix_length = 64;
+	}
+
+	SHA1MultiBuffer(inner, n);
+
+	for (i = 0; i < n; i++) {
+		outer[i].data = inner[i].digest;
+		outer[i].length = 20;
+		outer[i].prefix_length = 64;
+	}
+
+	SHA1MultiBuffer(outer, n);
+
+	for (i = 0; i < n; i++) {
+		sigs[i] = oauth_encode_base64(20, outer[i].digest);
+	}
+
+	// wipe key material and intermediate digests
+	memset(pads, 0, 2 * n * sizeof(pads[0]));
+	memset(inner, 0, n * sizeof(inner[0]));
+	memset(outer, 0, n * sizeof(outer[0]));
+}
+#endif
+
+void oauth_sign_hmac_sha1_batch(size_t n, const char **m, const size_t *ml, const char **k, const size_t *kl, char **sigs)
+{
+#ifndef PSP
+	size_t chunk;
+
+	while (n > 0) {
+		chunk = (n < HMAC_BATCH_CHUNK) ? n : HMAC_BATCH_CHUNK;
+		hmac_sha1_multi(chunk, m, ml, k, kl, sigs);
+
+		m += chunk;
+		k += chunk;
+		sigs += chunk;
+		if (ml) ml += chunk;
+		if (kl) kl += chunk;
+		n -= chunk;
+	}
+#else
+	size_t i;
+
+	for (i = 0; i < n; i++) {
+		sigs[i] = oauth_sign_hmac_sha1_raw(m[i], ml ? ml[i] : strlen(m[i]), k[i], kl ? kl[i] : strlen(k[i]));
+	}
+#endif
+}
+
+#define BODY_HASH_READ_SIZE		(1 << 20)	///< read(2) chunk size for files that are not mapped
+#define BODY_HASH_MMAP_MIN		(1 << 16)	///< smaller ranges are read, mapping them costs more
+#define BODY_HASH_MMAP_WINDOW	(64 << 20)	///< map large files piecewise, bounds address space use
+
+#ifdef HAVE_MMAP
+/*
+ * hash up to 'length' bytes of 'fd' from 'offset' through a read-only
+ * mapping. returns the number of bytes hashed, which is short when the
+ * file can not be mapped (the caller reads the rest).
+ */
+static
+size_t body_hash_mmap(SHA1Context_t *ctx, int fd, off_t offset, size_t length)
+{
+	long page = sysconf(_SC_PAGESIZE);
+	size_t done = 0, chunk, skip;
+	off_t base;
+	void *map;
+
+	if (page <= 0 || length < BODY_HASH_MMAP_MIN) {
+		return 0;
+	}
+
+	while (done < length) {
+		chunk = length - done;
+		if (chunk > BODY_HASH_MMAP_WINDOW) chunk = BODY_HASH_MMAP_WINDOW;
+
+		base = (offset + (off_t)done) & ~((off_t)page - 1);
+		skip = (size_t)(offset + (off_t)done - base);
+
+		map = mmap(NULL, chunk + skip, PROT_READ, MAP_PRIVATE, fd, base);
+		if (map == MAP_FAILED) {
+			break;
+		}
+		madvise(map, chunk + skip, MADV_SEQUENTIAL);
+
+		SHA1Input(ctx, (const unsigned char *)map + skip, chunk);
+		munmap(map, chunk + skip);
+		done += chunk;
+	}
+
+	return done;
+}
+#endif
+
+/*
+ * hash 'length' bytes of 'fd' from 'offset' with large reads; 
+ * length OAUTH_BODY_HASH_TO_EOF reads up to EOF. returns 0 on success, -1 on error.
+ * On POSIX systems pread() is used, so the file position is unchanged
+ * unless 'fd' is not seekable (offset 0 only).
+ */
+static
+int body_hash_read(SHA1Context_t *ctx, int fd, off_t offset, size_t length)
+{
+	unsigned char *buf;
+	size_t want;
+	long n;
+	int rv = 0;
+#ifdef HAVE_MMAP
+	int seekable = 1;
+
+	posix_fadvise(fd, offset, (length == OAUTH_BODY_HASH_TO_EOF) ? 0 : (off_t)length, POSIX_FADV_SEQUENTIAL);
+#else
+	if (lseek(fd, offset, SEEK_SET) == (off_t)-1 && offset != 0) {
+		return -1;
+	}
+#endif
+
+	buf = (unsigned char *)xmalloc(BODY_HASH_READ_SIZE);
+
+	while (length > 0) {
+		want = (length < BODY_HASH_READ_SIZE) ? length : BODY_HASH_READ_SIZE;
+#ifdef HAVE_MMAP
+		if (seekable) {
+			n = pread(fd, buf, want, offset);
+			if (n < 0 && errno == ESPIPE && offset == 0) {
+				seekable = 0;
+				continue;
+			}
+		} else {
+			n = read(fd, buf, want);
+		}
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
 #else
-	fp = fopen(filename, "r");
+		n = read(fd, buf, (unsigned int)want);
 #endif
-	if (!fp) {
+		if (n < 0) {
+			rv = -1;
+			break;
+		}
+		if (n == 0) {
+			break; // EOF
+		}
+
+		SHA1Input(ctx, buf, (size_t)n);
+		offset += n;
+		if (length != OAUTH_BODY_HASH_TO_EOF) length -= (size_t)n;
+	}
+
+	xfree(buf);
+	return rv;
+}
+
+char *oauth_body_hash_fd(int fd, off_t offset, size_t length)
+{
+	SHA1Context_t ctx;
+	unsigned char *digest;
+	struct stat st;
+	size_t done = 0;
+
+	if (fd < 0 || offset < 0) {
 		return NULL;
 	}
 
-	SHA1Reset(&ctx); // init sha1
+	// clamp to the file size; regular files only, pipes are read until EOF.
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+		if (offset >= st.st_size) {
+			length = 0;
+		} else if (length > (size_t)(st.st_size - offset)) {
+			length = (size_t)(st.st_size - offset);
+		}
+	}
+
+	SHA1Reset(&ctx);
 
-	// read file
-	while ((len = fread(data, sizeof(unsigned char), sizeof data, fp)) > 0) {
-		SHA1Input(&ctx, data, len);
+#ifdef HAVE_MMAP
+	if (length != OAUTH_BODY_HASH_TO_EOF) {
+		done = body_hash_mmap(&ctx, fd, offset, length);
 	}
+#endif
 
-	fclose(fp);
+	if (done < length &&
+		body_hash_read(&ctx, fd, offset + (off_t)done, (length == OAUTH_BODY_HASH_TO_EOF) ? length : length - done) < 0)
+	{
+		return NULL;
+	}
 
 	digest = (unsigned char *)xmalloc(20 * sizeof(unsigned char));
 	SHA1Result(&ctx, digest);
 	return oauth_body_hash_encode(20, digest);
 }
 
+char *oauth_body_hash_file(char *filename)
+{
+	char *rv;
+	int fd;
+
+#ifdef WIN32
+	fd = open(filename, O_RDONLY | O_BINARY);
+#else
+	fd = open(filename, O_RDONLY);
+#endif
+	if (fd < 0) {
+		return NULL;
+	}
+
+	rv = oauth_body_hash_fd(fd, 0, OAUTH_BODY_HASH_TO_EOF);
+	close(fd);
+	return rv;
+}
+
 char *oauth_body_hash_data(size_t length, const char *data)
 {
 	SHA1Context_t ctx;
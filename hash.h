@@ -0,0 +1,55 @@
+#ifndef _OAUTH_HASH_H
+#define _OAUTH_HASH_H      1
+
+/*
+ * internal: hash contexts shared by hash.c and the code that keeps
+ * HMAC state on the stack (no allocation per request).
+ */
+
+#include "oauth.h"
+#include "sha256.h"
+#ifndef PSP
+	#include "sha1.h"
+	typedef SHA1Context SHA1Context_t;
+#else
+	#include <psputils.h>
+	typedef SceKernelUtilsSha1Context SHA1Context_t;
+	#define SHA1Reset(ctx) 				sceKernelUtilsSha1BlockInit(ctx)
+	#define SHA1Input(ctx, key, len)	sceKernelUtilsSha1BlockUpdate(ctx, (u8 *)key, (u32)len)
+	#define SHA1Result(ctx, digest) 	sceKernelUtilsSha1BlockResult(ctx, (u8 *)digest)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OAUTH_HMAC_MAX_DIGEST	SHA256HashSize	///< largest digest of the HMAC methods
+
+/*
+ * incremental HMAC: the inner context absorbs the message piecewise,
+ * the outer one is only fed the inner digest when finishing.
+ */
+typedef union {
+	SHA1Context_t sha1;
+	SHA256Context sha256;
+} oauth_hmac_state;
+
+struct OAuthHmacCtx {
+	OAuthMethod method;	///< OA_HMAC or OA_HMAC_SHA256
+	oauth_hmac_state inner;
+	oauth_hmac_state outer;
+};
+
+/*
+ * same as oauth_hmac_init / oauth_hmac_final on caller provided memory.
+ * oauth_hmac_start returns 0 if method is not an HMAC method;
+ * oauth_hmac_finish stores the raw digest and returns its length.
+ */
+int oauth_hmac_start(OAuthHmacCtx *ctx, OAuthMethod method, const char *k, size_t kl);
+size_t oauth_hmac_finish(OAuthHmacCtx *ctx, unsigned char digest[OAUTH_HMAC_MAX_DIGEST]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _OAUTH_HASH_H
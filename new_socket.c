@@ -28,8 +28,14 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#if !defined(WIN32) && !defined(PSP)
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#define HAVE_MMAP
+#endif
 #include "new_socket.h"
 #include "xmalloc.h"
+#include "hash.h"
 
 #ifndef WIN32
 	#define closesocket(s)  close(s)
@@ -201,7 +207,7 @@ void *socket_read_alloc(socket_t sock, size_t *readsize)
 		while (recvsize > 0) {
 			res = recv(sock, pos, recvsize, 0);
 			if (res < 0) {
-				free(buffer);
+				xfree(buffer);
 				*readsize = 0;
 				return NULL;
 			}
@@ -283,8 +289,170 @@ size_t socket_write_file(socket_t sock, const char *filename, size_t filesize)
 		ntotal += nwrite;
 	}
 
-	free(buffer);
+	xfree(buffer);
+	fclose(fp);
+	return ntotal;
+}
+
+#define FILE_BODY_BLOCK		0x2000		///< read and send size of streamed bodies
+#define FILE_BODY_LOAD_MAX	(4 << 20)	///< larger files are streamed where mmap is unavailable
+
+/*
+ * the body of socket_http_post_file2(), as it was passed to the header
+ * callback. a copy read into memory (also when empty) is sent as it is.
+ * a mapping, or a body too large to hold that is streamed from the file
+ * a second time, can change under us: 'digest' is the SHA-1 of what was
+ * fed, for file_body_send() to check.
+ */
+typedef struct {
+	unsigned char *data;	///< NULL if streamed
+	size_t size;
+	int mapped;				///< 'data' is a mapping, release it with munmap()
+	unsigned char digest[20];
+} file_body;
+
+/*
+ * read a file once for socket_http_post_file2() and pass it to 'feed'.
+ * it is mapped where possible, otherwise read into memory up to
+ * FILE_BODY_LOAD_MAX, and a larger file is fed in blocks. only the copy
+ * in memory can not change before it is sent; the others are hashed
+ * for file_body_send().
+ * returns 0, or -1 if the file can not be read.
+ */
+static int file_body_read(const char *filename, socket_header_func feed, void *user, file_body *b)
+{
+	size_t nread, room;
+	unsigned char *buffer;
+	SHA1Context_t sha1;
+	struct stat st;
+	FILE *fp;
+#ifdef HAVE_MMAP
+	int fd;
+
+	if ((fd = open(filename, O_RDONLY)) < 0) {
+		return -1;
+	}
+
+	if (fstat(fd, &st) == -1) {
+		close(fd);
+		return -1;
+	}
+
+	b->data = st.st_size ? (unsigned char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (b->data != MAP_FAILED) {
+		madvise(b->data, st.st_size, MADV_SEQUENTIAL);
+		feed(b->data, st.st_size, user);
+		SHA1Reset(&sha1);
+		SHA1Input(&sha1, b->data, st.st_size);
+		SHA1Result(&sha1, b->digest);
+		b->size = st.st_size;
+		b->mapped = 1;
+		return 0;
+	}
+#endif
+
+	b->data = NULL;
+	b->size = 0;
+	b->mapped = 0;
+	if (stat(filename, &st) == -1 || !(fp = fopen(filename, "rb"))) {
+		return -1;
+	}
+
+	if ((size_t)st.st_size <= FILE_BODY_LOAD_MAX) {
+		// room for one more byte, so a file that grew since stat() still
+		// ends in a short read
+		room = (size_t)st.st_size + 1;
+		buffer = (unsigned char *)xmalloc(room);
+		while ((nread = fread(buffer + b->size, 1, room - b->size, fp)) > 0) {
+			b->size += nread;
+			if (b->size == room) {
+				room *= 2;
+				buffer = (unsigned char *)xrealloc(buffer, room);
+			}
+		}
+		if (ferror(fp)) {
+			xfree(buffer);
+			fclose(fp);
+			return -1;
+		}
+
+		fclose(fp);
+		if (b->size) feed(buffer, b->size, user);
+		b->data = buffer;
+		return 0;
+	}
+
+	buffer = (unsigned char *)xmalloc(FILE_BODY_BLOCK);
+	SHA1Reset(&sha1);
+	while ((nread = fread(buffer, 1, FILE_BODY_BLOCK, fp)) > 0) {
+		feed(buffer, nread, user);
+		SHA1Input(&sha1, buffer, nread);
+		b->size += nread;
+	}
+	SHA1Result(&sha1, b->digest);
+
+	xfree(buffer);
+	if (ferror(fp)) {
+		fclose(fp);
+		return -1;
+	}
 	fclose(fp);
+	return 0;
+}
+
+/*
+ * send a body file_body_read() did not copy, from the mapping or from
+ * the file a second time, hashing it again on the way. the last block
+ * is only sent if the hash still matches 'digest', so a file that
+ * changed in between never goes out complete under the header made for
+ * the old content.
+ * returns the number of bytes sent, short on any error.
+ */
+static size_t file_body_send(socket_t sock, const char *filename, const file_body *b)
+{
+	size_t nread, ntotal = 0;
+	unsigned char *buffer = NULL, check[20];
+	const unsigned char *block;
+	SHA1Context_t sha1;
+	FILE *fp = NULL;
+
+	if (!b->mapped) {
+		if (!(fp = fopen(filename, "rb"))) {
+			return 0;
+		}
+		buffer = (unsigned char *)xmalloc(FILE_BODY_BLOCK);
+	}
+	SHA1Reset(&sha1);
+
+	while (ntotal < b->size) {
+		nread = (b->size - ntotal < FILE_BODY_BLOCK) ? b->size - ntotal : FILE_BODY_BLOCK;
+		if (!fp) {
+			block = b->data + ntotal;
+		} else if (fread(buffer, 1, nread, fp) == nread) {
+			block = buffer;
+		} else {
+			break; // shrunk
+		}
+		SHA1Input(&sha1, block, nread);
+
+		if (ntotal + nread == b->size) {
+			SHA1Result(&sha1, check);
+			if (memcmp(check, b->digest, sizeof(check)) != 0) {
+				break;
+			}
+		}
+
+		if (socket_write(sock, block, nread) != nread) {
+			break;
+		}
+		ntotal += nread;
+	}
+
+	if (fp) {
+		xfree(buffer);
+		fclose(fp);
+	}
 	return ntotal;
 }
 
@@ -314,14 +482,14 @@ static void free_HTTPRequest(HTTPRequest *req)
 {
 	if( req ) {
 		if( req->name ) {
-			free(req->name);
+			xfree(req->name);
 			req->name = NULL;
 		}
 		if( req->uri ) {
-			free(req->uri);
+			xfree(req->uri);
 			req->uri = NULL;
 		}
-		free(req);
+		xfree(req);
 	}
 }
 
@@ -342,16 +510,16 @@ static void free_HTTPResponse(HTTPResponse *res)
 {
 	if (res) {
 		if (res->header) {
-			free(res->header);
+			xfree(res->header);
 			res->header = NULL;
 		}
 
 		if (res->data) {
-			free(res->data);
+			xfree(res->data);
 			res->data = NULL;
 		}
 
-		free(res);
+		xfree(res);
 	}
 }
 #endif
@@ -523,7 +691,7 @@ HTTPResponse *socket_http_get(const char *url, const char *query, const char *cu
 	free_HTTPRequest(http_request);
 
 	socket_write_str(sock, request);
-	free(request);
+	xfree(request);
 
 	response = (char *)socket_read_alloc(sock, &response_size);
 	response[response_size] = '\0';
@@ -539,7 +707,7 @@ HTTPResponse *socket_http_get(const char *url, const char *query, const char *cu
 		http_response = parse_http_result(response, response_size);
 	}
 
-	free(response);
+	xfree(response);
 	return http_response;
 }
 
@@ -596,7 +764,7 @@ HTTPResponse *socket_http_post(const char *url, const char *content, size_t cont
 
 	socket_write_str(sock, request);
 	socket_write(sock, content, content_size);
-	free(request);
+	xfree(request);
 
 	response = (char *)socket_read_alloc(sock, &response_size);
 	response[response_size] = '\0';
@@ -608,11 +776,18 @@ HTTPResponse *socket_http_post(const char *url, const char *content, size_t cont
 		http_response = parse_http_result(response, response_size);
 	}
 
-	free(response);
+	xfree(response);
 	return http_response;
 }
 
-HTTPResponse *socket_http_post_file(const char *url, const char *file_name, size_t file_size, const char *custom_header, int keepalive)
+/*
+ * POST a body of 'size' bytes, sent from 'body' or, if that is NULL,
+ * streamed from 'file_name', or sent from 'checked' by file_body_send()
+ * if that is given. without a custom header the body
+ * is sent as image/jpeg. returns NULL if the body could not be sent.
+ */
+static HTTPResponse *http_post_file_send(const char *url, const char *file_name, const unsigned char *body, size_t size,
+	const file_body *checked, const char *custom_header, int keepalive)
 {
 	socket_t sock;
 	HTTPRequest *http_request = NULL;
@@ -621,17 +796,10 @@ HTTPResponse *socket_http_post_file(const char *url, const char *file_name, size
 	size_t request_size = 0;
 	char *response = NULL;
 	size_t response_size = 0;
+	size_t sent;
 
-	struct stat st;
 	char str_num[16] = "";
 
-	if (file_size == 0) {
-		if (stat(file_name, &st) == -1) {
-			return NULL;
-		}
-		file_size = st.st_size;
-	}
-
 	// make http request.
 	http_request = malloc_HTTPRequest();
 	parse_http_url(http_request, url);
@@ -648,7 +816,7 @@ HTTPResponse *socket_http_post_file(const char *url, const char *file_name, size
 	strcat(request, "\r\n");
 	strcat(request, "Accept: */*\r\n");
 	strcat(request, "Content-Length: ");
-	strcat(request, ntos(str_num, file_size));
+	strcat(request, ntos(str_num, size));
 	strcat(request, "\r\n");
 	if (!keepalive) {
 		strcat(request, "Connection: close\r\n");
@@ -662,30 +830,98 @@ HTTPResponse *socket_http_post_file(const char *url, const char *file_name, size
 
 	// Connect.
 	if ((sock = socket_open(AF_INET, SOCK_STREAM)) < 0) {
+		free_HTTPRequest(http_request);
+		xfree(request);
 		return NULL; // Error.
 	}
 
 	if (socket_connect(sock, http_request->name, http_request->port) == INVALID_SOCKET) {
+		socket_close(sock);
+		free_HTTPRequest(http_request);
+		xfree(request);
 		return NULL;
 	}
 
 	free_HTTPRequest(http_request);
 
 	socket_write_str(sock, request);
-	socket_write_file(sock, file_name, file_size);
-	free(request);
+	if (body) {
+		sent = socket_write(sock, body, size);
+	} else if (checked) {
+		sent = file_body_send(sock, file_name, checked);
+	} else {
+		sent = socket_write_file(sock, file_name, size);
+	}
+	xfree(request);
+
+	if (sent != size) {
+		// the server would wait for the rest, or take a body the header does not match
+		socket_close(sock);
+		return NULL;
+	}
 
 	response = socket_read_alloc(sock, &response_size);
-	response[response_size] = '\0';
 
 	socket_close(sock);
 
+	if (!response) {
+		return NULL; // recv error.
+	}
+	response[response_size] = '\0'; // socket_read_alloc() leaves room.
+
 	// parse response.
 	if (*response) {
 		http_response = parse_http_result(response, response_size);
 	}
 
-	free(response);
+	xfree(response);
+	return http_response;
+}
+
+HTTPResponse *socket_http_post_file(const char *url, const char *file_name, size_t file_size, const char *custom_header, int keepalive)
+{
+	struct stat st;
+
+	if (file_size == 0) {
+		if (stat(file_name, &st) == -1) {
+			return NULL;
+		}
+		file_size = st.st_size;
+	}
+
+	return http_post_file_send(url, file_name, NULL, file_size, NULL, custom_header, keepalive);
+}
+
+HTTPResponse *socket_http_post_file2(const char *url, const char *file_name, socket_header_func make_header, void *user, int keepalive)
+{
+	HTTPResponse *http_response = NULL;
+	file_body body;
+	char *custom_header;
+
+	// 1st phase: the header may depend on the body (e.g. a signed body hash).
+	if (file_body_read(file_name, make_header, user, &body) < 0) {
+		return NULL;
+	}
+	custom_header = make_header(NULL, body.size, user);
+
+	// 2nd phase: send the copy that was fed, or the mapping or file checked against it.
+	if (body.data && !body.mapped) {
+		http_response = http_post_file_send(url, file_name, body.data, body.size, NULL, custom_header, keepalive);
+	} else {
+		http_response = http_post_file_send(url, file_name, NULL, body.size, &body, custom_header, keepalive);
+	}
+
+#ifdef HAVE_MMAP
+	if (body.mapped) {
+		munmap(body.data, body.size);
+	} else
+#endif
+	if (body.data) {
+		xfree(body.data);
+	}
+	if (custom_header) {
+		xfree(custom_header);
+	}
 	return http_response;
 }
 
@@ -738,7 +974,7 @@ HTTPResponse *socket_post_data(const char *url, const char *data, size_t data_si
 
 	socket_write_str(sock, request);
 	socket_write(sock, data, data_size);
-	free(request);
+	xfree(request);
 
 	response = socket_read_alloc(sock, &response_size);
 	response[response_size] = '\0';
@@ -750,7 +986,7 @@ HTTPResponse *socket_post_data(const char *url, const char *data, size_t data_si
 		http_response = parse_http_result(response, response_size);
 	}
 
-	free(response);
+	xfree(response);
 	return http_response;
 }
 #endif
@@ -57,6 +57,15 @@ HTTPResponse *socket_http_get(const char *url, const char *query, const char *cu
 HTTPResponse *socket_http_post(const char *url, const char *content, size_t content_size, const char *custom_header, int keepalive);
 HTTPResponse *socket_http_post_file(const char *url, const char *file_name, size_t file_size, const char *custom_header, int keepalive);
 
+/*
+ * header callback of socket_http_post_file2(): called with the body in
+ * pieces, in order (return NULL), then once with body NULL and the total
+ * size to return the custom header (allocated, freed by the caller) or NULL.
+ */
+typedef char *(*socket_header_func)(const unsigned char *body, size_t size, void *user);
+
+HTTPResponse *socket_http_post_file2(const char *url, const char *file_name, socket_header_func make_header, void *user, int keepalive);
+
 
 #ifdef __cplusplus
 }
@@ -39,12 +39,17 @@
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <time.h>
-#include <math.h>
-#include <ctype.h> // isxdigit
+#include <ctype.h> // toupper
 
 #include "xmalloc.h"
 #include "oauth.h"
+#include "hash.h"
+#include "base64.h"
+#include "escape.h"
+#include "oauth_norm.h"
+#include "oauth_rand.h"
 
 #ifndef WIN32 // getpid() on POSIX systems
 #include <sys/types.h>
@@ -54,9 +59,6 @@
 #define strncasecmp strnicmp
 #endif
 
-#ifdef PSP
-#include <psputils.h>
-#endif
 
 
 /**
@@ -107,44 +109,45 @@ int oauth_b64_is_base64(char c)
  */
 char *oauth_encode_base64(int size, const unsigned char *src)
 {
-	int i;
-	char *out, *p;
-	unsigned char b1 = 0, b2 = 0, b3 = 0, b4 = 0, b5 = 0, b6 = 0, b7 = 0;
+	char *out;
+	size_t n;
 
 	if (!src) return NULL;
 	if (!size) size = strlen((char *)src);
 
-	out = (char *)xcalloc(sizeof(char), size * 4 / 3 + 4);
-	p = out;
-
-	for (i = 0; i < size; i += 3) {
-		b1 = 0; b2 = 0; b3 = 0; b4 = 0; b5 = 0; b6 = 0; b7 = 0;
+	n = oauth_encode_base64_len(size);
+	out = (char *)xmalloc(n + 1);
+	oauth_encode_base64_into(out, n + 1, src, size);
+	return out;
+}
 
-		b1 = src[i];
-		if (i + 1 < size) b2 = src[i + 1];
-		if (i + 2 < size) b3 = src[i + 2];
+size_t oauth_encode_base64_len(size_t len)
+{
+	return OAUTH_BASE64_ENCODED_LEN(len);
+}
 
-		b4 = b1 >> 2;
-		b5 = ((b1 & 0x3) << 4) | (b2 >> 4);
-		b6 = ((b2 & 0xf) << 2) | (b3 >> 6);
-		b7 = b3 & 0x3f;
+size_t oauth_encode_base64_into(char *dest, size_t size, const unsigned char *src, size_t len)
+{
+	size_t need = OAUTH_BASE64_ENCODED_LEN(len);
+	size_t groups;
+	char tail[4];
 
-		*p++ = oauth_b64_encode(b4);
-		*p++ = oauth_b64_encode(b5);
+	if (!size) return need;
 
-		if (i + 1 < size) {
-			*p++ = oauth_b64_encode(b6);
-		} else {
-			*p++ = '=';
-		}
+	if (need < size) {
+		dest[oauth_base64_encode_raw(dest, src, len)] = '\0';
+		return need;
+	}
 
-		if (i + 2 < size) {
-			*p++ = oauth_b64_encode(b7);
-		} else {
-			*p++ = '=';
-		}
+	// truncated: whole groups that fit, then the start of the next one
+	groups = (size - 1) / 4;
+	oauth_base64_encode_raw(dest, src, groups * 3);
+	if ((size - 1) % 4) {
+		oauth_base64_encode_raw(tail, src + groups * 3, len - groups * 3 < 3 ? len - groups * 3 : 3);
+		memcpy(dest + groups * 4, tail, (size - 1) % 4);
 	}
-	return out;
+	dest[size - 1] = '\0';
+	return need;
 }
 
 /**
@@ -159,49 +162,27 @@ char *oauth_encode_base64(int size, const unsigned char *src)
  */
 int oauth_decode_base64(unsigned char *dest, const char *src)
 {
-	unsigned char *p = dest;
-	unsigned char *buf = NULL;
-
-	char c1, c2, c3, c4;
-	unsigned char b1, b2, b3, b4;
-
-	int k = 0;
-	int l = strlen(src) + 1;
+	size_t n;
 
-	if (src == NULL || src == '\0') return 0;
-
-	buf = (unsigned char *)xcalloc(sizeof(unsigned char), l);
+	if (src == NULL) return 0;
 
 	/* Ignore non base64 chars as per the POSIX standard */
-	for (k = 0, l = 0; src[k]; k++) {
-		if (oauth_b64_is_base64(src[k])) {
-			buf[l++] = src[k];
-		}
-	}
+	n = oauth_base64_decode_raw(dest, (size_t)-1, src, strlen(src), OAUTH_BASE64_LENIENT);
+	if (n == OAUTH_BASE64_ERROR) return 0;
 
-	for (k = 0; k < l; k += 4) {
-		c1 = 'A', c2 = 'A', c3 = 'A', c4 = 'A';
-		b1 = 0, b2 = 0, b3 = 0, b4 = 0;
-		c1 = buf[k];
-
-		if (k + 1 < l) c2 = buf[k + 1];
-		if (k + 2 < l) c3 = buf[k + 2];
-		if (k + 3 < l) c4 = buf[k + 3];
-
-		b1 = oauth_b64_decode(c1);
-		b2 = oauth_b64_decode(c2);
-		b3 = oauth_b64_decode(c3);
-		b4 = oauth_b64_decode(c4);
+	dest[n] = '\0';
+	return n;
+}
 
-		*p++ = ((b1 << 2) | (b2 >> 4));
+int oauth_decode_base64_into(unsigned char *dest, size_t size, const char *src, size_t len)
+{
+	size_t n;
 
-		if (c3 != '=') *p++ = (((b2 & 0xf) << 4) | (b3 >> 2));
-		if (c4 != '=') *p++ = (((b3 & 0x3) << 6) | b4 );
-	}
+	if (!src || (!dest && size)) return -1;
 
-	free(buf);
-	dest[p - dest] = '\0';
-	return (p - dest);
+	n = oauth_base64_decode_raw(dest, size, src, len, OAUTH_BASE64_PLAIN);
+	if (n == OAUTH_BASE64_ERROR || n > INT_MAX) return -1;
+	return (int)n;
 }
 
 /**
@@ -214,80 +195,68 @@ int oauth_decode_base64(unsigned char *dest, const char *src)
  */
 char *oauth_url_escape(const char *string)
 {
-	size_t alloc, newlen;
-	char *ns = NULL, *testing_ptr = NULL;
-	unsigned char in; 
-	size_t strindex = 0;
-	size_t length;
+	size_t len, unsafe;
+	char *ns;
 
 	if (!string) return xstrdup("");
 
-	alloc = strlen(string) + 1;
-	newlen = alloc;
+	len = strlen(string);
+	unsafe = oauth_escape_count(string, len);
+	ns = (char *)xmalloc(len + 2 * unsafe + 1);
 
-	ns = (char *)xmalloc(alloc);
+	if (!unsafe) {
+		// nothing to escape, the common case for keys and values
+		memcpy(ns, string, len + 1);
+		return ns;
+	}
 
-	length = alloc - 1;
-	while (length--) {
-		in = *string;
+	ns[oauth_escape_raw(ns, string, len)] = '\0';
+	return ns;
+}
 
-/*		switch(in)
-		{
-		case '0': case '1': case '2': case '3': case '4':
-		case '5': case '6': case '7': case '8': case '9':
-		case 'a': case 'b': case 'c': case 'd': case 'e':
-		case 'f': case 'g': case 'h': case 'i': case 'j':
-		case 'k': case 'l': case 'm': case 'n': case 'o':
-		case 'p': case 'q': case 'r': case 's': case 't':
-		case 'u': case 'v': case 'w': case 'x': case 'y': case 'z':
-		case 'A': case 'B': case 'C': case 'D': case 'E':
-		case 'F': case 'G': case 'H': case 'I': case 'J':
-		case 'K': case 'L': case 'M': case 'N': case 'O':
-		case 'P': case 'Q': case 'R': case 'S': case 'T':
-		case 'U': case 'V': case 'W': case 'X': case 'Y': case 'Z':
-		case '_': case '~': case '.': case '-':
-			ns[strindex++] = in;
-			break;
-
-		default:
-			newlen += 2; // this'll become a %XX
-			if (newlen > alloc) {
-				alloc *= 2;
-				testing_ptr = (char *)xrealloc(ns, alloc);
-				ns = testing_ptr;
-			}
-			snprintf(&ns[strindex], 4, "%%%02X", in);
-			strindex += 3;
-			break;
-		}
-*/
+/* store 'c' at dest[o] unless that is past the room for the terminating zero */
+#define OAUTH_PUT(dest, size, o, c) do { \
+	if ((o) + 1 < (size)) (dest)[o] = (c); \
+	(o)++; \
+} while (0)
 
-		if ((in >= '0' && in <= '9') || // 0 ... 9
-			(in >= 'a' && in <= 'z') || // a ... z
-			(in >= 'A' && in <= 'Z') || // A ... Z
-			(in == '_' || in == '~' || in == '.' || in == '-')) // _ ~ . -
-		{
-			ns[strindex++] = in;
+/* zero-terminate snprintf-style output of length 'o' */
+#define OAUTH_TERMINATE(dest, size, o) do { \
+	if (size) (dest)[(o) < (size) ? (o) : (size) - 1] = '\0'; \
+} while (0)
+
+size_t oauth_url_escape_into(char *dest, size_t size, const char *src, size_t len)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	size_t i, o = 0, need;
+	unsigned char in;
+
+	need = len + 2 * oauth_escape_count(src, len);
+	if (need < size) {
+		// exact size is known and fits: let the kernels write it
+		dest[oauth_escape_raw(dest, src, len)] = '\0';
+		return need;
+	}
+
+	for (i = 0; i < len && o + 1 < size; i++) {
+		in = src[i];
+		if (oauth_escape_safe[in]) {
+			OAUTH_PUT(dest, size, o, in);
 		} else {
-			newlen += 2; /* this'll become a %XX */
-			if (newlen > alloc) {
-				alloc *= 2;
-				testing_ptr = (char *)xrealloc(ns, alloc);
-				ns = testing_ptr;
-			}
-			snprintf(&ns[strindex], 4, "%%%02X", in);
-			strindex += 3;
+			OAUTH_PUT(dest, size, o, '%');
+			OAUTH_PUT(dest, size, o, hex[in >> 4]);
+			OAUTH_PUT(dest, size, o, hex[in & 0x0f]);
 		}
-
-		string++;
 	}
-	ns[strindex] = 0;
-	return ns;
+
+	OAUTH_TERMINATE(dest, size, o);
+	return need;
 }
 
-#ifndef ISXDIGIT
-# define ISXDIGIT(x) (isxdigit((int) ((unsigned char)x)))
-#endif
+size_t oauth_url_escape_len(const char *src, size_t len)
+{
+	return len + 2 * oauth_escape_count(src, len);
+}
 
 /**
  * Parse RFC3986 encoded 'string' back to  unescaped version.
@@ -299,43 +268,66 @@ char *oauth_url_escape(const char *string)
  */
 char *oauth_url_unescape(const char *string, size_t *olen)
 {
-	size_t alloc, strindex = 0;
-	char *ns = NULL;
-	unsigned char in;
-	long hex;
-
-	char hexstr[3];
+	size_t len, n;
+	char *ns;
 
 	if (!string) return NULL;
 
-	alloc = strlen(string) + 1;
-	ns = (char *)xmalloc(alloc);
-
-	while (--alloc > 0) {
-		in = *string;
-		if (('%' == in) && ISXDIGIT(string[1]) && ISXDIGIT(string[2])) {
-			// hexstr[3] '%XX'
-			hexstr[0] = string[1];
-			hexstr[1] = string[2];
-			hexstr[2] = 0;
-			hex = strtol(hexstr, NULL, 16);
-			in = (unsigned char)hex; /* hex is always < 256 */
-			string += 2;
-			alloc -= 2;
-		}
+	// the result is never longer: decode in one pass into a buffer of the input's size
+	len = strlen(string);
+	ns = (char *)xmalloc(len + 1);
+	n = oauth_unescape_raw(ns, string, len);
+	ns[n] = '\0';
 
-		ns[strindex++] = in;
-		string++;
-	}
-
-	ns[strindex] = 0;
 	if (olen) {
-		*olen = strindex;
+		*olen = n;
 	}
 
 	return ns;
 }
 
+size_t oauth_url_unescape_inplace(char *buf, size_t len)
+{
+	size_t n = oauth_unescape_raw(buf, buf, len);
+
+	buf[n] = '\0';
+	return n;
+}
+
+size_t oauth_url_unescape_into(char *dest, size_t size, const char *src, size_t len)
+{
+	size_t i, o = 0;
+	unsigned char in, h, l;
+
+	if (len < size) {
+		// the input fits, and the result is never longer
+		o = oauth_unescape_raw(dest, src, len);
+		dest[o] = '\0';
+		return o;
+	}
+
+	for (i = 0; i < len; i++) {
+		in = src[i];
+		if ('%' == in && i + 2 < len &&
+			(h = oauth_escape_hexval[(unsigned char)src[i + 1]]) != 0xff &&
+			(l = oauth_escape_hexval[(unsigned char)src[i + 2]]) != 0xff)
+		{
+			in = h << 4 | l;
+			i += 2;
+		}
+
+		OAUTH_PUT(dest, size, o, in);
+	}
+
+	OAUTH_TERMINATE(dest, size, o);
+	return o;
+}
+
+size_t oauth_url_unescape_len(const char *src, size_t len)
+{
+	return len - 2 * oauth_unescape_count(src, len);
+}
+
 /**
  * returns plaintext signature for the given key.
  *
@@ -350,6 +342,26 @@ char *oauth_sign_plaintext(const char *m, const char *k)
 	return xstrdup(k);
 }
 
+/* escape 'len' strings from 'va' and join them with '&', snprintf-style */
+static size_t oauth_vcatenc_into(char *dest, size_t size, int len, va_list va)
+{
+	size_t o = 0, n;
+	const char *arg;
+	int i;
+
+	for (i = 0; i < len; i++) {
+		arg = va_arg(va, const char *);
+		if (i > 0) OAUTH_PUT(dest, size, o, '&');
+		if (!arg) continue;
+
+		n = strlen(arg);
+		o += oauth_url_escape_into(o < size ? dest + o : NULL, o < size ? size - o : 0, arg, n);
+	}
+
+	OAUTH_TERMINATE(dest, size, o);
+	return o;
+}
+
 /**
  * encode strings and concatenate with '&' separator.
  * The number of strings to be concatenated must be
@@ -366,33 +378,43 @@ char *oauth_sign_plaintext(const char *m, const char *k)
 char *oauth_catenc(int len, ...)
 {
 	va_list va;
-	int i;
 	char *rv;
+	size_t n;
 
-	char *arg, *enc;
-	int len_;
+	va_start(va, len);
+	n = oauth_vcatenc_into(NULL, 0, len, va);
+	va_end(va);
 
-	rv = (char *)xmalloc(sizeof(char));
-	*rv = '\0';
+	rv = (char *)xmalloc(n + 1);
 
 	va_start(va, len);
-	for (i = 0; i < len; i++) {
-		arg = va_arg(va, char *);
-		enc = oauth_url_escape(arg);
-		if (enc == NULL) break;
-		len_ = strlen(enc) + 1 + ((i > 0)? 1 : 0);
-		if (rv != NULL) len_ += strlen(rv);
-		rv = (char *)xrealloc(rv, len_ * sizeof(char));
-
-		if (i > 0) strcat(rv, "&");
-		strcat(rv, enc);
-		free(enc);
-	}
-
+	oauth_vcatenc_into(rv, n + 1, len, va);
 	va_end(va);
 	return(rv);
 }
 
+size_t oauth_catenc_into(char *dest, size_t size, int len, ...)
+{
+	va_list va;
+	size_t n;
+
+	va_start(va, len);
+	n = oauth_vcatenc_into(dest, size, len, va);
+	va_end(va);
+	return n;
+}
+
+size_t oauth_catenc_len(int len, ...)
+{
+	va_list va;
+	size_t n;
+
+	va_start(va, len);
+	n = oauth_vcatenc_into(NULL, 0, len, va);
+	va_end(va);
+	return n;
+}
+
 /**
  * splits the given url into a parameter array. 
  * (see \ref oauth_serialize_url and \ref oauth_serialize_url_parameters for the reverse)
@@ -418,42 +440,38 @@ char *oauth_catenc(int len, ...)
  */
 int oauth_split_post_paramters(const char *url, char ***argv, short qesc)
 {
-	int argc = 0;
-	char *token, *tmp, *t1, *slash;
+	OAuthQuery q;
+	OAuthQueryParam t;
+	int argc = 0, alloc = 0, flags;
+	char *s, *tmp, *slash;
 
 	if (!argv || !url) return 0;
 
-	t1 = xstrdup(url);
+	// '+' represents a space in a URL query string, SOH stands for '&'
+	flags = ((qesc & 1) ? OAUTH_QUERY_PLUS : 0) | ((qesc & 2) ? 0 : OAUTH_QUERY_SOH);
 
-	// '+' represents a space, in a URL query string
-	while ((qesc & 1) && (tmp = strchr(t1, '+'))) {
-		*tmp = ' ';
-	}
-
-	tmp = t1;
-	while ((token = strtok(tmp, "&?"))) {
-		if (!strncasecmp("oauth_signature=", token, 16)) {
+	oauth_query_init(&q, url, strlen(url));
+	while (oauth_query_next(&q, &t)) {
+		if (t.len >= 16 && !strncasecmp("oauth_signature=", t.name, 16)) {
 			continue;
 		}
 
-		(*argv) = (char **)xrealloc(*argv, sizeof(char *) * (argc + 1));
-		while (!(qesc & 2) && (tmp = strchr(token, '\001'))) {
-			*tmp = '&';
+		if (argc == alloc) {
+			alloc = alloc ? 2 * alloc : 8;
+			(*argv) = (char **)xrealloc(*argv, sizeof(char *) * alloc);
 		}
 
-		if (argc > 0 || (qesc & 4)) {
-			(*argv)[argc] = oauth_url_unescape(token, NULL);
-		} else {
-			(*argv)[argc] = xstrdup(token);
-		}
+		// one more byte for a trailing slash the URL may need
+		s = (char *)xmalloc(t.len + 2);
+		s[oauth_query_decode(s, t.name, t.len,
+			flags | ((argc > 0 || (qesc & 4)) ? 0 : OAUTH_QUERY_RAW))] = '\0';
 
-		if (argc == 0 && strstr(token, ":/")) {
+		if (argc == 0 && (slash = strstr(s, ":/"))) {
 			// HTTP does not allow empty absolute paths, so the URL 
 			// 'http://example.com' is equivalent to 'http://example.com/' and should
 			// be treated as such for the purposes of OAuth signing (rfc2616, section 3.2.1)
 			// see http://groups.google.com/group/oauth/browse_thread/thread/c44b6f061bfd98c?hl=en
-			slash = strstr(token, ":/");
-			while (slash && *(++slash) == '/'); // skip slashes eg /xxx:[\/]*/
+			while (*(++slash) == '/'); // skip slashes eg /xxx:[\/]*/
 #if 0
 			// skip possibly unescaped slashes in the userinfo - they're not allowed by RFC2396 but have been seen.
 			// the hostname/IP may only contain alphanumeric characters - so we're safe there.
@@ -462,26 +480,24 @@ int oauth_split_post_paramters(const char *url, char ***argv, short qesc)
 			}
 #endif
 
-			if (slash && !strchr(slash, '/')) {
+			if (!strchr(slash, '/')) {
 #ifdef DEBUG_OAUTH
-				fprintf(stderr, "\nliboauth: added trailing slash to URL: '%s'\n\n", token);
+				fprintf(stderr, "\nliboauth: added trailing slash to URL: '%s'\n\n", s);
 #endif
-				free((*argv)[argc]);
-				(*argv)[argc] = (char *)xmalloc(sizeof(char) * (2 + strlen(token))); 
-				strcpy((*argv)[argc], token);
-				strcat((*argv)[argc], "/");
+				strcat(s, "/");
 			}
 		}
 
-		if (argc == 0 && (tmp = strstr((*argv)[argc], ":80/"))) {
+		if (argc == 0 && (tmp = strstr(s, ":80/"))) {
 			memmove(tmp, tmp + 3, strlen(tmp + 2));
 		}
 
-		tmp=NULL;
-		argc++;
+		(*argv)[argc++] = s;
 	}
 
-	free(t1);
+	if (argc > 0 && argc < alloc) {
+		(*argv) = (char **)xrealloc(*argv, sizeof(char *) * argc);
+	}
 	return argc;
 }
 
@@ -504,96 +520,96 @@ char *oauth_serialize_url(int argc, int start, char **argv)
 	return oauth_serialize_url_sep(argc, start, argv, "&", 0);
 }
 
-/**
- * encode query parameters from an array.
- *
- * @param argc the total number of elements in the array
- * @param start element in the array at which to start concatenating.
- * @param argv parameter-array to concatenate.
- * @param sep separator for parameters (usually "&") 
- * @param mod - bitwise modifiers: 
- *   1: skip all values that start with "oauth_"
- *   2: skip all values that don't start with "oauth_"
- *   4: add double quotation marks around values (use with sep=", " to generate HTTP Authorization header).
- * @return url string needs to be freed by the caller.
- */
-char *oauth_serialize_url_sep(int argc, int start, char **argv, char *sep, int mod)
+/* whether oauth_serialize_url_sep() leaves out argv[i] for 'mod' */
+static __inline int oauth_serialize_skip(char **argv, int i, int mod)
 {
-	char *tmp, *t1, *t2, *query;
-	int i, first, seplen, len;
+	int is_oauth = strncmp(argv[i], "oauth_", 6) == 0 || strncmp(argv[i], "x_oauth_", 8) == 0;
 
-	query = (char *)xmalloc(sizeof(char)); 
-	*query = '\0';
-	first = 0;
-	seplen = strlen(sep);
+	if ((mod & 1) == 1 && is_oauth) return 1;
+	if ((mod & 2) == 2 && !is_oauth && i != 0) return 1;
+	return 0;
+}
+
+#define SERIALIZE_PUT(s, n) do { \
+	if (dest) memcpy(dest + o, (s), (n)); \
+	o += (n); \
+} while (0)
+
+#define SERIALIZE_ESCAPED(s, n) do { \
+	if (dest) o += oauth_escape_raw(dest + o, (s), (n)); \
+	else o += (n) + 2 * oauth_escape_count((s), (n)); \
+} while (0)
+
+/*
+ * write the serialized query to 'dest', or with 'dest' NULL only
+ * measure it: called once for the exact size, then once to fill it in.
+ */
+static size_t oauth_serialize_url_write(char *dest, int argc, int start, char **argv, const char *sep, int mod)
+{
+	size_t o = 0, seplen = strlen(sep), n;
+	const char *s, *t1;
+	int i, first = 0;
 
 	for (i = start; i < argc; i++) {
-		len = 0;
-		if ((mod & 1) == 1 && (strncmp(argv[i], "oauth_", 6) == 0 || strncmp(argv[i], "x_oauth_", 8) == 0 )) continue;
-		if ((mod & 2) == 2 && (strncmp(argv[i], "oauth_", 6) != 0 && strncmp(argv[i], "x_oauth_", 8) != 0 ) && i != 0) continue;
+		if (oauth_serialize_skip(argv, i, mod)) continue;
 
-		if (query) len += strlen(query);
+		if (i != start && !first) SERIALIZE_PUT(sep, seplen);
+		first = 0;
 
 		if (i == start && i == 0 && strstr(argv[i], ":/")) {
-			tmp = xstrdup(argv[i]);
-#if 1		// encode white-space in the base-url
-			while ((t1 = strchr(tmp, ' '))) {
-	#if 0
-				*t1 = '+';
-	#else
-				size_t off = t1 - tmp;
-				t2 = (char *)xmalloc(sizeof(char) * (3 + strlen(tmp)));
-				strcpy(t2, tmp);
-				strcpy(t2 + off + 2, tmp + off);
-				*(t2 + off    ) = '%';
-				*(t2 + off + 1) = '2';
-				*(t2 + off + 2) = '0';
-				free(tmp);
-				tmp = t2;
-	#endif // 0
-#endif // 1
+			// encode white-space in the base-url
+			for (s = argv[i]; (t1 = strchr(s, ' ')); s = t1 + 1) {
+				SERIALIZE_PUT(s, (size_t)(t1 - s));
+				SERIALIZE_PUT("%20", 3);
 			}
-
-			len += strlen(tmp);
+			n = strlen(s);
+			SERIALIZE_PUT(s, n);
+			SERIALIZE_PUT("?", 1);
+			first = 1;
 		}
 		else if (!(t1 = strchr(argv[i], '=')))
 		{
 			// see http://oauth.net/core/1.0/#anchor14
 			// escape parameter names and arguments but not the '='
-			tmp = xstrdup(argv[i]);
-			tmp = (char *)xrealloc(tmp, (strlen(tmp) + 2) * sizeof(char));
-			strcat(tmp, "=");
-			len += strlen(tmp);
+			n = strlen(argv[i]);
+			SERIALIZE_PUT(argv[i], n);
+			SERIALIZE_PUT("=", 1);
 		}
 		else
 		{
-			*t1 = 0;
-			tmp = oauth_url_escape(argv[i]);
-			*t1 = '=';
-			t1 = oauth_url_escape(t1 + 1);
-			tmp = (char *)xrealloc(tmp, (strlen(tmp) + strlen(t1) + 2 + (mod & 4 ? 2 : 0)) * sizeof(char));
-			strcat(tmp, "=");
-			if (mod & 4) strcat(tmp, "\"");
-			strcat(tmp, t1);
-			if (mod & 4) strcat(tmp, "\"");
-			free(t1);
-			len += strlen(tmp);
+			n = t1 - argv[i];
+			SERIALIZE_ESCAPED(argv[i], n);
+			SERIALIZE_PUT("=", 1);
+			if (mod & 4) SERIALIZE_PUT("\"", 1);
+			n = strlen(++t1);
+			SERIALIZE_ESCAPED(t1, n);
+			if (mod & 4) SERIALIZE_PUT("\"", 1);
 		}
+	}
 
-		len += seplen + 1;
-		query = (char *)xrealloc(query, len * sizeof(char));
-		strcat(query, ((i == start || first)? "" : sep));
-		first = 0;
-		strcat(query, tmp);
-
-		if (i == start && i == 0 && strstr(tmp, ":/")) {
-			strcat(query, "?");
-			first = 1;
-		}
+	return o;
+}
 
-		free(tmp);
-	}
+/**
+ * encode query parameters from an array.
+ *
+ * @param argc the total number of elements in the array
+ * @param start element in the array at which to start concatenating.
+ * @param argv parameter-array to concatenate.
+ * @param sep separator for parameters (usually "&") 
+ * @param mod - bitwise modifiers: 
+ *   1: skip all values that start with "oauth_"
+ *   2: skip all values that don't start with "oauth_"
+ *   4: add double quotation marks around values (use with sep=", " to generate HTTP Authorization header).
+ * @return url string needs to be freed by the caller.
+ */
+char *oauth_serialize_url_sep(int argc, int start, char **argv, char *sep, int mod)
+{
+	size_t len = oauth_serialize_url_write(NULL, argc, start, argv, sep, mod);
+	char *query = (char *)xmalloc(len + 1);
 
+	oauth_serialize_url_write(query, argc, start, argv, sep, mod);
+	query[len] = '\0';
 	return query;
 }
 
@@ -613,53 +629,53 @@ char *oauth_serialize_url_parameters(int argc, char **argv)
 	return oauth_serialize_url(argc, 1, argv);
 }
 
+static const char oauth_nonce_chars[64] =
+	"abcdefghijklmnopqrstuvwxyz"
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+	"0123456789_-";
+
+/**
+ * fill 'buf' with a zero terminated random string of size - 1 chars.
+ *
+ * @return length of the string
+ */
+size_t oauth_gen_nonce_into(char *buf, size_t size)
+{
+	size_t i;
+
+	if (size == 0) return 0;
+
+	// 64 unreserved chars: 6 random bits each, no modulo bias
+	oauth_random_bytes(buf, size - 1);
+	for (i = 0; i < size - 1; i++) {
+		buf[i] = oauth_nonce_chars[(unsigned char)buf[i] & 63];
+	}
+	buf[i] = '\0';
+
+#ifdef DEBUG_OAUTH
+	fprintf(stderr, "\nliboauth: oauth_gen_nonce: %s\n\n", buf);
+#endif
+
+	return size - 1;
+}
+
 /**
- * generate a random string between 15 and 32 chars length
+ * generate a random string between 16 and 31 chars length
  * and return a pointer to it. The value needs to be freed by the
  * caller
  *
  * @return zero terminated random string.
  */
-/* pre liboauth-0.7.2 and possible future versions that don't use OpenSSL or NSS */
 char *oauth_gen_nonce()
 {
 	char *nc;
-	static int randinit = 1;
-	const char *chars = "abcdefghijklmnopqrstuvwxyz"
-						"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-						"0123456789_";
-	const unsigned int max = 63; /*26 + 26 + 10 + 1 strlen(chars)*/
-	int i, len;
-
-#ifdef PSP
-	static SceKernelUtilsMt19937Context ctx;
-#define rand() sceKernelUtilsMt19937UInt(&ctx)
-#define floor(x) ((int)(x))
-#endif
+	unsigned char r;
+	int len;
 
-	if (randinit)
-	{
-#ifdef WIN32
-		srand((unsigned int)time(NULL));
-#elif PSP
-		sceKernelUtilsMt19937Init(&ctx, (u32)sceKernelLibcTime(NULL));
-#else
-		srand((unsigned int)time(NULL) * getpid());
-#endif
-		randinit = 0;
-	} // seed random number generator - FIXME: we can do better ;)
-
-	len = 15 + floor(rand() * 16.0 / (double)RAND_MAX);
+	oauth_random_bytes(&r, 1);
+	len = 16 + (r & 15);
 	nc = (char *)xmalloc((len + 1) * sizeof(char));
-
-	for (i = 0; i < len; i++) {
-		nc[i] = chars[rand() % max];
-	}
-	nc[i] = '\0';
-
-#ifdef DEBUG_OAUTH
-	fprintf(stderr, "\nliboauth: oauth_gen_nonce: %s\n\n", nc);
-#endif
+	oauth_gen_nonce_into(nc, len + 1);
 
 	return nc;
 }
@@ -676,8 +692,8 @@ int oauth_cmpstringp(const void *p1, const void *p2)
 	char *t1, *t2;
 	int rv;
 
-	// TODO: this is not fast - we should escape the 
-	// array elements (once) before sorting.
+	// the library itself sorts through oauth_norm.c, which escapes
+	// every parameter only once; this stays for API users.
 	v1 = oauth_url_escape(* (char * const *)p1);
 	v2 = oauth_url_escape(* (char * const *)p2);
 
@@ -696,8 +712,8 @@ int oauth_cmpstringp(const void *p1, const void *p2)
 
 	// compare parameter names
 	if ((rv = strcmp(v1, v2)) != 0) {
-		free(v1);
-		free(v2);
+		xfree(v1);
+		xfree(v2);
 		return rv;
 	}
 
@@ -715,8 +731,8 @@ int oauth_cmpstringp(const void *p1, const void *p2)
 		rv = 1;
 	}
 
-	free(v1);
-	free(v2);
+	xfree(v1);
+	xfree(v2);
 	return rv;
 }
 
@@ -733,7 +749,7 @@ int oauth_param_exists(char **argv, int argc, char *key)
 	int i;
 	size_t l = strlen(key);
 	for (i = 0; i < argc; i++) {
-		if (strlen(argv[i]) > l && !strncmp(argv[i], key, l) && argv[i][l] == '=') {
+		if (!strncmp(argv[i], key, l) && argv[i][l] == '=') {
 			return 1;
 		}
 	}
@@ -753,6 +769,58 @@ void oauth_add_param_to_array(int *argcp, char ***argvp, const char *addparam)
 	(*argvp)[(*argcp)++] = (char *)xstrdup(addparam);
 }
 
+/**
+ * name of the signature method as sent in oauth_signature_method
+ */
+static const char *oauth_method_name(OAuthMethod method)
+{
+	switch (method)
+	{
+	case OA_RSA:			return "RSA-SHA1";
+	case OA_PLAINTEXT:		return "PLAINTEXT";
+	case OA_HMAC_SHA256:	return "HMAC-SHA256";
+	default:				return "HMAC-SHA1";
+	}
+}
+
+/*
+ * the part of oauth_add_protocol() that changes from request to request:
+ * oauth_nonce and oauth_timestamp unless argv has them already, and
+ * oauth_version
+ */
+static void oauth_add_protocol_request(int *argcp, char ***argvp)
+{
+	char oarg[64];
+	const char *s;
+	unsigned char r;
+	int has_nonce = 0, has_timestamp = 0, has_version = 0, i;
+
+	// one pass over argv for all three checks, rather than one each
+	for (i = 0; i < *argcp; i++) {
+		if (strncmp((*argvp)[i], "oauth_", 6)) continue;
+		s = (*argvp)[i] + 6;
+		if (!strncmp(s, "nonce=", 6)) has_nonce = 1;
+		else if (!strncmp(s, "timestamp=", 10)) has_timestamp = 1;
+		else if (!strncmp(s, "version=", 8)) has_version = 1;
+	}
+
+	if (!has_nonce) {
+		oauth_random_bytes(&r, 1);
+		memcpy(oarg, "oauth_nonce=", 12);
+		oauth_gen_nonce_into(oarg + 12, 17 + (r & 15));
+		oauth_add_param_to_array(argcp, argvp, oarg);
+	}
+
+	if (!has_timestamp) {
+		snprintf(oarg, sizeof(oarg), "oauth_timestamp=%li", (long int)time(NULL));
+		oauth_add_param_to_array(argcp, argvp, oarg);
+	}
+
+	if (!has_version) {
+		oauth_add_param_to_array(argcp, argvp, "oauth_version=1.0");
+	}
+}
+
 /**
  *
  */
@@ -762,37 +830,22 @@ void oauth_add_protocol(int *argcp, char ***argvp,
 	const char *t_key  /* < token key - posted plain text in URL */ )
 {
 	char oarg[1024];
-	char *tmp;
 
 	// add OAuth specific arguments
-	if (!oauth_param_exists(*argvp, *argcp, "oauth_nonce")) {
-		snprintf(oarg, 1024, "oauth_nonce=%s", (tmp = oauth_gen_nonce()));
-		oauth_add_param_to_array(argcp, argvp, oarg);
-		free(tmp);
-	}
-
-	if (!oauth_param_exists(*argvp, *argcp, "oauth_timestamp")) {
-		snprintf(oarg, 1024, "oauth_timestamp=%li", (long int)time(NULL));
-		oauth_add_param_to_array(argcp, argvp, oarg);
-	}
+	oauth_add_protocol_request(argcp, argvp);
 
 	if (t_key != NULL) {
 		snprintf(oarg, 1024, "oauth_token=%s", t_key);
 		oauth_add_param_to_array(argcp, argvp, oarg);
 	}
 
-	snprintf(oarg, 1024, "oauth_consumer_key=%s", c_key);
+	// a NULL key is sent empty, as by oauth_signer_new()
+	snprintf(oarg, 1024, "oauth_consumer_key=%s", c_key ? c_key : "");
 	oauth_add_param_to_array(argcp, argvp, oarg);
 
-	snprintf(oarg, 1024, "oauth_signature_method=%s",
-			(method == 0)? "HMAC-SHA1" : (method == 1)? "RSA-SHA1" : "PLAINTEXT");
+	snprintf(oarg, 1024, "oauth_signature_method=%s", oauth_method_name(method));
 	oauth_add_param_to_array(argcp, argvp, oarg);
 
-	if (!oauth_param_exists(*argvp, *argcp, "oauth_version")) {
-		snprintf(oarg, 1024, "oauth_version=1.0");
-		oauth_add_param_to_array(argcp, argvp, oarg);
-	}
-
 #if 0 // oauth_version 1.0 Rev A
 	if (!oauth_param_exists(argv,argc,"oauth_callback")) {
 		snprintf(oarg, 1024, "oauth_callback=oob");
@@ -821,18 +874,11 @@ char *oauth_sign_url2(const char *url, char **postargs,
 	const char *t_key,			/* < token key - posted plain text in URL */
 	const char *t_secret		/* < token secret - used as 2st part of secret-key */ )
 {
-	int argc;
-	char **argv = NULL;
+	OAuthSigner *s = oauth_signer_new(method, c_key, c_secret, t_key, t_secret);
 	char *rv;
 
-	if (postargs != NULL) {
-		argc = oauth_split_post_paramters(url, &argv, 0);
-	} else {
-		argc = oauth_split_url_parameters(url, &argv);
-	}
-
-	rv = oauth_sign_array2(&argc, &argv, postargs, method, http_method, c_key, c_secret, t_key, t_secret);
-	oauth_free_array(&argc, &argv);
+	rv = oauth_signer_sign_url(s, url, postargs, http_method);
+	oauth_signer_free(s);
 	return rv;
 }
 
@@ -847,76 +893,258 @@ char *oauth_sign_array(int *argcp, char ***argvp,
 	return oauth_sign_array2(argcp, argvp, postargs, method, NULL, c_key, c_secret, t_key, t_secret);
 }
 
-void oauth_sign_array2_process(int *argcp, char ***argvp,
+/*
+ * HMAC sign the signature base string of the given request without
+ * building it: this feeds the same bytes as
+ * oauth_catenc(3, http_method, url, oauth_serialize_url_parameters(argc, argv))
+ * to the HMAC piece by piece, the parameters coming from their sorted,
+ * already escaped form in 'norm'. 'key' is a context that has hashed
+ * the pad block of the key and nothing else yet.
+ */
+static char *oauth_sign_hmac_request(const OAuthHmacCtx *key,
+	const char *http_method, const char *url, const oauth_norm *norm)
+{
+	oauth_hmac_feed feed;
+	unsigned char digest[OAUTH_HMAC_MAX_DIGEST];
+	size_t size;
+
+	feed.hmac = *key;
+	feed.len = 0;
+
+	oauth_feed_escaped(&feed, http_method, strlen(http_method));
+	oauth_feed_raw(&feed, "&", 1);
+	if (url) oauth_feed_escaped(&feed, url, strlen(url));
+	oauth_feed_raw(&feed, "&", 1);
+
+	oauth_feed_params(&feed, norm);
+
+	oauth_feed_flush(&feed);
+	size = oauth_hmac_finish(&feed.hmac, digest);
+#ifdef WIPE_MEMORY
+	memset(feed.buf, 0, sizeof(feed.buf));
+#endif
+	return oauth_encode_base64(size, digest);
+}
+
+/*
+ * the credentials of a signer, prepared by oauth_signer_new(): the key
+ * with the HMAC pad blocks already hashed, and the protocol parameters
+ * that do not change between requests, formatted. Nothing is changed
+ * after that, so a signer can be shared between threads.
+ */
+struct OAuthSigner {
+	OAuthMethod method;
+	OAuthHmacCtx hmac;			///< pad blocks hashed (HMAC methods only)
+	char *key;					///< escaped "c_secret&t_secret"
+	const char *token;			///< "oauth_token=t_key", NULL without a token
+	const char *consumer;		///< "oauth_consumer_key=c_key"
+	const char *signature_method;	///< "oauth_signature_method=..."
+	size_t token_len;
+	size_t consumer_len;
+	size_t signature_method_len;
+};
+
+#define SIGNER_TOKEN 12		///< strlen("oauth_token=")
+#define SIGNER_CONSUMER 19	///< strlen("oauth_consumer_key=")
+#define SIGNER_METHOD 23	///< strlen("oauth_signature_method=")
+
+/* write "name=value" at p, return the byte after its terminating zero */
+static char *oauth_signer_put(char *p, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+	memcpy(p, name, name_len);
+	memcpy(p + name_len, value, value_len);
+	p[name_len + value_len] = '\0';
+	return p + name_len + value_len + 1;
+}
+
+OAuthSigner *oauth_signer_new(OAuthMethod method,
+	const char *c_key,
+	const char *c_secret,
+	const char *t_key,
+	const char *t_secret)
+{
+	OAuthSigner *s;
+	const char *name = oauth_method_name(method);
+	size_t cl, tl, ml;
+	char *p;
+
+	if (!c_key) c_key = "";
+	cl = strlen(c_key);
+	tl = t_key ? strlen(t_key) : 0;
+	ml = strlen(name);
+
+	// the parameters are stored right behind the struct
+	s = (OAuthSigner *)xcalloc(1, sizeof(OAuthSigner)
+			+ SIGNER_CONSUMER + cl + 1 + (t_key ? SIGNER_TOKEN + tl + 1 : 0) + SIGNER_METHOD + ml + 1);
+	s->method = method;
+
+	p = (char *)(s + 1);
+	s->consumer = p;
+	s->consumer_len = SIGNER_CONSUMER + cl;
+	p = oauth_signer_put(p, "oauth_consumer_key=", SIGNER_CONSUMER, c_key, cl);
+	if (t_key != NULL) {
+		s->token = p;
+		s->token_len = SIGNER_TOKEN + tl;
+		p = oauth_signer_put(p, "oauth_token=", SIGNER_TOKEN, t_key, tl);
+	}
+	s->signature_method = p;
+	s->signature_method_len = SIGNER_METHOD + ml;
+	oauth_signer_put(p, "oauth_signature_method=", SIGNER_METHOD, name, ml);
+
+	s->key = oauth_catenc(2, c_secret, t_secret);
+#ifdef DEBUG_OAUTH
+	fprintf(stderr, "\nliboauth: key='%s'\n\n", s->key);
+#endif
+
+	if (method != OA_RSA && method != OA_PLAINTEXT) {
+		oauth_hmac_start(&s->hmac, method == OA_HMAC_SHA256 ? OA_HMAC_SHA256 : OA_HMAC,
+				s->key, strlen(s->key));
+	}
+
+	return s;
+}
+
+void oauth_signer_free(OAuthSigner *s)
+{
+	if (!s) return;
+
+	memset(s->key, 0, strlen(s->key));
+	xfree(s->key);
+	memset(s, 0, sizeof(OAuthSigner));
+	xfree(s);
+}
+
+/*
+ * sign argc/argv (argv[0] the base URL), which already hold the OAuth
+ * protocol parameters. 'base' is left holding the normalized order of
+ * argv[1..]; the caller applies it and frees it.
+ */
+static char *oauth_sign_normalized(int argc, char **argv, oauth_base *base,
 	char **postargs,
-	OAuthMethod method, 
-	const char *http_method, 	/* < HTTP request method */
-	const char *c_key, 			/* < consumer key - posted plain text */
-	const char *c_secret, 		/* < consumer secret - used as 1st part of secret-key */
-	const char *t_key, 			/* < token key - posted plain text in URL */
-	const char *t_secret 		/* < token secret - used as 2st part of secret-key */ )
+	const OAuthSigner *s,
+	const char *http_method)
 {
-	char oarg[1024];
-	char *query;
-	char *okey, *odat, *sign;
+	char *odat, *sign;
 	char *http_request_method;
 	int i;
 
 	if (http_method != NULL) {
 		http_request_method = xstrdup(http_method);
-		for (i = 0; i < strlen(http_request_method); i++) {
+		for (i = 0; http_request_method[i]; i++) {
 			http_request_method[i] = toupper(http_request_method[i]);
 		}
 	} else {
 		http_request_method = xstrdup(postargs ? "POST" : "GET");
 	}
 
-	// add required OAuth protocol parameters
-	oauth_add_protocol(argcp, argvp, method, c_key, t_key);
-
-	// sort parameters
-	qsort(&(*argvp)[1], (*argcp) - 1, sizeof(char *), oauth_cmpstringp);
-
-	// serialize URL - base-url 
-	query = oauth_serialize_url_parameters(*argcp, *argvp);
+	// sort parameters: each is escaped once, then sorted by its escaped form;
+	// the RSA/PLAINTEXT base-string is written into the same allocation
+	oauth_base_build(base, http_request_method, argc, argv,
+			s->method == OA_RSA || s->method == OA_PLAINTEXT);
 
 	// generate signature
-	okey = oauth_catenc(2, c_secret, t_secret);
-	odat = oauth_catenc(3, http_request_method, (*argvp)[0], query); // base-string
-	free(http_request_method);
+	switch (s->method)
+	{
+	case OA_RSA:
+	case OA_PLAINTEXT:
+		odat = base->base; // base-string
 
 #ifdef DEBUG_OAUTH
-	fprintf(stderr, "\nliboauth: data to sign='%s'\n\n", odat);
-	fprintf(stderr, "\nliboauth: key='%s'\n\n", okey);
+		fprintf(stderr, "\nliboauth: data to sign='%s'\n\n", odat);
 #endif
 
-	switch (method)
-	{
-	case OA_RSA:
-		sign = oauth_sign_rsa_sha1(odat, okey); // XXX okey needs to be RSA key!
-		break;
+		if (s->method == OA_RSA)
+			sign = oauth_sign_rsa_sha1(odat, s->key); // XXX okey needs to be RSA key!
+		else
+			sign = oauth_sign_plaintext(odat, s->key);
 
-	case OA_PLAINTEXT:
-		sign = oauth_sign_plaintext(odat, okey);
 		break;
 
 	default:
-		sign = oauth_sign_hmac_sha1(odat, okey);
+		// the base-string is streamed into the HMAC, never built
+		sign = oauth_sign_hmac_request(&s->hmac, http_request_method, argv[0], &base->norm);
 	}
 
-#ifdef WIPE_MEMORY
-	memset(okey, 0, strlen(okey));
-	memset(odat, 0, strlen(odat));
-#endif
+	xfree(http_request_method);
+
+	return sign;
+}
+
+void oauth_signer_sign_array_process(const OAuthSigner *s,
+	int *argcp, char ***argvp,
+	char **postargs,
+	const char *http_method)
+{
+	char oarg[1024];
+	char *sign;
+	oauth_base base;
+
+	// add required OAuth protocol parameters
+	oauth_add_protocol_request(argcp, argvp);
+	if (s->token) oauth_add_param_to_array(argcp, argvp, s->token);
+	oauth_add_param_to_array(argcp, argvp, s->consumer);
+	oauth_add_param_to_array(argcp, argvp, s->signature_method);
 
-	free(odat);
-	free(okey);
+	sign = oauth_sign_normalized(*argcp, *argvp, &base, postargs, s, http_method);
+	if (base.norm.count) memcpy(&(*argvp)[1], base.sorted, sizeof(char *) * base.norm.count);
+	oauth_base_free(&base);
 
 	// append signature to query args.
 	snprintf(oarg, 1024, "oauth_signature=%s", sign);
 	oauth_add_param_to_array(argcp, argvp, oarg);
-	free(sign);
-	free(query);
+	xfree(sign);
+}
+
+char *oauth_signer_sign_array(const OAuthSigner *s,
+	int *argcp, char ***argvp,
+	char **postargs,
+	const char *http_method)
+{
+	char *result;
+
+	oauth_signer_sign_array_process(s, argcp, argvp, postargs, http_method);
+	result = oauth_serialize_url(*argcp, ((postargs != NULL) ? 1 : 0), *argvp); // build URL params
+
+	if (postargs != NULL) {
+		*postargs = result;
+		result = xstrdup((*argvp)[0]);
+	}
+
+	return result;
+}
+
+char *oauth_signer_sign_url(const OAuthSigner *s, const char *url,
+	char **postargs,
+	const char *http_method)
+{
+	int argc;
+	char **argv = NULL;
+	char *rv;
+
+	if (postargs != NULL) {
+		argc = oauth_split_post_paramters(url, &argv, 0);
+	} else {
+		argc = oauth_split_url_parameters(url, &argv);
+	}
+
+	rv = oauth_signer_sign_array(s, &argc, &argv, postargs, http_method);
+	oauth_free_array(&argc, &argv);
+	return rv;
+}
+
+void oauth_sign_array2_process(int *argcp, char ***argvp,
+	char **postargs,
+	OAuthMethod method, 
+	const char *http_method, 	/* < HTTP request method */
+	const char *c_key, 			/* < consumer key - posted plain text */
+	const char *c_secret, 		/* < consumer secret - used as 1st part of secret-key */
+	const char *t_key, 			/* < token key - posted plain text in URL */
+	const char *t_secret 		/* < token secret - used as 2st part of secret-key */ )
+{
+	OAuthSigner *s = oauth_signer_new(method, c_key, c_secret, t_key, t_secret);
+
+	oauth_signer_sign_array_process(s, argcp, argvp, postargs, http_method);
+	oauth_signer_free(s);
 }
 
 char *oauth_sign_array2 (int *argcp, char ***argvp,
@@ -928,19 +1156,146 @@ char *oauth_sign_array2 (int *argcp, char ***argvp,
 	const char *t_key, 			/* < token key - posted plain text in URL */
 	const char *t_secret 		/* < token secret - used as 2st part of secret-key */ )
 {
+	OAuthSigner *s = oauth_signer_new(method, c_key, c_secret, t_key, t_secret);
 	char *result;
 
-	oauth_sign_array2_process(argcp, argvp, postargs, method, http_method, c_key, c_secret, t_key, t_secret);
-	result = oauth_serialize_url(*argcp, ((postargs != NULL) ? 1 : 0), *argvp); // build URL params
+	result = oauth_signer_sign_array(s, argcp, argvp, postargs, http_method);
+	oauth_signer_free(s);
+	return result;
+}
+
+/*
+ * oauth_add_protocol() for an OAuthParams list. The protocol parameters a
+ * previous signature of the list left behind are replaced rather than
+ * added a second time, and its oauth_signature is dropped.
+ */
+static void oauth_params_add_protocol(OAuthParams *p, const OAuthSigner *s)
+{
+	char tmp[32];
+	unsigned char r;
+	int i, n;
+
+	oauth_params_reserve(p, 6, 128 + s->consumer_len + s->token_len);
+
+	if (oauth_params_find(p, "oauth_nonce") < 0) {
+		oauth_random_bytes(&r, 1);
+		oauth_params_add(p, "oauth_nonce", 11, tmp, oauth_gen_nonce_into(tmp, 17 + (r & 15)));
+	}
+
+	if (oauth_params_find(p, "oauth_timestamp") < 0) {
+		snprintf(tmp, sizeof(tmp), "%li", (long int)time(NULL));
+		oauth_params_add(p, "oauth_timestamp", 15, tmp, strlen(tmp));
+	}
+
+	if (s->token != NULL) {
+		oauth_params_set(p, "oauth_token", 11, s->token + SIGNER_TOKEN, s->token_len - SIGNER_TOKEN);
+	}
+
+	oauth_params_set(p, "oauth_consumer_key", 18, s->consumer + SIGNER_CONSUMER, s->consumer_len - SIGNER_CONSUMER);
+	oauth_params_set(p, "oauth_signature_method", 22, s->signature_method + SIGNER_METHOD,
+			s->signature_method_len - SIGNER_METHOD);
+
+	if (oauth_params_find(p, "oauth_version") < 0) {
+		oauth_params_add(p, "oauth_version", 13, "1.0", 3);
+	}
+
+	for (i = n = 0; i < p->count; i++) {
+		if (p->param[i].name_len != 15 || memcmp(OAUTH_PARAM_STR(p, i), "oauth_signature", 15)) {
+			p->param[n++] = p->param[i];
+		}
+	}
+	if (n < p->count) {
+		p->count = n;
+		oauth_params_reindex(p);
+	}
+}
+
+void oauth_signer_sign_params_process(const OAuthSigner *s,
+	OAuthParams *p, const char *url,
+	char **postargs,
+	const char *http_method)
+{
+	oauth_base base;
+	oauth_norm_param *order;
+	OAuthParam t;
+	char *sign;
+	int i, j, k;
+
+	oauth_params_add_protocol(p, s);
+
+	sign = oauth_sign_normalized(p->count + 1, oauth_params_argv(p, url), &base,
+			postargs, s, http_method);
+
+	// put the records into normalized order, following the cycles of the
+	// permutation (order[i].index is where entry i comes from)
+	order = base.norm.param;
+	for (i = 0; i < p->count; i++) {
+		if (order[i].index < 0) continue;
+		t = p->param[i];
+		for (j = i; (k = order[j].index) != i; j = k) {
+			p->param[j] = p->param[k];
+			order[j].index = -1;
+		}
+		p->param[j] = t;
+		order[j].index = -1;
+	}
+	oauth_base_free(&base);
+	oauth_params_reindex(p);
+
+	oauth_params_add(p, "oauth_signature", 15, sign, strlen(sign));
+	xfree(sign);
+}
+
+char *oauth_signer_sign_params(const OAuthSigner *s,
+	OAuthParams *p, const char *url,
+	char **postargs,
+	const char *http_method)
+{
+	char *result;
+
+	oauth_signer_sign_params_process(s, p, url, postargs, http_method);
+	result = oauth_serialize_url(p->count + 1, ((postargs != NULL) ? 1 : 0), oauth_params_argv(p, url)); // build URL params
 
 	if (postargs != NULL) {
 		*postargs = result;
-		result = xstrdup((*argvp)[0]);
+		result = xstrdup(url);
 	}
 
 	return result;
 }
 
+void oauth_sign_params_process(OAuthParams *p, const char *url,
+	char **postargs,
+	OAuthMethod method, 
+	const char *http_method, 	/* < HTTP request method */
+	const char *c_key, 			/* < consumer key - posted plain text */
+	const char *c_secret, 		/* < consumer secret - used as 1st part of secret-key */
+	const char *t_key, 			/* < token key - posted plain text in URL */
+	const char *t_secret 		/* < token secret - used as 2st part of secret-key */ )
+{
+	OAuthSigner *s = oauth_signer_new(method, c_key, c_secret, t_key, t_secret);
+
+	oauth_signer_sign_params_process(s, p, url, postargs, http_method);
+	oauth_signer_free(s);
+}
+
+char *oauth_sign_params(OAuthParams *p, const char *url,
+	char **postargs,
+	OAuthMethod method, 
+	const char *http_method, 	/* < HTTP request method */
+	const char *c_key, 			/* < consumer key - posted plain text */
+	const char *c_secret, 		/* < consumer secret - used as 1st part of secret-key */
+	const char *t_key, 			/* < token key - posted plain text in URL */
+	const char *t_secret 		/* < token secret - used as 2st part of secret-key */ )
+{
+	OAuthSigner *s = oauth_signer_new(method, c_key, c_secret, t_key, t_secret);
+	char *result;
+
+	result = oauth_signer_sign_params(s, p, url, postargs, http_method);
+	oauth_signer_free(s);
+	return result;
+}
+
 
 /**
  * free array args
@@ -952,10 +1307,10 @@ void oauth_free_array(int *argcp, char ***argvp)
 {
 	int i = 0;
 	while (i < (*argcp)) {
-		free((*argvp)[i++]);
+		xfree((*argvp)[i++]);
 	}
 
-	free(*argvp);
+	xfree(*argvp);
 }
 
 /**
@@ -964,19 +1319,38 @@ void oauth_free_array(int *argcp, char ***argvp)
  */
 char *oauth_body_hash_encode(size_t len, unsigned char *digest)
 {
-	char *sign = NULL;
-	char *sign_url = NULL;
+	char *sign_url;
+	size_t n = oauth_body_hash_encode_len(len);
 
-	sign = oauth_encode_base64(len, digest);
-	sign_url = (char *)xmalloc(17 + strlen(sign));
+	sign_url = (char *)xmalloc(n + 1);
+	oauth_body_hash_encode_into(sign_url, n + 1, len, digest);
 
-	strcpy(sign_url, "oauth_body_hash=");
-	strcat(sign_url, sign);
+	xfree(digest);
+	return sign_url;
+}
 
-	free(sign);
-	free(digest);
+#define OAUTH_BODY_HASH_PREFIX "oauth_body_hash="
+#define OAUTH_BODY_HASH_PREFIX_LEN (sizeof(OAUTH_BODY_HASH_PREFIX) - 1)
 
-	return sign_url;
+size_t oauth_body_hash_encode_len(size_t len)
+{
+	return OAUTH_BODY_HASH_PREFIX_LEN + OAUTH_BASE64_ENCODED_LEN(len);
+}
+
+size_t oauth_body_hash_encode_into(char *dest, size_t size, size_t len, const unsigned char *digest)
+{
+	size_t pre = OAUTH_BODY_HASH_PREFIX_LEN;
+
+	if (size <= pre) {
+		if (size) {
+			memcpy(dest, OAUTH_BODY_HASH_PREFIX, size - 1);
+			dest[size - 1] = '\0';
+		}
+		return oauth_body_hash_encode_len(len);
+	}
+
+	memcpy(dest, OAUTH_BODY_HASH_PREFIX, pre);
+	return pre + oauth_encode_base64_into(dest + pre, size - pre, digest, len);
 }
 
 
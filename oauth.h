@@ -27,6 +27,8 @@
 #ifndef _OAUTH_H
 #define _OAUTH_H      1 
 
+#include <sys/types.h>
+
 #ifndef DOXYGEN_IGNORE
 // liboauth version
 #define LIBOAUTH_VERSION "0.9.5"
@@ -65,7 +67,8 @@ extern "C" {
 typedef enum { 
     OA_HMAC=0, ///< use HMAC-SHA1 request signing method
     OA_RSA, ///< use RSA signature 
-    OA_PLAINTEXT ///< use plain text signature (for testing only)
+    OA_PLAINTEXT, ///< use plain text signature (for testing only)
+    OA_HMAC_SHA256 ///< use HMAC-SHA256 request signing method
   } OAuthMethod;
 
 /**
@@ -78,6 +81,26 @@ typedef enum {
  */
 char *oauth_encode_base64(int size, const unsigned char *src);
 
+/**
+ * same as \ref oauth_encode_base64 but writes into the caller's buffer,
+ * snprintf-style: at most size - 1 chars and a terminating zero are
+ * stored, and the full length of the encoding is returned. The result
+ * was truncated if that is size or more.
+ *
+ * @param dest buffer receiving the encoding (may be NULL if size is 0)
+ * @param size size of dest in bytes
+ * @param src the data to encode
+ * @param len the size of the data in src (0 encodes nothing)
+ * @return length of the complete encoding, without the terminating zero
+ */
+size_t oauth_encode_base64_into(char *dest, size_t size, const unsigned char *src, size_t len);
+
+/**
+ * exact length of the base64 encoding of len bytes, without
+ * the terminating zero.
+ */
+size_t oauth_encode_base64_len(size_t len);
+
 /**
  * Decode the base64 encoded string 'src' into the memory pointed to by
  * 'dest'. 
@@ -90,6 +113,23 @@ char *oauth_encode_base64(int size, const unsigned char *src);
  */
 int oauth_decode_base64(unsigned char *dest, const char *src);
 
+/**
+ * Decode 'len' chars of base64 in 'src' into the 'size' bytes at 'dest'
+ * in a single pass, without a temporary copy.
+ * Whitespace is skipped and the trailing '=' padding may be left out;
+ * any other char outside the base64 alphabet is an error. No
+ * terminating zero is written.
+ *
+ * @param dest buffer receiving the decoded data; 3 bytes for
+ * every 4 chars of input (rounded up) are always enough.
+ * @param size the size of 'dest'
+ * @param src base64 encoded data, need not be zero-terminated
+ * @param len the number of chars in 'src'
+ * @return the number of bytes written to 'dest', or -1 if 'src' is
+ * not valid base64 or the decoded data does not fit into 'size' bytes.
+ */
+int oauth_decode_base64_into(unsigned char *dest, size_t size, const char *src, size_t len);
+
 /**
  * Escape 'string' according to RFC3986 and
  * http://oauth.net/core/1.0/#encoding_parameters.
@@ -100,6 +140,25 @@ int oauth_decode_base64(unsigned char *dest, const char *src);
  */
 char *oauth_url_escape(const char *string);
 
+/**
+ * same as \ref oauth_url_escape but for 'len' bytes of 'src' written
+ * into the caller's buffer, snprintf-style: at most size - 1 chars and a
+ * terminating zero are stored, and the full escaped length is returned.
+ *
+ * @param dest buffer receiving the escaped string (may be NULL if size is 0)
+ * @param size size of dest in bytes
+ * @param src the data to be encoded, need not be zero-terminated
+ * @param len the number of bytes in src
+ * @return length of the escaped string, without the terminating zero
+ */
+size_t oauth_url_escape_into(char *dest, size_t size, const char *src, size_t len);
+
+/**
+ * exact length of the RFC3986 escaped form of 'len' bytes of 'src',
+ * without the terminating zero.
+ */
+size_t oauth_url_escape_len(const char *src, size_t len);
+
 /**
  * Parse RFC3986 encoded 'string' back to  unescaped version.
  *
@@ -109,6 +168,38 @@ char *oauth_url_escape(const char *string);
  * The caller must free the returned string.
  */
 char *oauth_url_unescape(const char *string, size_t *olen);
+
+/**
+ * same as \ref oauth_url_unescape but for 'len' bytes of 'src' written
+ * into the caller's buffer, snprintf-style: at most size - 1 bytes and a
+ * terminating zero are stored, and the full unescaped length is returned.
+ * The unescaped data may itself contain zero bytes.
+ *
+ * @param dest buffer receiving the unescaped data (may be NULL if size is 0)
+ * @param size size of dest in bytes
+ * @param src the data to be unescaped, need not be zero-terminated
+ * @param len the number of bytes in src
+ * @return length of the unescaped data, without the terminating zero
+ */
+size_t oauth_url_unescape_into(char *dest, size_t size, const char *src, size_t len);
+
+/**
+ * exact length of 'len' bytes of 'src' once unescaped,
+ * without the terminating zero.
+ */
+size_t oauth_url_unescape_len(const char *src, size_t len);
+
+/**
+ * same as \ref oauth_url_unescape but decodes the 'len' bytes of 'buf'
+ * in place, for buffers the caller owns. The result is never longer
+ * than the input.
+ *
+ * @param buf the data to be unescaped; it needs room for len + 1 bytes
+ * as the result is zero-terminated (any zero-terminated string has).
+ * @param len the number of bytes in buf
+ * @return length of the unescaped data, without the terminating zero
+ */
+size_t oauth_url_unescape_inplace(char *buf, size_t len);
  
 
 /**
@@ -136,6 +227,138 @@ char *oauth_sign_hmac_sha1(const char *m, const char *k);
  */
 char *oauth_sign_hmac_sha1_raw(const char *m, const size_t ml, const char *k, const size_t kl);
 
+/**
+ * returns base64 encoded HMAC-SHA256 signature for
+ * given message and key.
+ * both data and key need to be urlencoded.
+ *
+ * the returned string needs to be freed by the caller
+ *
+ * @param m message to be signed
+ * @param k key used for signing
+ * @return signature string.
+ */
+char *oauth_sign_hmac_sha256(const char *m, const char *k);
+
+/**
+ * same as \ref oauth_sign_hmac_sha256 but allows
+ * to specify length of message and key (in case they contain null chars).
+ *
+ * @param m message to be signed
+ * @param ml length of message
+ * @param k key used for signing
+ * @param kl length of key
+ * @return signature string.
+ */
+char *oauth_sign_hmac_sha256_raw(const char *m, const size_t ml, const char *k, const size_t kl);
+
+/**
+ * opaque HMAC key with precomputed inner and outer hash state.
+ * see \ref oauth_hmac_sha1_prepare
+ */
+typedef struct OAuthHmacKey OAuthHmacKey;
+
+/**
+ * precompute the HMAC-SHA1 state for a key.
+ *
+ * HMAC hashes one block derived from the key before the message and
+ * one before the inner digest. Preparing the key once and signing with
+ * \ref oauth_sign_hmac_sha1_prepared skips both blocks, which roughly
+ * halves the hashing work for short messages such as OAuth base strings.
+ *
+ * the returned key needs to be freed with \ref oauth_hmac_key_free
+ *
+ * @param k key used for signing (eg. "consumer_secret&token_secret")
+ * @param kl length of key
+ * @return prepared key
+ */
+OAuthHmacKey *oauth_hmac_sha1_prepare(const char *k, size_t kl);
+
+/**
+ * same as \ref oauth_sign_hmac_sha1_raw with a prepared key.
+ *
+ * the returned string needs to be freed by the caller
+ *
+ * @param m message to be signed
+ * @param ml length of message
+ * @param key key prepared with \ref oauth_hmac_sha1_prepare
+ * @return signature string.
+ */
+char *oauth_sign_hmac_sha1_prepared(const char *m, size_t ml, const OAuthHmacKey *key);
+
+/**
+ * wipe and free a prepared key.
+ *
+ * @param key key to free, may be NULL
+ */
+void oauth_hmac_key_free(OAuthHmacKey *key);
+
+/**
+ * opaque incremental HMAC context.
+ * see \ref oauth_hmac_init
+ */
+typedef struct OAuthHmacCtx OAuthHmacCtx;
+
+/**
+ * start an incremental HMAC signature. The message is then passed
+ * piecewise to \ref oauth_hmac_update and the signature is returned
+ * by \ref oauth_hmac_final, so it never has to be held in memory as
+ * a whole.
+ *
+ * @param method \ref OA_HMAC or \ref OA_HMAC_SHA256
+ * @param k key used for signing
+ * @param kl length of key
+ * @return context to be passed to \ref oauth_hmac_final, or NULL
+ * if method is not an HMAC method.
+ */
+OAuthHmacCtx *oauth_hmac_init(OAuthMethod method, const char *k, size_t kl);
+
+/**
+ * same as \ref oauth_hmac_init for HMAC-SHA1 with a key prepared
+ * by \ref oauth_hmac_sha1_prepare.
+ *
+ * @param key prepared key, it is not modified
+ * @return HMAC context
+ */
+OAuthHmacCtx *oauth_hmac_init_prepared(const OAuthHmacKey *key);
+
+/**
+ * append data to the message signed with the given context.
+ *
+ * @param ctx context returned by \ref oauth_hmac_init
+ * @param m message data
+ * @param ml length of message data
+ */
+void oauth_hmac_update(OAuthHmacCtx *ctx, const char *m, size_t ml);
+
+/**
+ * finish the signature and free the context.
+ *
+ * the returned string needs to be freed by the caller
+ *
+ * @param ctx context returned by \ref oauth_hmac_init
+ * @return base64 encoded signature string.
+ */
+char *oauth_hmac_final(OAuthHmacCtx *ctx);
+
+/**
+ * HMAC-SHA1 sign a batch of messages.
+ *
+ * Equivalent to calling \ref oauth_sign_hmac_sha1_raw for every
+ * (message, key) pair, but the independent SHA-1 computations are run
+ * side by side on CPUs with AVX2 or AVX-512 (8 or 16 at a time).
+ *
+ * each returned signature needs to be freed by the caller
+ *
+ * @param n number of messages to sign
+ * @param m array of n messages
+ * @param ml array of n message lengths, or NULL to use strlen()
+ * @param k array of n keys
+ * @param kl array of n key lengths, or NULL to use strlen()
+ * @param sigs array receiving n base64 encoded signature strings
+ */
+void oauth_sign_hmac_sha1_batch(size_t n, const char **m, const size_t *ml, const char **k, const size_t *kl, char **sigs);
+
 /**
  * returns plaintext signature for the given key.
  *
@@ -184,6 +407,25 @@ int oauth_verify_rsa_sha1(const char *m, const char *c, const char *s);
  */
 char *oauth_catenc(int len, ...);
 
+/**
+ * same as \ref oauth_catenc but writes into the caller's buffer,
+ * snprintf-style: at most size - 1 chars and a terminating zero are
+ * stored, and the full length of the joined string is returned.
+ *
+ * @param dest buffer receiving the string (may be NULL if size is 0)
+ * @param size size of dest in bytes
+ * @param len the number of (char *) arguments to follow, NULL ones
+ * count as empty strings
+ * @return length of the joined string, without the terminating zero
+ */
+size_t oauth_catenc_into(char *dest, size_t size, int len, ...);
+
+/**
+ * exact length of what \ref oauth_catenc would return for the same
+ * arguments, without the terminating zero.
+ */
+size_t oauth_catenc_len(int len, ...);
+
 /**
  * splits the given url into a parameter array. 
  * (see \ref oauth_serialize_url and \ref oauth_serialize_url_parameters for the reverse)
@@ -215,6 +457,69 @@ int oauth_split_url_parameters(const char *url, char ***argv);
  */
 int oauth_split_post_paramters(const char *url, char ***argv, short qesc);
 
+/**
+ * one parameter of a query string found by \ref oauth_query_next,
+ * pointing into that string (not decoded, not zero-terminated).
+ */
+typedef struct {
+	const char *name; ///< start of the parameter
+	size_t name_len; ///< length of the name
+	const char *value; ///< start of the value, NULL if there is no '='
+	size_t value_len; ///< length of the value
+	size_t len; ///< length of the whole "name=value"
+} OAuthQueryParam;
+
+/**
+ * state of a walk over the parameters of a query string or
+ * application/x-www-form-urlencoded body; see \ref oauth_query_init.
+ */
+typedef struct {
+	const char *pos; ///< where the next parameter is looked for
+	const char *end; ///< end of the string
+} OAuthQuery;
+
+/** flags for \ref oauth_query_decode */
+enum {
+	OAUTH_QUERY_PLUS = 1, ///< '+' is a space, as in a URL query string
+	OAUTH_QUERY_SOH = 2, ///< ASCII SOH (0x01) is an '&', see \ref oauth_split_post_paramters
+	OAUTH_QUERY_RAW = 4 ///< only replace the above, keep %XX sequences
+};
+
+/**
+ * start splitting a query string (or URL) into parameters. The
+ * parameters are separated by '&' or '?', as for
+ * \ref oauth_split_post_paramters; empty ones are skipped.
+ * Splitting neither modifies nor copies the string, and keeps no
+ * other state than 'q', so it is safe to do from several threads.
+ *
+ * @param q state to initialize
+ * @param s the string, which must stay valid while walking it
+ * @param len length of s
+ */
+void oauth_query_init(OAuthQuery *q, const char *s, size_t len);
+
+/**
+ * find the next parameter. With a URL the first one is the URL
+ * itself (everything up to the '?').
+ *
+ * @param q state set up by \ref oauth_query_init
+ * @param p filled with the spans of the parameter
+ * @return 1 if a parameter was found, 0 at the end of the string
+ */
+int oauth_query_next(OAuthQuery *q, OAuthQueryParam *p);
+
+/**
+ * decode 'len' bytes of a parameter (or of its name or value).
+ *
+ * @param dst output of at most len bytes, not zero-terminated;
+ * may be src itself, but may not overlap it otherwise
+ * @param src text to decode
+ * @param len length of src
+ * @param flags OAUTH_QUERY_* flags
+ * @return number of bytes written to dst
+ */
+size_t oauth_query_decode(char *dst, const char *src, size_t len, int flags);
+
 /**
  * build a url query string from an array.
  *
@@ -255,14 +560,34 @@ char *oauth_serialize_url_sep(int argc, int start, char **argv, char *sep, int m
 char *oauth_serialize_url_parameters(int argc, char **argv);
  
 /**
- * generate a random string between 15 and 32 chars length
+ * generate a random string between 16 and 31 chars length
  * and return a pointer to it. The value needs to be freed by the
  * caller
  *
+ * The characters come from a per-thread ChaCha20 generator seeded by
+ * the operating system; this is thread-safe.
+ *
+ * On PSP there is neither thread local storage nor an entropy source in
+ * user mode: all threads share one generator (thread-safe, it is updated
+ * with interrupts suspended), and it is seeded from the jitter of the
+ * system clock. Nonces there are unique but less unpredictable than
+ * elsewhere; don't use them where they have to be secret.
+ *
  * @return zero terminated random string.
  */
 char *oauth_gen_nonce();
 
+/**
+ * same as \ref oauth_gen_nonce but writes into the caller's buffer
+ * instead of allocating: size - 1 random characters from [A-Za-z0-9_-]
+ * followed by a terminating zero. The same PSP limitations apply.
+ *
+ * @param buf buffer receiving the nonce
+ * @param size size of buf in bytes; 17 or more is recommended
+ * @return length of the nonce (size - 1), 0 if size is 0
+ */
+size_t oauth_gen_nonce_into(char *buf, size_t size);
+
 /**
  * string compare function for oauth parameters.
  *
@@ -335,6 +660,103 @@ int oauth_time_independent_equals(const char *a, const char *b);
  */
 int oauth_time_indepenent_equals(const char *a, const char *b) attribute_deprecated;
 
+#define OAUTH_VERIFY_MAX_PARAMS 64 ///< request parameters \ref oauth_verify_request keeps on the stack, more are allocated
+
+/** \enum OAuthVerifyResult
+ * result of \ref oauth_verify_request.
+ */
+typedef enum {
+    OA_VERIFY_OK=0, ///< the signature is valid
+    OA_VERIFY_BAD_SIGNATURE, ///< the signature does not match the request
+    OA_VERIFY_MALFORMED, ///< no or more than one oauth_signature, or a malformed Authorization header
+    OA_VERIFY_UNSUPPORTED, ///< oauth_signature_method is not HMAC-SHA1 or HMAC-SHA256
+    OA_VERIFY_TOO_LARGE ///< the escaped secrets are longer than 1 KB
+  } OAuthVerifyResult;
+
+/**
+ * verify the HMAC-SHA1 or HMAC-SHA256 signature of a received request.
+ *
+ * The signature base string is rebuilt from the parameters in the query
+ * string, the Authorization header and the form encoded body, normalized
+ * like \ref oauth_sign_array2_process does when signing. The signature
+ * must be in the padded, canonical base64 the signer writes and is
+ * compared in constant time. No memory is allocated unless the escaped
+ * parameters take more than 4 KB or there are more than
+ * OAUTH_VERIFY_MAX_PARAMS of them, so this can be called for every
+ * request on a busy server.
+ *
+ * Only the signature is checked; oauth_timestamp and oauth_nonce must be
+ * checked by the caller.
+ *
+ * @param http_method request method, e.g. "GET" or "POST"
+ * @param url the full request URL including the query string
+ * @param auth_header value of the Authorization header ("OAuth ...") or NULL
+ * @param body application/x-www-form-urlencoded body, or NULL for other
+ * content types (which are not part of the signature)
+ * @param body_len length of body
+ * @param c_secret consumer secret
+ * @param t_secret token secret or NULL
+ * @return OA_VERIFY_OK if the signature is valid, otherwise the reason
+ */
+OAuthVerifyResult oauth_verify_request(const char *http_method, const char *url,
+                                       const char *auth_header, const char *body, size_t body_len,
+                                       const char *c_secret, const char *t_secret);
+
+/** \enum OAuthReplayResult
+ * result of \ref oauth_replay_check.
+ */
+typedef enum {
+    OA_REPLAY_OK=0, ///< first use of the nonce, it has been recorded
+    OA_REPLAY_SEEN, ///< the nonce was already used: reject the request
+    OA_REPLAY_STALE, ///< the timestamp is outside the accepted window: reject the request
+    OA_REPLAY_FULL ///< the cache is too full to record the nonce: reject the request
+  } OAuthReplayResult;
+
+/**
+ * opaque nonce replay cache.
+ * see \ref oauth_replay_cache_new
+ */
+typedef struct OAuthReplayCache OAuthReplayCache;
+
+/**
+ * create a replay cache for (consumer key, timestamp, nonce) triples.
+ *
+ * Nonces are remembered as long as their timestamp is within 'window'
+ * seconds of the current time and forgotten after that without any
+ * cleanup calls. Memory is allocated once, here. The cache may be
+ * used from several threads at the same time without locking (except
+ * on PSP).
+ *
+ * @param capacity number of nonces expected within the window
+ * @param window accepted clock skew of oauth_timestamp, in seconds
+ * @return replay cache, free with \ref oauth_replay_cache_free
+ */
+OAuthReplayCache *oauth_replay_cache_new(size_t capacity, long window);
+
+/**
+ * free a replay cache.
+ *
+ * @param cache cache to free, may be NULL
+ */
+void oauth_replay_cache_free(OAuthReplayCache *cache);
+
+/**
+ * check and record the nonce of a request.
+ *
+ * Nonces are compared by a 32 bit fingerprint, so a fresh nonce is
+ * mistaken for a replay with a probability of about 2^-32 for each
+ * entry it is compared with (a few per check).
+ *
+ * @param cache cache created with \ref oauth_replay_cache_new
+ * @param c_key oauth_consumer_key of the request
+ * @param timestamp oauth_timestamp of the request
+ * @param nonce oauth_nonce of the request
+ * @param now current time, usually time(NULL)
+ * @return OA_REPLAY_OK if the request may be accepted
+ */
+OAuthReplayResult oauth_replay_check(OAuthReplayCache *cache, const char *c_key,
+                                     long timestamp, const char *nonce, long now);
+
 /**
  * calculate OAuth-signature for a given HTTP request URL, parameters and oauth-tokens.
  *
@@ -353,7 +775,7 @@ int oauth_time_indepenent_equals(const char *a, const char *b) attribute_depreca
  * is stored. If 'postargs' is NULL, no value is stored.
  *
  * @param method specify the signature method to use. It is of type 
- * \ref OAuthMethod and most likely \ref OA_HMAC.
+ * \ref OAuthMethod and most likely \ref OA_HMAC or \ref OA_HMAC_SHA256.
  *
  * @param http_method The HTTP request method to use (ie "GET", "PUT",..)
  * If NULL is given as 'http_method' this defaults to "GET" when 
@@ -411,7 +833,7 @@ char *oauth_sign_url(const char *url, char **postargs,
  * is stored. If 'postargs' is NULL, no value is stored.
  *
  * @param method specify the signature method to use. It is of type 
- * \ref OAuthMethod and most likely \ref OA_HMAC.
+ * \ref OAuthMethod and most likely \ref OA_HMAC or \ref OA_HMAC_SHA256.
  *
  * @param http_method The HTTP request method to use (ie "GET", "PUT",..)
  * If NULL is given as 'http_method' this defaults to "GET" when 
@@ -450,7 +872,7 @@ void oauth_sign_array2_process(int *argcp, char ***argvp,
  * is stored. If 'postargs' is NULL, no value is stored.
  *
  * @param method specify the signature method to use. It is of type 
- * \ref OAuthMethod and most likely \ref OA_HMAC.
+ * \ref OAuthMethod and most likely \ref OA_HMAC or \ref OA_HMAC_SHA256.
  *
  * @param http_method The HTTP request method to use (ie "GET", "PUT",..)
  * If NULL is given as 'http_method' this defaults to "GET" when 
@@ -486,6 +908,437 @@ char *oauth_sign_array(int *argcp, char ***argvp,
 	) attribute_deprecated;
 
 
+/**
+ * one parameter of an \ref OAuthParams list.
+ * the text "name=value" (or just "name" for a parameter without '=')
+ * is stored zero-terminated at OAuthParams.buf + off.
+ */
+typedef struct {
+	size_t off; ///< start of the parameter in OAuthParams.buf
+	size_t name_len; ///< length of the name
+	size_t len; ///< length of the whole parameter; len > name_len if it has a value
+} OAuthParam;
+
+/**
+ * list of request parameters in a single buffer, used instead of the
+ * argv array of \ref oauth_sign_array2 by \ref oauth_sign_params.
+ *
+ * Parameters are appended in one growing buffer and indexed by offset,
+ * so adding one costs no allocation of its own. Initialize with
+ * \ref oauth_params_init (or OAUTH_PARAMS_INIT), free with
+ * \ref oauth_params_free. Offsets stay valid as the list grows,
+ * pointers into buf do not.
+ *
+ * Lookups by name (\ref oauth_params_find, \ref oauth_params_set)
+ * build a hash index of the names on longer lists, kept up to date as
+ * parameters are added; code that reorders or removes entries of param
+ * itself must call \ref oauth_params_reindex afterwards.
+ */
+typedef struct {
+	OAuthParam *param; ///< the parameters
+	int count; ///< number of parameters
+	int alloc; ///< room in param
+	char *buf; ///< text of all parameters
+	size_t used; ///< bytes of buf in use
+	size_t size; ///< bytes allocated for buf
+	char **argv; ///< array returned by \ref oauth_params_argv
+	struct OAuthParamsIndex *index; ///< name index, NULL until a lookup needs one
+} OAuthParams;
+
+#define OAUTH_PARAMS_INIT { NULL, 0, 0, NULL, 0, 0, NULL, NULL }
+
+/** "name=value" of parameter i, zero-terminated */
+#define OAUTH_PARAM_STR(p, i) ((p)->buf + (p)->param[i].off)
+/** whether parameter i has a value (contains '=') */
+#define OAUTH_PARAM_HAS_VALUE(p, i) ((p)->param[i].len > (p)->param[i].name_len)
+/** value of parameter i, zero-terminated (only if it has one) */
+#define OAUTH_PARAM_VALUE(p, i) (OAUTH_PARAM_STR(p, i) + (p)->param[i].name_len + 1)
+/** length of the value of parameter i (only if it has one) */
+#define OAUTH_PARAM_VALUE_LEN(p, i) ((p)->param[i].len - (p)->param[i].name_len - 1)
+
+/**
+ * initialize an empty parameter list.
+ *
+ * @param p list to initialize
+ */
+void oauth_params_init(OAuthParams *p);
+
+/**
+ * make room for more parameters, so that adding them does not
+ * need to grow the list again.
+ *
+ * @param p parameter list
+ * @param count number of parameters that will be added
+ * @param bytes total length of their text ("name=value", without
+ * terminating zeros)
+ */
+void oauth_params_reserve(OAuthParams *p, int count, size_t bytes);
+
+/**
+ * append a parameter.
+ *
+ * @param p parameter list
+ * @param name parameter name, not escaped
+ * @param name_len length of name
+ * @param value parameter value, not escaped; NULL to add the name
+ * without '='
+ * @param value_len length of value
+ */
+void oauth_params_add(OAuthParams *p, const char *name, size_t name_len, const char *value, size_t value_len);
+
+/**
+ * append a parameter given as one string, like
+ * \ref oauth_add_param_to_array.
+ *
+ * @param p parameter list
+ * @param param parameter to add (eg. "foo=bar")
+ */
+void oauth_params_add_param(OAuthParams *p, const char *param);
+
+/**
+ * search the list for a parameter with a value, like
+ * \ref oauth_param_exists. Takes constant time on average.
+ *
+ * @param p parameter list
+ * @param name name of the parameter
+ * @return index of the first such parameter, -1 if there is none
+ */
+int oauth_params_find(OAuthParams *p, const char *name);
+
+/**
+ * replace the value of parameter i (adding a '=' if it had none).
+ *
+ * @param p parameter list
+ * @param i index of the parameter
+ * @param value new value, not escaped; must not point into the list
+ * @param value_len length of value
+ */
+void oauth_params_set_value(OAuthParams *p, int i, const char *value, size_t value_len);
+
+/**
+ * replace the value of the first parameter called 'name', or append
+ * the parameter if there is none.
+ *
+ * @param p parameter list
+ * @param name parameter name
+ * @param name_len length of name
+ * @param value new value; must not point into the list
+ * @param value_len length of value
+ * @return index of the parameter
+ */
+int oauth_params_set(OAuthParams *p, const char *name, size_t name_len, const char *value, size_t value_len);
+
+/**
+ * remove every parameter whose name occurred earlier in the list,
+ * keeping the order of the others. Takes time linear in the number
+ * of parameters.
+ *
+ * @param p parameter list
+ * @return number of parameters removed
+ */
+int oauth_params_dedup(OAuthParams *p);
+
+/**
+ * forget the name index of the list, after entries of OAuthParams.param
+ * were reordered or removed by the caller. The next lookup rebuilds it.
+ *
+ * @param p parameter list
+ */
+void oauth_params_reindex(OAuthParams *p);
+
+/**
+ * append the parameters of an argv array.
+ *
+ * @param p parameter list
+ * @param argc number of elements in argv
+ * @param argv parameters (eg. argv + 1 of \ref oauth_split_url_parameters,
+ * to leave out the base URL)
+ */
+void oauth_params_add_array(OAuthParams *p, int argc, char **argv);
+
+/**
+ * copy the list into a new argv array as used by \ref oauth_sign_array2.
+ *
+ * @param p parameter list
+ * @param url base URL to store as argv[0], or NULL to start with the
+ * first parameter
+ * @param argvp receives the array, free it with \ref oauth_free_array
+ * @return number of elements in the array
+ */
+int oauth_params_to_array(const OAuthParams *p, const char *url, char ***argvp);
+
+/**
+ * argv view on the list, without copying: argv[0] is 'url' and
+ * argv[1..count] point into the list's buffer. The array is owned by
+ * the list and valid until it is modified or freed.
+ *
+ * @param p parameter list
+ * @param url base URL to store as argv[0]
+ * @return NULL terminated array of count + 1 elements
+ */
+char **oauth_params_argv(OAuthParams *p, const char *url);
+
+/**
+ * free the memory of a parameter list; it is empty afterwards.
+ *
+ * @param p parameter list
+ */
+void oauth_params_free(OAuthParams *p);
+
+/**
+ * same as \ref oauth_sign_array2_process on an \ref OAuthParams list:
+ * the OAuth parameters are added, the list is sorted into normalized
+ * order and the oauth_signature is appended.
+ * A list that was signed before can be signed again: oauth_token,
+ * oauth_consumer_key and oauth_signature_method are replaced, and the
+ * old oauth_signature is dropped (nonce and timestamp are kept unless
+ * removed by the caller).
+ *
+ * @param p parameters of the request, modified
+ * @param url base URL of the request (without query string)
+ * @param postargs only used to choose the default of 'http_method'
+ * @param method signature method
+ * @param http_method HTTP request method, or NULL for the default
+ * @param c_key consumer key
+ * @param c_secret consumer secret
+ * @param t_key token key
+ * @param t_secret token secret
+ */
+void oauth_sign_params_process(OAuthParams *p, const char *url,
+	char **postargs,
+	OAuthMethod method, 
+	const char *http_method, //< HTTP request method
+	const char *c_key, 		//< consumer key - posted plain text
+	const char *c_secret, 	//< consumer secret - used as 1st part of secret-key 
+	const char *t_key, 		//< token key - posted plain text in URL
+	const char *t_secret 	//< token secret - used as 2st part of secret-key
+	);
+
+/**
+ * same as \ref oauth_sign_array2 on an \ref OAuthParams list.
+ *
+ * The parameters are signed where they are, with neither the URL split
+ * again nor the strings copied.
+ *
+ * @param p parameters of the request, modified as by
+ * \ref oauth_sign_params_process
+ * @param url base URL of the request (without query string)
+ * @param postargs If not NULL it receives the signed POST parameters,
+ * and the base URL is returned.
+ * @param method signature method
+ * @param http_method HTTP request method, or NULL for the default
+ * @param c_key consumer key
+ * @param c_secret consumer secret
+ * @param t_key token key
+ * @param t_secret token secret
+ *
+ * @return the signed url or NULL if an error occurred.
+ */
+char *oauth_sign_params(OAuthParams *p, const char *url,
+	char **postargs,
+	OAuthMethod method, 
+	const char *http_method, //< HTTP request method
+	const char *c_key, 		//< consumer key - posted plain text
+	const char *c_secret, 	//< consumer secret - used as 1st part of secret-key 
+	const char *t_key, 		//< token key - posted plain text in URL
+	const char *t_secret 	//< token secret - used as 2st part of secret-key
+	);
+
+/**
+ * opaque set of credentials prepared for signing many requests.
+ * see \ref oauth_signer_new
+ */
+typedef struct OAuthSigner OAuthSigner;
+
+/**
+ * prepare a signer for one set of credentials.
+ *
+ * The escaped "c_secret&t_secret" key (with the HMAC pad blocks already
+ * hashed for the HMAC methods) and the oauth_consumer_key, oauth_token
+ * and oauth_signature_method parameters are computed once here, so
+ * signing a request with the oauth_signer_sign_* functions only deals
+ * with its nonce, timestamp, URL and parameters.
+ * A signer is not modified by signing, so several threads may sign with
+ * the same one.
+ *
+ * the returned signer needs to be freed with \ref oauth_signer_free
+ *
+ * @param method signature method
+ * @param c_key consumer key
+ * @param c_secret consumer secret
+ * @param t_key token key, may be NULL
+ * @param t_secret token secret
+ * @return signer
+ */
+OAuthSigner *oauth_signer_new(OAuthMethod method,
+	const char *c_key,
+	const char *c_secret,
+	const char *t_key,
+	const char *t_secret);
+
+/**
+ * wipe and free a signer.
+ *
+ * @param s signer to free, may be NULL
+ */
+void oauth_signer_free(OAuthSigner *s);
+
+/**
+ * same as \ref oauth_sign_url2 with the credentials of a signer.
+ *
+ * @param s signer
+ * @param url the url to sign
+ * @param postargs see \ref oauth_sign_url2
+ * @param http_method HTTP request method, or NULL for the default
+ * @return the signed url or base URL, see \ref oauth_sign_url2
+ */
+char *oauth_signer_sign_url(const OAuthSigner *s, const char *url,
+	char **postargs,
+	const char *http_method);
+
+/**
+ * same as \ref oauth_sign_array2_process with the credentials of a signer.
+ *
+ * @param s signer
+ * @param argcp pointer to array length
+ * @param argvp pointer to array values
+ * @param postargs only used to choose the default of 'http_method'
+ * @param http_method HTTP request method, or NULL for the default
+ */
+void oauth_signer_sign_array_process(const OAuthSigner *s,
+	int *argcp, char ***argvp,
+	char **postargs,
+	const char *http_method);
+
+/**
+ * same as \ref oauth_sign_array2 with the credentials of a signer.
+ *
+ * @param s signer
+ * @param argcp pointer to array length
+ * @param argvp pointer to array values
+ * @param postargs see \ref oauth_sign_array2
+ * @param http_method HTTP request method, or NULL for the default
+ * @return the signed url or base URL, see \ref oauth_sign_array2
+ */
+char *oauth_signer_sign_array(const OAuthSigner *s,
+	int *argcp, char ***argvp,
+	char **postargs,
+	const char *http_method);
+
+/**
+ * same as \ref oauth_sign_params_process with the credentials of a signer.
+ *
+ * @param s signer
+ * @param p parameters of the request, modified
+ * @param url base URL of the request (without query string)
+ * @param postargs only used to choose the default of 'http_method'
+ * @param http_method HTTP request method, or NULL for the default
+ */
+void oauth_signer_sign_params_process(const OAuthSigner *s,
+	OAuthParams *p, const char *url,
+	char **postargs,
+	const char *http_method);
+
+/**
+ * same as \ref oauth_sign_params with the credentials of a signer.
+ *
+ * @param s signer
+ * @param p parameters of the request, modified
+ * @param url base URL of the request (without query string)
+ * @param postargs see \ref oauth_sign_params
+ * @param http_method HTTP request method, or NULL for the default
+ * @return the signed url or base URL, see \ref oauth_sign_params
+ */
+char *oauth_signer_sign_params(const OAuthSigner *s,
+	OAuthParams *p, const char *url,
+	char **postargs,
+	const char *http_method);
+
+/**
+ * memory allocator used by the library for everything it allocates,
+ * including the strings it returns. see \ref oauth_set_allocator
+ */
+typedef struct {
+	void *(*alloc)(void *ctx, size_t size); ///< like malloc(); NULL if out of memory
+	void *(*resize)(void *ctx, void *ptr, size_t size); ///< like realloc()
+	void (*release)(void *ctx, void *ptr); ///< like free(), never called with NULL
+	void *ctx; ///< passed to the functions above
+} OAuthAllocator;
+
+/**
+ * set the allocator of the whole process. By default libc's malloc,
+ * realloc and free are used; the library exits if memory runs out
+ * either way.
+ *
+ * Memory the library returns comes from the allocator in effect at
+ * the time and must be given back to that one, not to free(). The same
+ * holds for arrays passed in to be freed (eg. to \ref oauth_free_array).
+ * Set it before the library is used; it is not synchronized.
+ *
+ * @param a allocator, which must stay valid while in use;
+ * NULL restores libc
+ */
+void oauth_set_allocator(const OAuthAllocator *a);
+
+/**
+ * set an allocator for the calling thread only, overriding the one
+ * of \ref oauth_set_allocator (on PSP it is shared by all threads).
+ *
+ * @param a allocator, NULL to use the process allocator again
+ * @return the thread allocator set before, to restore it when done
+ */
+const OAuthAllocator *oauth_set_thread_allocator(const OAuthAllocator *a);
+
+/**
+ * opaque bump-pointer memory arena.
+ * see \ref oauth_arena_new
+ */
+typedef struct OAuthArena OAuthArena;
+
+/**
+ * create a memory arena. Allocating from it only moves a pointer, and
+ * all its memory is released at once by \ref oauth_arena_reset, so it
+ * suits the many short-lived allocations of a single signing or HTTP
+ * call, eg:
+ * @code
+ * prev = oauth_set_thread_allocator(oauth_arena_allocator(arena));
+ * url = oauth_sign_url2(...);
+ * // ... use url, do not free() it
+ * oauth_set_thread_allocator(prev);
+ * oauth_arena_reset(arena);
+ * @endcode
+ * An arena must only be used by one thread at a time.
+ *
+ * @param block_size size of the blocks memory is carved from,
+ * 0 for the default (16 KiB); larger allocations get a block of their own.
+ * @return arena, free with \ref oauth_arena_free
+ */
+OAuthArena *oauth_arena_new(size_t block_size);
+
+/**
+ * the allocator that allocates from an arena, for
+ * \ref oauth_set_thread_allocator or \ref oauth_set_allocator.
+ *
+ * @param arena arena created with \ref oauth_arena_new
+ * @return allocator, valid as long as the arena
+ */
+const OAuthAllocator *oauth_arena_allocator(OAuthArena *arena);
+
+/**
+ * release all memory allocated from an arena in O(1); its blocks are
+ * kept for reuse.
+ *
+ * @param arena arena to reset
+ */
+void oauth_arena_reset(OAuthArena *arena);
+
+/**
+ * free an arena and all memory allocated from it.
+ *
+ * @param arena arena to free, may be NULL
+ */
+void oauth_arena_free(OAuthArena *arena);
+
 /** 
  * calculate body hash (sha1sum) of given file and return
  * a oauth_body_hash=xxxx parameter to be added to the request.
@@ -500,6 +1353,29 @@ char *oauth_sign_array(int *argcp, char ***argvp,
  */
 char *oauth_body_hash_file(char *filename);
 
+/** 
+ * calculate body hash (sha1sum) of a range of an open file and return
+ * a oauth_body_hash=xxxx parameter to be added to the request.
+ * The returned string needs to be freed by the calling function.
+ *
+ * Large regular files are memory-mapped and hashed in place, everything
+ * else is read in large chunks. The file position of 'fd' is not changed
+ * (except for pipes and other non-seekable descriptors, which are read
+ * from their current position and require 'offset' 0).
+ *
+ * @param fd file descriptor open for reading
+ * @param offset byte offset at which to start hashing
+ * @param length number of bytes to hash (0 hashes nothing, giving the
+ * hash of an empty body), or OAUTH_BODY_HASH_TO_EOF to hash up to the
+ * end of the file
+ *
+ * @return URL oauth_body_hash parameter string or NULL on error
+ */
+char *oauth_body_hash_fd(int fd, off_t offset, size_t length);
+
+/** 'length' of \ref oauth_body_hash_fd: hash up to the end of the file */
+#define OAUTH_BODY_HASH_TO_EOF ((size_t)-1)
+
 /** 
  * calculate body hash (sha1sum) of given data and return
  * a oauth_body_hash=xxxx parameter to be added to the request.
@@ -530,6 +1406,26 @@ char *oauth_body_hash_data(size_t length, const char *data);
  */
 char *oauth_body_hash_encode(size_t len, unsigned char *digest);
 
+/**
+ * same as \ref oauth_body_hash_encode but writes the parameter into the
+ * caller's buffer, snprintf-style, and leaves the digest alone (it is
+ * not freed).
+ *
+ * @param dest buffer receiving the parameter (may be NULL if size is 0)
+ * @param size size of dest in bytes
+ * @param len length of the digest to encode
+ * @param digest hash value to encode
+ * @return length of the complete parameter string, without the
+ * terminating zero
+ */
+size_t oauth_body_hash_encode_into(char *dest, size_t size, size_t len, const unsigned char *digest);
+
+/**
+ * exact length of the oauth_body_hash parameter for a digest of
+ * 'len' bytes, without the terminating zero.
+ */
+size_t oauth_body_hash_encode_len(size_t len);
+
 /**
  * xep-0235 - TODO
  */
@@ -659,6 +1555,34 @@ char *oauth_http_post2(const char *u, const char *p, const char *customheader);
  */
 char *oauth_post_file(const char *u, const char *fn, const size_t len, const char *customheader);
 
+/**
+ * http post raw data from file, signed with an oauth_body_hash.
+ * the returned string needs to be freed by the caller
+ *
+ * unlike calling \ref oauth_body_hash_file before \ref oauth_post_file
+ * the file is read only once: it is mapped where the system supports it,
+ * elsewhere (WIN32, PSP) read into memory up to 4 MB. Only larger files
+ * there are read a second time to be sent, in small blocks. Since the
+ * hash has to be signed into the request header, the header is built by
+ * a callback after hashing and before anything is sent, so a file that
+ * changes before it is sent from the mapping or the second read no longer
+ * matches: the upload is cut short and NULL returned. An empty file is
+ * posted with an empty body.
+ *
+ * see dislaimer: /ref oauth_http_post
+ *
+ * @param u url to retrieve
+ * @param fn filename of the file to post along
+ * @param header called with the "oauth_body_hash=..." parameter string;
+ * returns the custom HTTP header (allocated, freed by the library) or
+ * NULL for the default. Multiple header elements can be separated with "\r\n"
+ * @param data passed to the header callback
+ * @return returned HTTP reply or NULL on error
+ */
+char *oauth_post_file_body_hash(const char *u, const char *fn,
+                                char *(*header)(const char *body_hash, void *data),
+                                void *data);
+
 /**
  * http post raw data
  * the returned string needs to be freed by the caller
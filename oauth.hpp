@@ -0,0 +1,356 @@
+/* oauth.hpp -- thin C++ wrapper around OAuthSigner
+ *
+ * A signer is a template over the signature method, the form the signed
+ * request is written in (query string, POST body or Authorization
+ * header) and how a query string handed to it is decoded. Only the form
+ * is compiled in: each has its own writer, which appends the escaped
+ * parameters straight into std::string buffers the caller can reuse from
+ * one request to the next, without the oauth_serialize_url_sep() modifier
+ * bits and temporary strings of the C entry points.
+ *
+ * The method and the decoding are only constants passed on to the C
+ * library, which picks the digest, sets up the key and splits the query
+ * string at run time, as for any OAuthSigner; normalization, hashing and
+ * escaping are its code too. Like oauth.h this needs nothing but liboauth
+ * to link against.
+ *
+ * @code
+ * oauth::signer<oauth::hmac_sha1, oauth::auth_header> s(c_key, c_secret, t_key, t_secret);
+ * oauth::request r;
+ * s.sign(r, "http://example.com/photos?size=original");
+ * // GET r.url with "Authorization: " + r.authorization
+ * @endcode
+ */
+#ifndef _OAUTH_HPP
+#define _OAUTH_HPP      1
+
+#include <string.h>
+#include <string>
+
+#include "oauth.h"
+
+namespace oauth {
+
+/**
+ * signature methods, the first argument of \ref signer: the OAuthMethod
+ * it hands to \ref oauth_signer_new
+ */
+template <OAuthMethod M> struct method {
+	static const OAuthMethod value = M;
+};
+typedef method<OA_HMAC> hmac_sha1;
+typedef method<OA_HMAC_SHA256> hmac_sha256;
+typedef method<OA_RSA> rsa_sha1;
+typedef method<OA_PLAINTEXT> plaintext;
+
+/**
+ * decoding of a query string given to \ref signer::sign: the 'qesc'
+ * passed on to \ref oauth_split_post_paramters. Both decode %XX escapes.
+ *
+ * form_escaping: '+' is a space, as in application/x-www-form-urlencoded.
+ * How \ref oauth_sign_url2 decodes the URL without postargs.
+ *
+ * rfc3986_escaping: '+' is a literal plus (RFC 3986). How
+ * \ref oauth_sign_url2 decodes the URL when it returns postargs.
+ */
+struct form_escaping {
+	static const short qesc = 1; ///< '+' decodes to ' '
+};
+struct rfc3986_escaping {
+	static const short qesc = 0; ///< '+' stays '+'
+};
+
+/** a signed request, the strings a form does not use are left empty */
+struct request {
+	std::string url; ///< URL to request
+	std::string body; ///< POST body (\ref post_body)
+	std::string authorization; ///< value of the Authorization header (\ref auth_header)
+};
+
+namespace detail {
+
+enum { all_params, oauth_params, other_params };
+
+/*
+ * the parameters the writers take, either from an OAuthParams list or
+ * from argv[1..argc) of oauth_split_post_paramters, which is signed in
+ * place. get() sets 'value' NULL for a parameter without '='.
+ */
+struct params_view {
+	const OAuthParams &p;
+
+	explicit params_view(const OAuthParams &list) : p(list) {}
+	int count() const { return p.count; }
+	const char *str(int i) const { return OAUTH_PARAM_STR(&p, i); }
+	size_t len(int i) const { return p.param[i].len; }
+	void get(int i, size_t &nl, const char *&value, size_t &vl) const
+	{
+		nl = p.param[i].name_len;
+		value = OAUTH_PARAM_HAS_VALUE(&p, i) ? OAUTH_PARAM_VALUE(&p, i) : NULL;
+		vl = value ? OAUTH_PARAM_VALUE_LEN(&p, i) : 0;
+	}
+};
+
+struct argv_view {
+	int argc;
+	char **argv;
+
+	argv_view(int n, char **v) : argc(n), argv(v) {}
+	int count() const { return argc > 1 ? argc - 1 : 0; }
+	const char *str(int i) const { return argv[i + 1]; }
+	size_t len(int i) const { return strlen(argv[i + 1]); }
+	void get(int i, size_t &nl, const char *&value, size_t &vl) const
+	{
+		const char *eq = strchr(argv[i + 1], '=');
+
+		nl = eq ? (size_t)(eq - argv[i + 1]) : strlen(argv[i + 1]);
+		value = eq ? eq + 1 : NULL;
+		vl = eq ? strlen(eq + 1) : 0;
+	}
+};
+
+/* whether 's' is written by a form taking 'Select' */
+template <int Select> inline bool selected(const char *s)
+{
+	bool is_oauth;
+
+	if (Select == all_params) return true;
+	is_oauth = (s[0] == 'o' && !strncmp(s, "oauth_", 6)) || (s[0] == 'x' && !strncmp(s, "x_oauth_", 8));
+	return is_oauth == (Select == oauth_params);
+}
+
+/* escape 'n' bytes of 's' to 'd', which has room for 3 * n + 1 */
+inline char *put_escaped(char *d, const char *s, size_t n)
+{
+	return d + oauth_url_escape_into(d, 3 * n + 1, s, n);
+}
+
+/* the base URL with its spaces encoded, as oauth_serialize_url_sep() does */
+inline void append_url(std::string &out, const char *url)
+{
+	const char *sp;
+
+	for (; (sp = strchr(url, ' ')); url = sp + 1) {
+		out.append(url, sp - url);
+		out.append("%20", 3);
+	}
+	out.append(url);
+}
+
+/*
+ * append the parameters 'Select' takes as escape(name)=escape(value),
+ * the value in double quotes if 'Quote', separated by 'sep'. The room
+ * for all of them is made at once and trimmed to what was written.
+ * returns the number of parameters written.
+ */
+template <int Select, bool Quote, class View>
+int append_params(std::string &out, const View &p, const char *sep, size_t seplen)
+{
+	size_t o = out.size(), room = 1, nl, vl;
+	const char *s, *value;
+	char *d;
+	int i, n = 0;
+
+	for (i = 0; i < p.count(); i++) {
+		if (selected<Select>(p.str(i))) room += seplen + 3 * p.len(i) + 2;
+	}
+	out.resize(o + room);
+	d = &out[o];
+
+	for (i = 0; i < p.count(); i++) {
+		s = p.str(i);
+		if (!selected<Select>(s)) continue;
+		if (n++) {
+			memcpy(d, sep, seplen);
+			d += seplen;
+		}
+
+		p.get(i, nl, value, vl);
+		if (!value) {
+			// written unescaped as "name=", see oauth_serialize_url_sep
+			memcpy(d, s, nl);
+			d += nl;
+			*d++ = '=';
+			continue;
+		}
+
+		d = put_escaped(d, s, nl);
+		*d++ = '=';
+		if (Quote) *d++ = '"';
+		d = put_escaped(d, value, vl);
+		if (Quote) *d++ = '"';
+	}
+
+	out.resize(d - &out[0]);
+	return n;
+}
+
+/* owns the array of oauth_split_post_paramters */
+struct split_url {
+	int argc;
+	char **argv;
+
+	split_url(const char *url, short qesc) : argv(NULL)
+	{
+		argc = oauth_split_post_paramters(url, &argv, qesc);
+	}
+	~split_url() { oauth_free_array(&argc, &argv); }
+
+private:
+	split_url(const split_url &);
+	split_url &operator=(const split_url &);
+};
+
+} // namespace detail
+
+/**
+ * output forms, the second argument of \ref signer.
+ *
+ * query_string: everything in the URL, "url?a=1&oauth_...=...".
+ * Same result as \ref oauth_sign_url2 without postargs.
+ */
+struct query_string {
+	typedef form_escaping escaping; ///< default decoding of a URL to sign
+	static const char *http_method() { return "GET"; }
+
+	template <class View>
+	static void write(request &r, const char *url, const View &p)
+	{
+		r.url.clear();
+		detail::append_url(r.url, url);
+		r.url += '?';
+		detail::append_params<detail::all_params, false>(r.url, p, "&", 1);
+		r.body.clear();
+		r.authorization.clear();
+	}
+};
+
+/**
+ * post_body: the URL as given and all parameters in the form encoded
+ * body. Same result as \ref oauth_sign_url2 with postargs.
+ */
+struct post_body {
+	typedef rfc3986_escaping escaping;
+	static const char *http_method() { return "POST"; }
+
+	template <class View>
+	static void write(request &r, const char *url, const View &p)
+	{
+		r.url.assign(url);
+		r.body.clear();
+		detail::append_params<detail::all_params, false>(r.body, p, "&", 1);
+		r.authorization.clear();
+	}
+};
+
+/**
+ * auth_header: the oauth_ parameters in the Authorization header,
+ * "OAuth oauth_...=\"...\", ...", the others in the URL. What
+ * oauth_serialize_url_sep() makes of the signed array with mod 6 and 1,
+ * less the separators it leaves in front of skipped parameters.
+ */
+struct auth_header {
+	typedef form_escaping escaping;
+	static const char *http_method() { return "GET"; }
+
+	template <class View>
+	static void write(request &r, const char *url, const View &p)
+	{
+		r.url.clear();
+		detail::append_url(r.url, url);
+		r.url += '?';
+		if (!detail::append_params<detail::other_params, false>(r.url, p, "&", 1)) {
+			r.url.erase(r.url.size() - 1);
+		}
+		r.body.clear();
+		r.authorization.assign("OAuth ", 6);
+		detail::append_params<detail::oauth_params, true>(r.authorization, p, ", ", 2);
+	}
+};
+
+/**
+ * signs requests with one set of credentials, see \ref oauth_signer_new.
+ * The signing is that of the OAuthSigner it wraps, only the writing of
+ * the result depends on the template arguments.
+ *
+ * @tparam Method signature method, eg. \ref hmac_sha1
+ * @tparam Form output form: \ref query_string, \ref post_body or \ref auth_header
+ * @tparam Escaping decoding of query strings passed to sign():
+ * \ref form_escaping or \ref rfc3986_escaping; by default that of the
+ * C function with the same result
+ *
+ * Like OAuthSigner, a signer is not modified by signing and may be
+ * shared by threads.
+ */
+template <class Method, class Form = query_string, class Escaping = typename Form::escaping>
+class signer {
+public:
+	/**
+	 * @param c_key consumer key
+	 * @param c_secret consumer secret
+	 * @param t_key token key, may be NULL
+	 * @param t_secret token secret
+	 */
+	signer(const char *c_key, const char *c_secret, const char *t_key = NULL, const char *t_secret = NULL)
+		: s_(oauth_signer_new(Method::value, c_key, c_secret, t_key, t_secret))
+	{
+	}
+
+	~signer() { oauth_signer_free(s_); }
+
+	/**
+	 * sign a request given by its parameters.
+	 *
+	 * @param r receives the signed request; its strings are reused
+	 * @param url base URL of the request (without query string)
+	 * @param p parameters of the request, modified as by
+	 * \ref oauth_signer_sign_params_process
+	 * @param http_method HTTP request method, or NULL for the default of the form
+	 */
+	void sign(request &r, const char *url, OAuthParams &p, const char *http_method = NULL) const
+	{
+		oauth_signer_sign_params_process(s_, &p, url, NULL,
+			http_method ? http_method : Form::http_method());
+		Form::write(r, url, detail::params_view(p));
+	}
+
+	/**
+	 * sign a URL with its query string (or a POST body after a '?').
+	 * The parameters are signed in the array they are split into, as by
+	 * \ref oauth_signer_sign_url, and written from there.
+	 *
+	 * @param r receives the signed request; its strings are reused
+	 * @param url the URL to sign
+	 * @param http_method HTTP request method, or NULL for the default of the form
+	 */
+	void sign(request &r, const char *url, const char *http_method = NULL) const
+	{
+		detail::split_url q(url, Escaping::qesc);
+
+		oauth_signer_sign_array_process(s_, &q.argc, &q.argv, NULL,
+			http_method ? http_method : Form::http_method());
+		Form::write(r, q.argv[0], detail::argv_view(q.argc, q.argv));
+	}
+
+	/** same as above, returning the signed request */
+	request sign(const char *url, const char *http_method = NULL) const
+	{
+		request r;
+
+		sign(r, url, http_method);
+		return r;
+	}
+
+	/** the C signer, for the oauth_signer_* functions */
+	const OAuthSigner *get() const { return s_; }
+
+private:
+	signer(const signer &);
+	signer &operator=(const signer &);
+
+	OAuthSigner *s_;
+};
+
+} // namespace oauth
+
+#endif // _OAUTH_HPP
@@ -43,6 +43,7 @@
 #include "xmalloc.h"
 #include "oauth.h"
 #include "new_socket.h"
+#include "hash.h"
 
 
 /**
@@ -64,8 +65,8 @@ char *oauth_http_get(const char *u, const char *q)
 	response = socket_http_get(u, q, NULL, NOT_KEEPALIVE);
 	if (response != NULL) {
 		result = (char *)response->data;
-		free(response->header);
-		free(response);
+		xfree(response->header);
+		xfree(response);
 	}
 	return result;
 }
@@ -88,8 +89,8 @@ char *oauth_http_get2(const char *u, const char *q, const char *customheader)
 	response = socket_http_get(u, q, customheader, NOT_KEEPALIVE);
 	if (response != NULL) {
 		result = (char *)response->data;
-		free(response->header);
-		free(response);
+		xfree(response->header);
+		xfree(response);
 	}
 	return result;
 }
@@ -113,8 +114,8 @@ char *oauth_http_post(const char *u, const char *p)
 	response = socket_http_post(u, p, strlen(p), NULL, NOT_KEEPALIVE);
 	if (response != NULL) {
 		result = (char *)response->data;
-		free(response->header);
-		free(response);
+		xfree(response->header);
+		xfree(response);
 	}
 	return result;
 }
@@ -139,8 +140,8 @@ char *oauth_http_post2(const char *u, const char *p, const char *customheader)
 	response = socket_http_post(u, p, strlen(p), customheader, KEEPALIVE);
 	if (response != NULL) {
 		result = (char *)response->data;
-		free(response->header);
-		free(response);
+		xfree(response->header);
+		xfree(response);
 	}
 	return result;
 }
@@ -164,8 +165,61 @@ char *oauth_post_file(const char *u, const char *fn, const size_t len, const cha
 	response = socket_http_post_file(u, fn, len, customheader, KEEPALIVE);
 	if (response != NULL) {
 		result = (char *)response->data;
-		free(response->header);
-		free(response);
+		xfree(response->header);
+		xfree(response);
+	}
+	return result;
+}
+
+typedef struct {
+	char *(*header)(const char *body_hash, void *data);
+	void *data;
+	SHA1Context_t sha1;
+} oauth_post_file_ctx;
+
+static char *oauth_post_file_header(const unsigned char *body, size_t size, void *user)
+{
+	oauth_post_file_ctx *ctx = (oauth_post_file_ctx *)user;
+	unsigned char digest[20];
+	char body_hash[64];
+
+	if (body) {
+		SHA1Input(&ctx->sha1, body, size);
+		return NULL;
+	}
+
+	SHA1Result(&ctx->sha1, digest);
+	oauth_body_hash_encode_into(body_hash, sizeof(body_hash), 20, digest);
+	return ctx->header(body_hash, ctx->data);
+}
+
+/**
+ * http post raw data from file, with the oauth_body_hash computed
+ * as the file is read for sending.
+ * the returned string needs to be freed by the caller
+ *
+ * more documentation in oauth.h
+ *
+ * @param u url to retrieve
+ * @param fn filename of the file to post along
+ * @param header callback returning the custom header for the body hash
+ * @param data passed to the callback
+ * @return returned HTTP reply or NULL on error
+ */
+char *oauth_post_file_body_hash(const char *u, const char *fn, char *(*header)(const char *body_hash, void *data), void *data)
+{
+	char *result = NULL;
+	HTTPResponse *response = NULL;
+	oauth_post_file_ctx ctx;
+
+	ctx.header = header;
+	ctx.data = data;
+	SHA1Reset(&ctx.sha1);
+	response = socket_http_post_file2(u, fn, oauth_post_file_header, &ctx, KEEPALIVE);
+	if (response != NULL) {
+		result = (char *)response->data;
+		xfree(response->header);
+		xfree(response);
 	}
 	return result;
 }
@@ -0,0 +1,326 @@
+/* oauth_norm.c -- escape-once parameter normalization, sort and base string
+ *
+ * The parameters are escaped a single time up front (instead of twice per
+ * comparison inside qsort) and sorted by a multikey quicksort (Bentley and
+ * Sedgewick): it partitions on one byte of the key at a time, so the long
+ * common prefixes of bulk parameters ("id=1001", "id=1002", ...) are
+ * looked at once per level rather than once per comparison.
+ *
+ * A first pass only counts (how many bytes of each name and value need
+ * escaping); that fixes the exact size of everything, which is then
+ * carved out of one allocation and filled in by a second pass.
+ *
+ * The base string can also be streamed into an HMAC instead of being
+ * built (oauth_hmac_feed), which is how requests are signed and verified.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "xmalloc.h"
+#include "escape.h"
+#include "oauth_norm.h"
+
+#define NORM_INSERTION 12	///< below this many keys, sort by insertion
+
+/* byte 'd' of a key, -1 past its end */
+static __inline int norm_char(const char *buf, const oauth_norm_param *p, size_t d)
+{
+	return d < p->key_len ? (unsigned char)buf[p->off + d] : -1;
+}
+
+/* compare two keys known to agree on their first 'd' bytes */
+static __inline int norm_cmp(const char *buf, const oauth_norm_param *a, const oauth_norm_param *b, size_t d)
+{
+	size_t la = a->key_len - d, lb = b->key_len - d;
+	int rv = memcmp(buf + a->off + d, buf + b->off + d, la < lb ? la : lb);
+
+	if (rv) return rv;
+	return la < lb ? -1 : la > lb;
+}
+
+static __inline void norm_swap(oauth_norm_param *a, oauth_norm_param *b)
+{
+	oauth_norm_param t = *a;
+	*a = *b;
+	*b = t;
+}
+
+static void norm_insertion(const char *buf, oauth_norm_param *a, int n, size_t d)
+{
+	oauth_norm_param t;
+	int i, j;
+
+	for (i = 1; i < n; i++) {
+		t = a[i];
+		for (j = i; j > 0 && norm_cmp(buf, &a[j - 1], &t, d) > 0; j--) {
+			a[j] = a[j - 1];
+		}
+		a[j] = t;
+	}
+}
+
+static void norm_mkqsort(const char *buf, oauth_norm_param *a, int n, size_t d)
+{
+	int lt, gt, i, c, v, x, y, z;
+
+	while (n > NORM_INSERTION) {
+		// median of three for the pivot byte
+		x = norm_char(buf, &a[0], d);
+		y = norm_char(buf, &a[n / 2], d);
+		z = norm_char(buf, &a[n - 1], d);
+		v = x < y ? (y < z ? y : (x < z ? z : x)) : (x < z ? x : (y < z ? z : y));
+
+		// three way partition: [0, lt) < v, [lt, gt] == v, (gt, n) > v
+		lt = 0;
+		gt = n - 1;
+		i = 0;
+		while (i <= gt) {
+			c = norm_char(buf, &a[i], d);
+			if (c < v) {
+				norm_swap(&a[lt++], &a[i++]);
+			} else if (c > v) {
+				norm_swap(&a[i], &a[gt--]);
+			} else {
+				i++;
+			}
+		}
+
+		norm_mkqsort(buf, a, lt, d);
+		norm_mkqsort(buf, a + gt + 1, n - gt - 1, d);
+
+		// equal byte: go one deeper, unless all of these keys ended here
+		if (v < 0) return;
+		a += lt;
+		n = gt - lt + 1;
+		d++;
+	}
+
+	norm_insertion(buf, a, n, d);
+}
+
+void oauth_norm_sort(oauth_norm *n)
+{
+	norm_mkqsort(n->buf, n->param, n->count, 0);
+}
+
+size_t oauth_norm_key(oauth_norm *n, oauth_norm_param *p, size_t o,
+	const char *name, size_t nl, const char *value, size_t vl)
+{
+	p->has_value = value != NULL;
+	p->off = o;
+	p->name_len = oauth_escape_raw(n->buf + o, name, nl);
+	o += p->name_len;
+	n->buf[o++] = value ? '\1' : '\0';
+	if (value) o += oauth_escape_raw(n->buf + o, value, vl);
+	p->key_len = o - p->off;
+	return o;
+}
+
+/* append 'n' already escaped bytes escaped once more: '%' becomes "%25" */
+static char *base_reescape(char *p, const char *s, size_t n)
+{
+	const char *end = s + n, *pct;
+	size_t run;
+
+	while (s < end) {
+		pct = (const char *)memchr(s, '%', end - s);
+		run = (pct ? pct : end) - s;
+		memcpy(p, s, run);
+		p += run;
+		if (!pct) break;
+		memcpy(p, "%25", 3);
+		p += 3;
+		s = pct + 1;
+	}
+
+	return p;
+}
+
+void oauth_base_build(oauth_base *b, const char *http_method, int argc, char **argv, int want_string)
+{
+	oauth_norm *n = &b->norm;
+	oauth_norm_param *p;
+	const char *url = (argc > 0 && argv[0]) ? argv[0] : "";
+	const char *eq;
+	size_t keys = 0, base = 0, nl, vl, un, uv, o;
+	size_t ml = strlen(http_method), ul = strlen(url);
+	char *mem, *q;
+	int i;
+
+	n->count = argc > 1 ? argc - 1 : 0;
+	argv++;
+
+	// pass 1: count only, for the exact sizes
+	for (i = 0; i < n->count; i++) {
+		eq = strchr(argv[i], '=');
+		nl = eq ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+		vl = eq ? strlen(eq + 1) : 0;
+		un = oauth_escape_count(argv[i], nl);
+		uv = eq ? oauth_escape_count(eq + 1, vl) : 0;
+
+		keys += nl + 2 * un + 1 + vl + 2 * uv;
+		if (eq) {
+			base += nl + 4 * un + 3 + vl + 4 * uv;	// escape(escape(name)) %3D escape(escape(value))
+		} else {
+			base += nl + 2 * un + 3;				// escape(name) %3D
+		}
+	}
+	if (n->count > 1) base += 3 * (n->count - 1);	// %26 between parameters
+	base += ml + 2 * oauth_escape_count(http_method, ml) + 1
+		+ ul + 2 * oauth_escape_count(url, ul) + 1;
+
+	b->arena_size = n->count * (sizeof(oauth_norm_param) + sizeof(char *)) + keys
+		+ (want_string ? base + 1 : 0);
+	b->arena = mem = (char *)xmalloc(b->arena_size ? b->arena_size : 1);
+
+	n->param = (oauth_norm_param *)mem;
+	mem += n->count * sizeof(oauth_norm_param);
+	b->sorted = (char **)mem;
+	mem += n->count * sizeof(char *);
+	n->buf = mem;
+	mem += keys;
+
+	// pass 2: escape the keys into place
+	for (i = 0, o = 0; i < n->count; i++) {
+		p = &n->param[i];
+		eq = strchr(argv[i], '=');
+		nl = eq ? (size_t)(eq - argv[i]) : strlen(argv[i]);
+
+		p->index = i;
+		o = oauth_norm_key(n, p, o, argv[i], nl, eq ? eq + 1 : NULL, eq ? strlen(eq + 1) : 0);
+	}
+
+	oauth_norm_sort(n);
+	for (i = 0; i < n->count; i++) {
+		b->sorted[i] = argv[n->param[i].index];
+	}
+
+	if (!want_string) {
+		b->base = NULL;
+		b->base_len = 0;
+		return;
+	}
+
+	q = b->base = mem;
+	q += oauth_escape_raw(q, http_method, ml);
+	*q++ = '&';
+	q += oauth_escape_raw(q, url, ul);
+	*q++ = '&';
+
+	for (i = 0; i < n->count; i++) {
+		p = &n->param[i];
+		if (i > 0) {
+			memcpy(q, "%26", 3);
+			q += 3;
+		}
+
+		if (p->has_value) {
+			q = base_reescape(q, n->buf + p->off, p->name_len);
+			memcpy(q, "%3D", 3);
+			q = base_reescape(q + 3, OAUTH_NORM_VALUE(n, p), OAUTH_NORM_VALUE_LEN(p));
+		} else {
+			// serialized unescaped as "name=" (see oauth_serialize_url_sep)
+			memcpy(q, n->buf + p->off, p->name_len);
+			memcpy(q + p->name_len, "%3D", 3);
+			q += p->name_len + 3;
+		}
+	}
+
+	*q = '\0';
+	b->base_len = q - b->base;
+}
+
+void oauth_base_free(oauth_base *b)
+{
+#ifdef WIPE_MEMORY
+	memset(b->arena, 0, b->arena_size);
+#endif
+	xfree(b->arena);
+	b->arena = NULL;
+	b->base = NULL;
+	b->sorted = NULL;
+	b->norm.param = NULL;
+	b->norm.buf = NULL;
+	b->norm.count = 0;
+}
+
+void oauth_feed_flush(oauth_hmac_feed *f)
+{
+#ifdef DEBUG_OAUTH
+	fwrite(f->buf, 1, f->len, stderr);
+#endif
+	oauth_hmac_update(&f->hmac, f->buf, f->len);
+	f->len = 0;
+}
+
+void oauth_feed_raw(oauth_hmac_feed *f, const char *s, size_t n)
+{
+	if (f->len + n > OAUTH_FEED_SIZE) {
+		oauth_feed_flush(f);
+		if (n > OAUTH_FEED_SIZE) {
+			oauth_hmac_update(&f->hmac, s, n);
+			return;
+		}
+	}
+	memcpy(f->buf + f->len, s, n);
+	f->len += n;
+}
+
+void oauth_feed_reescaped(oauth_hmac_feed *f, const char *s, size_t n)
+{
+	const char *end = s + n, *pct;
+
+	while (s < end) {
+		pct = (const char *)memchr(s, '%', end - s);
+		oauth_feed_raw(f, s, (pct ? pct : end) - s);
+		if (!pct) break;
+		oauth_feed_raw(f, "%25", 3);
+		s = pct + 1;
+	}
+}
+
+void oauth_feed_escaped(oauth_hmac_feed *f, const char *s, size_t n)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	unsigned char in;
+	char *p;
+
+	while (n--) {
+		if (f->len + 3 > OAUTH_FEED_SIZE) oauth_feed_flush(f);
+		p = f->buf + f->len;
+		in = (unsigned char)*s++;
+
+		if (oauth_escape_safe[in]) {
+			*p = in;
+			f->len++;
+		} else {
+			p[0] = '%';
+			p[1] = hex[in >> 4];
+			p[2] = hex[in & 15];
+			f->len += 3;
+		}
+	}
+}
+
+void oauth_feed_params(oauth_hmac_feed *f, const oauth_norm *n)
+{
+	const oauth_norm_param *p;
+	int i;
+
+	for (i = 0; i < n->count; i++) {
+		p = &n->param[i];
+		if (i > 0) oauth_feed_raw(f, "%26", 3);
+
+		if (p->has_value) {
+			oauth_feed_reescaped(f, n->buf + p->off, p->name_len);
+			oauth_feed_raw(f, "%3D", 3);
+			oauth_feed_reescaped(f, OAUTH_NORM_VALUE(n, p), OAUTH_NORM_VALUE_LEN(p));
+		} else {
+			// serialized unescaped as "name=" (see oauth_serialize_url_sep)
+			oauth_feed_raw(f, n->buf + p->off, p->name_len);
+			oauth_feed_raw(f, "%3D", 3);
+		}
+	}
+}
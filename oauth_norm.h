@@ -0,0 +1,128 @@
+#ifndef _OAUTH_NORM_H
+#define _OAUTH_NORM_H      1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "hash.h"
+
+/*
+ * internal: request parameter normalization (http://oauth.net/core/1.0/#anchor14).
+ *
+ * Every "name[=value]" is RFC3986 escaped once into one shared buffer as
+ * its sort key:
+ *
+ *   escaped name, '\0'                       for a parameter without '='
+ *   escaped name, '\1', escaped value        otherwise
+ *
+ * Escaped chars are all >= '%', so plain byte order on these keys is the
+ * order oauth_cmpstringp() defines: by name, valueless first, then by value.
+ */
+typedef struct {
+	size_t off;			///< start of the key in oauth_norm.buf
+	size_t name_len;	///< escaped name, at buf + off
+	size_t key_len;		///< whole key; the escaped value is the rest after the separator
+	int has_value;
+	int index;			///< position in the argv it came from
+} oauth_norm_param;
+
+typedef struct {
+	oauth_norm_param *param;
+	int count;
+	char *buf;
+} oauth_norm;
+
+/* escaped value of a parameter (empty unless has_value) */
+#define OAUTH_NORM_VALUE(n, p) ((n)->buf + (p)->off + (p)->name_len + 1)
+#define OAUTH_NORM_VALUE_LEN(p) ((p)->key_len - (p)->name_len - 1)
+
+/*
+ * escape name[=value] ('value' NULL for a parameter without '=') into
+ * n->buf at offset 'o' as the key of 'p', which needs room for three
+ * times nl + vl plus one. returns the offset after the key.
+ */
+size_t oauth_norm_key(oauth_norm *n, oauth_norm_param *p, size_t o,
+	const char *name, size_t nl, const char *value, size_t vl);
+
+/* sort n->param by their keys */
+void oauth_norm_sort(oauth_norm *n);
+
+/*
+ * everything needed to sign one request, in a single allocation:
+ * the normalized parameters, argv[1..] in that order, and optionally the
+ * signature base string
+ *
+ *   escape(method) & escape(url) & escape(p1 & p2 & ...)
+ *
+ * where each pi is "escape(name)=escape(value)" (so escaped twice in the
+ * end) or, for a parameter without '=', "name=" (escaped once).
+ *
+ * With n parameters whose argv strings are L bytes long in total, the
+ * arena is never larger than
+ *
+ *   n * (sizeof(oauth_norm_param) + sizeof(char *) + 7)
+ *     + 3 * (strlen(method) + strlen(url)) + 8 * L + 3
+ *
+ * bytes (every byte escaped to at most 3 chars in its key and 5 in the
+ * base string); it is sized exactly, so usually much less.
+ */
+typedef struct {
+	oauth_norm norm;
+	char **sorted;		///< the n parameters of argv in normalized order
+	char *base;			///< zero-terminated base string, NULL unless requested
+	size_t base_len;
+	void *arena;
+	size_t arena_size;
+} oauth_base;
+
+#define OAUTH_BASE_ARENA_MAX(n, method_len, url_len, params_len) \
+	((n) * (sizeof(oauth_norm_param) + sizeof(char *) + 7) \
+	 + 3 * ((method_len) + (url_len)) + 8 * (params_len) + 3)
+
+/*
+ * normalize and sort argv[1..argc), argv[0] being the base URL, and
+ * with 'want_string' set build the base string for 'http_method' as well.
+ */
+void oauth_base_build(oauth_base *b, const char *http_method, int argc, char **argv, int want_string);
+
+void oauth_base_free(oauth_base *b);
+
+#define OAUTH_FEED_SIZE 256 ///< escaped bytes collected before each oauth_hmac_update
+
+/*
+ * the base string streamed into an HMAC instead of built: a small output
+ * buffer between the serializer and the HMAC, so escaping one byte at a
+ * time does not turn into one update per byte.
+ */
+typedef struct {
+	OAuthHmacCtx hmac;
+	size_t len;
+	char buf[OAUTH_FEED_SIZE];
+} oauth_hmac_feed;
+
+/* pass the buffered bytes on to the HMAC */
+void oauth_feed_flush(oauth_hmac_feed *f);
+
+/* feed 'n' bytes of 's' as they are */
+void oauth_feed_raw(oauth_hmac_feed *f, const char *s, size_t n);
+
+/* feed 'n' bytes of 's' RFC3986 escaped, as oauth_url_escape would */
+void oauth_feed_escaped(oauth_hmac_feed *f, const char *s, size_t n);
+
+/*
+ * feed 'n' bytes of an already escaped 's' escaped once more: as only
+ * '%' is not unreserved there, that is every '%' becoming "%25".
+ */
+void oauth_feed_reescaped(oauth_hmac_feed *f, const char *s, size_t n);
+
+/* feed the sorted parameters of 'n', the last part of the base string */
+void oauth_feed_params(oauth_hmac_feed *f, const oauth_norm *n);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _OAUTH_NORM_H
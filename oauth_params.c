@@ -0,0 +1,320 @@
+/* oauth_params.c -- request parameters in one growing buffer
+ *
+ * The text of all parameters ("name=value\0" each) is appended to a
+ * single buffer and found through (offset, name length, length) records,
+ * both arrays growing geometrically. Offsets survive the buffer moving,
+ * so nothing is rewritten when it grows, and sorting the list only moves
+ * the records. Replacing a value appends the new text and leaves the old
+ * one unused in the buffer.
+ *
+ * Lookups by name go through a hash index of the names (open addressing
+ * with linear probing, kept at most half full), built the first time a
+ * list of PARAMS_INDEX_MIN or more is searched and then extended by every
+ * add. A name has one slot however often it repeats, holding the first
+ * record of the name and the first one with a value, so lists of many
+ * "id=..." do not pile up on one probe run. Slots hold record numbers, not
+ * pointers, so the buffer can move under the index; reordering or
+ * removing records drops it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "oauth.h"
+#include "xmalloc.h"
+
+#define PARAMS_MIN_COUNT 16		///< first allocation of records
+#define PARAMS_MIN_BYTES 256	///< first allocation of text
+#define PARAMS_INDEX_MIN 8		///< shorter lists are searched by a plain scan
+
+typedef struct {
+	unsigned int hash;
+	int first;			///< first record of the name + 1, 0 for an empty slot
+	int valued;			///< first record of the name with a value + 1, or 0
+} params_slot;
+
+struct OAuthParamsIndex {
+	size_t mask;		///< number of slots - 1
+	int count;			///< names in the index
+	params_slot slot[1];
+};
+
+/* FNV-1a */
+static unsigned int params_hash(const char *s, size_t n)
+{
+	unsigned int h = 2166136261U;
+
+	while (n--) {
+		h = (h ^ (unsigned char)*s++) * 16777619U;
+	}
+	return h;
+}
+
+/* an empty index with room for 'n' names */
+static struct OAuthParamsIndex *index_new(int n)
+{
+	struct OAuthParamsIndex *ix;
+	size_t size = 16;
+
+	while (size < 2 * (size_t)n) size *= 2;
+	ix = (struct OAuthParamsIndex *)xcalloc(1, sizeof(*ix) + (size - 1) * sizeof(params_slot));
+	ix->mask = size - 1;
+	return ix;
+}
+
+/* the slot of 'name', or the empty one it would go to */
+static params_slot *index_slot(const OAuthParams *p, struct OAuthParamsIndex *ix,
+	unsigned int hash, const char *name, size_t name_len)
+{
+	size_t s = hash & ix->mask;
+	const OAuthParam *r;
+
+	for (; ix->slot[s].first; s = (s + 1) & ix->mask) {
+		r = &p->param[ix->slot[s].first - 1];
+		if (ix->slot[s].hash == hash && r->name_len == name_len
+			&& !memcmp(p->buf + r->off, name, name_len))
+		{
+			break;
+		}
+	}
+	return &ix->slot[s];
+}
+
+/* enter record i; records go in in list order, so the first of a name stays */
+static void index_put(OAuthParams *p, int i)
+{
+	struct OAuthParamsIndex *ix = p->index, *nx;
+	params_slot *sl;
+	unsigned int h = params_hash(OAUTH_PARAM_STR(p, i), p->param[i].name_len);
+	size_t s;
+
+	if (2 * (size_t)(ix->count + 1) > ix->mask + 1) {
+		nx = index_new(2 * (ix->count + 1));
+		for (s = 0; s <= ix->mask; s++) {
+			if (!ix->slot[s].first) continue;
+			sl = &nx->slot[ix->slot[s].hash & nx->mask];
+			while (sl->first) {
+				sl = &nx->slot[(sl - nx->slot + 1) & nx->mask];
+			}
+			*sl = ix->slot[s];
+		}
+		nx->count = ix->count;
+		xfree(ix);
+		p->index = ix = nx;
+	}
+
+	sl = index_slot(p, ix, h, OAUTH_PARAM_STR(p, i), p->param[i].name_len);
+	if (!sl->first) {
+		sl->hash = h;
+		sl->first = i + 1;
+		ix->count++;
+	}
+	if (!sl->valued && OAUTH_PARAM_HAS_VALUE(p, i)) {
+		sl->valued = i + 1;
+	}
+}
+
+/* first record called 'name' (with a value if 'with_value'), -1 if none */
+static int params_lookup(OAuthParams *p, const char *name, size_t name_len, int with_value)
+{
+	params_slot *sl;
+	int i;
+
+	if (!p->index) {
+		if (p->count < PARAMS_INDEX_MIN) {
+			for (i = 0; i < p->count; i++) {
+				if (p->param[i].name_len == name_len && !memcmp(OAUTH_PARAM_STR(p, i), name, name_len)
+					&& (!with_value || OAUTH_PARAM_HAS_VALUE(p, i)))
+				{
+					return i;
+				}
+			}
+			return -1;
+		}
+
+		p->index = index_new(p->count);
+		for (i = 0; i < p->count; i++) {
+			index_put(p, i);
+		}
+	}
+
+	sl = index_slot(p, p->index, params_hash(name, name_len), name, name_len);
+	return (with_value ? sl->valued : sl->first) - 1;
+}
+
+void oauth_params_init(OAuthParams *p)
+{
+	memset(p, 0, sizeof(*p));
+}
+
+void oauth_params_reserve(OAuthParams *p, int count, size_t bytes)
+{
+	size_t need, size;
+	int n;
+
+	if (p->count + count > p->alloc) {
+		n = p->alloc ? p->alloc : PARAMS_MIN_COUNT;
+		while (n < p->count + count) n *= 2;
+		p->param = (OAuthParam *)xrealloc(p->param, sizeof(OAuthParam) * n);
+		p->alloc = n;
+	}
+
+	need = p->used + bytes + count;	// one terminator each
+	if (need > p->size) {
+		size = p->size ? p->size : PARAMS_MIN_BYTES;
+		while (size < need) size *= 2;
+		p->buf = (char *)xrealloc(p->buf, size);
+		p->size = size;
+	}
+}
+
+/* append the text of a parameter to the buffer and point 'r' at it */
+static void params_write(OAuthParams *p, OAuthParam *r, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+	char *s = p->buf + p->used;
+
+	r->off = p->used;
+	r->name_len = name_len;
+	r->len = name_len;
+
+	memmove(s, name, name_len);
+	if (value) {
+		s[name_len] = '=';
+		memcpy(s + name_len + 1, value, value_len);
+		r->len += 1 + value_len;
+	}
+	s[r->len] = '\0';
+	p->used += r->len + 1;
+}
+
+void oauth_params_add(OAuthParams *p, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+	oauth_params_reserve(p, 1, name_len + (value ? 1 + value_len : 0));
+	params_write(p, &p->param[p->count++], name, name_len, value, value_len);
+	if (p->index) index_put(p, p->count - 1);
+}
+
+void oauth_params_set_value(OAuthParams *p, int i, const char *value, size_t value_len)
+{
+	OAuthParam *r = &p->param[i];
+	params_slot *sl;
+	size_t off;
+
+	// the name is copied from the old text, which may move as the buffer grows
+	oauth_params_reserve(p, 0, r->name_len + 1 + value_len + 1);
+	off = r->off;
+	params_write(p, r, p->buf + off, r->name_len, value, value_len);
+
+	// a parameter that had no value may now be the first one with one
+	if (p->index) {
+		sl = index_slot(p, p->index, params_hash(p->buf + r->off, r->name_len), p->buf + r->off, r->name_len);
+		if (!sl->valued || sl->valued > i + 1) sl->valued = i + 1;
+	}
+}
+
+int oauth_params_set(OAuthParams *p, const char *name, size_t name_len, const char *value, size_t value_len)
+{
+	int i = params_lookup(p, name, name_len, 0);
+
+	if (i >= 0) {
+		oauth_params_set_value(p, i, value, value_len);
+		return i;
+	}
+
+	oauth_params_add(p, name, name_len, value, value_len);
+	return p->count - 1;
+}
+
+int oauth_params_dedup(OAuthParams *p)
+{
+	int i, n = 0, removed;
+
+	// index the records kept so far, as they are moved down
+	oauth_params_reindex(p);
+	p->index = index_new(p->count);
+	for (i = 0; i < p->count; i++) {
+		if (params_lookup(p, OAUTH_PARAM_STR(p, i), p->param[i].name_len, 0) < 0) {
+			p->param[n] = p->param[i];
+			index_put(p, n++);
+		}
+	}
+
+	removed = p->count - n;
+	p->count = n;
+	return removed;
+}
+
+void oauth_params_reindex(OAuthParams *p)
+{
+	xfree(p->index);
+	p->index = NULL;
+}
+
+void oauth_params_add_param(OAuthParams *p, const char *param)
+{
+	const char *eq = strchr(param, '=');
+
+	if (eq) {
+		oauth_params_add(p, param, eq - param, eq + 1, strlen(eq + 1));
+	} else {
+		oauth_params_add(p, param, strlen(param), NULL, 0);
+	}
+}
+
+int oauth_params_find(OAuthParams *p, const char *name)
+{
+	return params_lookup(p, name, strlen(name), 1);
+}
+
+void oauth_params_add_array(OAuthParams *p, int argc, char **argv)
+{
+	size_t bytes = 0;
+	int i;
+
+	for (i = 0; i < argc; i++) {
+		bytes += strlen(argv[i]);
+	}
+	oauth_params_reserve(p, argc, bytes);
+
+	for (i = 0; i < argc; i++) {
+		oauth_params_add_param(p, argv[i]);
+	}
+}
+
+int oauth_params_to_array(const OAuthParams *p, const char *url, char ***argvp)
+{
+	int argc = 0, i;
+
+	*argvp = (char **)xmalloc(sizeof(char *) * (p->count + 1));
+	if (url) {
+		(*argvp)[argc++] = xstrdup(url);
+	}
+	for (i = 0; i < p->count; i++) {
+		(*argvp)[argc++] = xstrdup(OAUTH_PARAM_STR(p, i));
+	}
+
+	return argc;
+}
+
+char **oauth_params_argv(OAuthParams *p, const char *url)
+{
+	int i;
+
+	p->argv = (char **)xrealloc(p->argv, sizeof(char *) * (p->count + 2));
+	p->argv[0] = (char *)url;
+	for (i = 0; i < p->count; i++) {
+		p->argv[i + 1] = OAUTH_PARAM_STR(p, i);
+	}
+	p->argv[p->count + 1] = NULL;
+
+	return p->argv;
+}
+
+void oauth_params_free(OAuthParams *p)
+{
+	xfree(p->param);
+	xfree(p->buf);
+	xfree(p->argv);
+	xfree(p->index);
+	memset(p, 0, sizeof(*p));
+}
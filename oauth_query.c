@@ -0,0 +1,111 @@
+/* oauth_query.c -- reentrant tokenizer for query strings and form bodies
+ *
+ * Parameters are handed out as spans of the caller's string: nothing is
+ * copied, terminated or decoded while splitting, so the same string can
+ * be walked by any number of threads at once. Each parameter is found by
+ * one forward scan, 16 bytes at a time with SSE2, for the next separator
+ * ('&' or '?') and, until the first one is seen, '='. Decoding is left to
+ * oauth_query_decode() for the parameters a caller actually wants.
+ */
+
+#include <string.h>
+
+#include "oauth.h"
+#include "escape.h"
+#include "cpu.h"
+
+#if defined(OAUTH_X86) && defined(__SSE2__)
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(OAUTH_X86) && defined(__SSE2__)
+static __inline unsigned int query_ctz(unsigned int m)
+{
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward(&i, m);
+	return i;
+#else
+	return __builtin_ctz(m);
+#endif
+}
+#endif
+
+/* first '&' or '?' (or '=' if 'eq' is set) in [s, end), or end */
+static const char *query_find(const char *s, const char *end, int eq)
+{
+#if defined(OAUTH_X86) && defined(__SSE2__)
+	const __m128i amp = _mm_set1_epi8('&');
+	const __m128i qm = _mm_set1_epi8('?');
+	const __m128i eqs = _mm_set1_epi8(eq ? '=' : '&');	// without 'eq', '&' twice
+	__m128i v;
+	unsigned int m;
+
+	for (; end - s >= 16; s += 16) {
+		v = _mm_loadu_si128((const __m128i *)s);
+		m = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(
+			_mm_cmpeq_epi8(v, amp), _mm_cmpeq_epi8(v, qm)), _mm_cmpeq_epi8(v, eqs)));
+		if (m) return s + query_ctz(m);
+	}
+#endif
+
+	for (; s < end; s++) {
+		if (*s == '&' || *s == '?' || (eq && *s == '=')) break;
+	}
+	return s;
+}
+
+void oauth_query_init(OAuthQuery *q, const char *s, size_t len)
+{
+	q->pos = s;
+	q->end = s + len;
+}
+
+int oauth_query_next(OAuthQuery *q, OAuthQueryParam *p)
+{
+	const char *s = q->pos, *end = q->end, *c;
+
+	// empty parameters ("a&&b", the '?' in front of a query) are skipped
+	while (s < end && (*s == '&' || *s == '?')) s++;
+	if (s == end) {
+		q->pos = s;
+		return 0;
+	}
+
+	c = query_find(s, end, 1);
+	p->name = s;
+	p->name_len = c - s;
+	p->value = NULL;
+	p->value_len = 0;
+
+	if (c < end && *c == '=') {
+		p->value = c + 1;
+		c = query_find(c + 1, end, 0);
+		p->value_len = c - p->value;
+	}
+
+	p->len = c - s;
+	q->pos = c;
+	return 1;
+}
+
+size_t oauth_query_decode(char *dst, const char *src, size_t len, int flags)
+{
+	char *c, *end = dst + len;
+
+	if (dst != src) memcpy(dst, src, len);
+
+	// the aliases are replaced before %XX decoding, so "%2B" stays a '+'
+	if (flags & OAUTH_QUERY_PLUS) {
+		for (c = dst; (c = (char *)memchr(c, '+', end - c)); *c++ = ' ');
+	}
+	if (flags & OAUTH_QUERY_SOH) {
+		for (c = dst; (c = (char *)memchr(c, '\001', end - c)); *c++ = '&');
+	}
+
+	if (flags & OAUTH_QUERY_RAW) return len;
+	return oauth_unescape_raw(dst, dst, len);
+}
@@ -0,0 +1,284 @@
+/* oauth_rand.c -- per-thread ChaCha20 random generator
+ *
+ * Each thread owns a ChaCha20 key. A refill encrypts a few blocks of
+ * keystream into a batch buffer; the first 32 bytes become the next key
+ * (fast key erasure, so earlier output can not be recovered from the
+ * state) and the rest is handed out to callers until it is used up.
+ *
+ * The key is seeded from the operating system on first use and again
+ * in a child after fork().
+ *
+ * PSP: there is no thread local storage, so one state is shared by all
+ * threads and updated with interrupts suspended (which also keeps the
+ * scheduler out). User mode has no entropy source either; the seed is
+ * gathered from the jitter of the microsecond clock, which is better
+ * than the time alone but no match for an OS generator.
+ */
+
+#ifdef WIN32
+#define _CRT_RAND_S
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#if defined(PSP)
+	#include <psputils.h>
+	#include <pspkernel.h>
+#elif !defined(WIN32)
+	#include <unistd.h>
+	#include <fcntl.h>
+	#include <errno.h>
+	#include <pthread.h>
+	#ifdef __linux__
+		#include <sys/syscall.h>
+	#endif
+#endif
+
+#include "oauth_rand.h"
+
+#define RAND_BLOCKS	4				///< ChaCha20 blocks per refill
+#define RAND_BATCH	(RAND_BLOCKS * 64)
+
+/* no thread local storage on PSP; a single generator serves all threads there. */
+#if defined(_MSC_VER)
+	#define RAND_TLS __declspec(thread)
+#elif defined(PSP)
+	#define RAND_TLS
+#else
+	#define RAND_TLS __thread
+#endif
+
+/* guard the state shared by all threads on PSP; no-ops for per-thread states */
+#if defined(PSP)
+	#define RAND_LOCK(flags)	((flags) = sceKernelCpuSuspendIntr())
+	#define RAND_UNLOCK(flags)	sceKernelCpuResumeIntr(flags)
+#else
+	#define RAND_LOCK(flags)	((void)(flags))
+	#define RAND_UNLOCK(flags)	((void)(flags))
+#endif
+
+typedef struct {
+	uint32_t key[8];
+	uint64_t counter;
+	unsigned char buf[RAND_BATCH];
+	size_t pos;					///< next unused byte of buf
+	unsigned int fork_gen;		///< rand_fork_gen at seeding time
+	int seeded;
+} rand_state;
+
+static RAND_TLS rand_state rand_tls;
+
+/* bumped in the child after fork(), every thread state then reseeds */
+static volatile unsigned int rand_fork_gen;
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTERROUND(a, b, c, d) \
+	a += b; d ^= a; d = ROTL32(d, 16); \
+	c += d; b ^= c; b = ROTL32(b, 12); \
+	a += b; d ^= a; d = ROTL32(d, 8); \
+	c += d; b ^= c; b = ROTL32(b, 7)
+
+/* one 64 byte ChaCha20 keystream block (RFC 7539, all-zero nonce) */
+static void chacha20_block(const uint32_t key[8], uint64_t counter, unsigned char out[64])
+{
+	uint32_t x[16], in[16];
+	int i;
+
+	in[0] = 0x61707865; in[1] = 0x3320646e; in[2] = 0x79622d32; in[3] = 0x6b206574;
+	for (i = 0; i < 8; i++) in[4 + i] = key[i];
+	in[12] = (uint32_t)counter;
+	in[13] = (uint32_t)(counter >> 32);
+	in[14] = 0;
+	in[15] = 0;
+
+	memcpy(x, in, sizeof(x));
+	for (i = 0; i < 10; i++) {
+		QUARTERROUND(x[0], x[4], x[8],  x[12]);
+		QUARTERROUND(x[1], x[5], x[9],  x[13]);
+		QUARTERROUND(x[2], x[6], x[10], x[14]);
+		QUARTERROUND(x[3], x[7], x[11], x[15]);
+		QUARTERROUND(x[0], x[5], x[10], x[15]);
+		QUARTERROUND(x[1], x[6], x[11], x[12]);
+		QUARTERROUND(x[2], x[7], x[8],  x[13]);
+		QUARTERROUND(x[3], x[4], x[9],  x[14]);
+	}
+
+	for (i = 0; i < 16; i++) {
+		uint32_t v = x[i] + in[i];
+		out[4 * i + 0] = (unsigned char)v;
+		out[4 * i + 1] = (unsigned char)(v >> 8);
+		out[4 * i + 2] = (unsigned char)(v >> 16);
+		out[4 * i + 3] = (unsigned char)(v >> 24);
+	}
+}
+
+#if !defined(WIN32) && !defined(PSP)
+static void rand_atfork_child(void)
+{
+	rand_fork_gen++;
+}
+
+static pthread_once_t rand_atfork_once = PTHREAD_ONCE_INIT;
+
+static void rand_atfork_register(void)
+{
+	pthread_atfork(NULL, NULL, rand_atfork_child);
+}
+#endif
+
+/* 32 bytes of seed from the OS. returns 0 if none was available. */
+static int rand_os_seed(unsigned char *seed)
+{
+#if defined(WIN32)
+	unsigned int v;
+	int i;
+
+	for (i = 0; i < 32; i += 4) {
+		if (rand_s(&v) != 0) return 0;
+		memcpy(seed + i, &v, 4);
+	}
+	return 1;
+#elif defined(PSP)
+	uint32_t acc[8] = { 0 }, t, spin;
+	int i;
+
+	// the number of polls until the clock ticks varies with cache, bus and
+	// interrupt timing; fold it together with the clock into the seed.
+	for (i = 0; i < 8 * 32; i++) {
+		t = sceKernelGetSystemTimeLow();
+		for (spin = 0; sceKernelGetSystemTimeLow() == t; spin++)
+			;
+		acc[i & 7] = ROTL32(acc[i & 7], 5) ^ spin ^ (t << 16) ^ t;
+	}
+	memcpy(seed, acc, sizeof(acc));
+	return 1;
+#else
+	size_t got = 0;
+	ssize_t n;
+	int fd;
+
+#if defined(__linux__) && defined(SYS_getrandom)
+	while (got < 32) {
+		n = syscall(SYS_getrandom, seed + got, 32 - got, 0);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		got += n;
+	}
+	if (got == 32) return 1;
+#endif
+
+	if ((fd = open("/dev/urandom", O_RDONLY)) < 0) return 0;
+	for (got = 0; got < 32; got += n) {
+		n = read(fd, seed + got, 32 - got);
+		if (n <= 0) {
+			if (n < 0 && errno == EINTR) { n = 0; continue; }
+			break;
+		}
+	}
+	close(fd);
+	return got == 32;
+#endif
+}
+
+static void rand_seed(rand_state *st)
+{
+	unsigned char seed[32];
+	uint32_t extra[8];
+	unsigned int flags = 0;
+	int i;
+
+#if !defined(WIN32) && !defined(PSP)
+	pthread_once(&rand_atfork_once, rand_atfork_register);
+#endif
+	if (!rand_os_seed(seed)) {
+		// last resort (no /dev/urandom): not unpredictable, only unique-ish
+		memset(seed, 0, sizeof(seed));
+	}
+
+	// mixed in always, so two states never start alike even without an OS seed
+	extra[0] = (uint32_t)time(NULL);
+	extra[1] = (uint32_t)clock();
+	extra[2] = (uint32_t)(uintptr_t)st;
+	extra[3] = (uint32_t)((uint64_t)(uintptr_t)st >> 32);
+#if defined(PSP)
+	extra[4] = (uint32_t)sceKernelGetSystemTimeWide();
+	extra[5] = (uint32_t)sceKernelGetThreadId();
+	extra[6] = (uint32_t)(uintptr_t)&flags; // the stack of the seeding thread
+#elif defined(WIN32)
+	extra[4] = 0;
+	extra[5] = 0;
+	extra[6] = 0;
+#else
+	extra[4] = (uint32_t)getpid();
+	extra[5] = rand_fork_gen;
+	extra[6] = 0;
+#endif
+	extra[7] = 0;
+
+	RAND_LOCK(flags);
+	st->fork_gen = rand_fork_gen;
+	for (i = 0; i < 8; i++) {
+		uint32_t v = (uint32_t)seed[4 * i] | (uint32_t)seed[4 * i + 1] << 8 |
+			(uint32_t)seed[4 * i + 2] << 16 | (uint32_t)seed[4 * i + 3] << 24;
+		st->key[i] ^= v ^ extra[i];
+	}
+
+	st->counter = 0;
+	st->pos = RAND_BATCH;
+	st->seeded = 1;
+	RAND_UNLOCK(flags);
+	memset(seed, 0, sizeof(seed));
+}
+
+static void rand_refill(rand_state *st)
+{
+	int i;
+
+	for (i = 0; i < RAND_BLOCKS; i++) {
+		chacha20_block(st->key, st->counter++, st->buf + 64 * i);
+	}
+
+	// fast key erasure: the first 32 bytes replace the key and are never output
+	for (i = 0; i < 8; i++) {
+		st->key[i] = (uint32_t)st->buf[4 * i] | (uint32_t)st->buf[4 * i + 1] << 8 |
+			(uint32_t)st->buf[4 * i + 2] << 16 | (uint32_t)st->buf[4 * i + 3] << 24;
+	}
+	memset(st->buf, 0, 32);
+	st->pos = 32;
+}
+
+void oauth_random_bytes(void *buf, size_t len)
+{
+	rand_state *st = &rand_tls;
+	unsigned char *out = (unsigned char *)buf;
+	unsigned int flags = 0;
+	size_t n;
+
+	// locked per batch, so long requests don't hold off interrupts for long
+	while (len > 0) {
+		RAND_LOCK(flags);
+		if (!st->seeded || st->fork_gen != rand_fork_gen) {
+			// seeded unlocked, the seed takes a while to gather on PSP
+			RAND_UNLOCK(flags);
+			rand_seed(st);
+			continue;
+		}
+		if (st->pos == RAND_BATCH) rand_refill(st);
+
+		n = RAND_BATCH - st->pos;
+		if (n > len) n = len;
+		memcpy(out, st->buf + st->pos, n);
+		memset(st->buf + st->pos, 0, n); // handed out bytes don't stay in memory
+		st->pos += n;
+		RAND_UNLOCK(flags);
+		out += n;
+		len -= n;
+	}
+}
@@ -0,0 +1,23 @@
+#ifndef _OAUTH_RAND_H
+#define _OAUTH_RAND_H      1
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+/*
+ * internal: fill 'buf' with 'len' bytes from the calling thread's ChaCha20
+ * generator, seeded from the operating system (getrandom / urandom /
+ * rand_s). Thread-safe and lock-free; a forked child reseeds itself.
+ * On PSP one generator is shared under suspended interrupts and seeded
+ * from clock jitter, see oauth_rand.c.
+ */
+void oauth_random_bytes(void *buf, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _OAUTH_RAND_H
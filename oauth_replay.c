@@ -0,0 +1,155 @@
+/* oauth_replay.c -- lock-free nonce replay cache
+ *
+ * Remembers (consumer key, timestamp, nonce) triples for as long as their
+ * timestamp is inside the accepted clock skew window.
+ *
+ * Time is cut into generations of gen_seconds. Each of the
+ * REPLAY_GENERATIONS tables in the ring holds the entries of one
+ * generation; a slot is a 64 bit word of 32 bit generation tag and 32 bit
+ * fingerprint. Slots tagged with another generation are free, so a table
+ * is recycled for a new generation without ever being cleared, and memory
+ * is fixed at creation. The tag is the whole generation number for any
+ * timestamp below 2^32, so an old slot never passes for a current one.
+ *
+ * Inserting claims the first free slot of the probe sequence with a
+ * compare-and-swap. Entries of the current generation are never removed,
+ * so two threads inserting the same triple race for the same slot and the
+ * loser finds the winner's entry there: no locks, and no lost replays.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "oauth.h"
+#include "xmalloc.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#define REPLAY_GENERATIONS	8	///< tables in the ring; the window spans at most 7 of them
+#define REPLAY_MAX_PROBE	64	///< slots searched before a table counts as full
+#define REPLAY_TAG_SHIFT	32
+#define REPLAY_FP_MASK		((((uint64_t)1) << REPLAY_TAG_SHIFT) - 1)
+
+/*
+ * PSP builds have no atomic compare-and-swap here, the cache must only
+ * be used from one thread there.
+ */
+#if defined(PSP)
+	#define REPLAY_LOAD(p)				(*(p))
+	#define REPLAY_CAS(p, expect, val)	(*(p) == *(expect) ? (*(p) = (val), 1) : (*(expect) = *(p), 0))
+#elif defined(_MSC_VER)
+	#define REPLAY_LOAD(p)				(*(volatile uint64_t *)(p))
+	static __inline int replay_cas(uint64_t *p, uint64_t *expect, uint64_t val)
+	{
+		uint64_t old = (uint64_t)_InterlockedCompareExchange64((volatile __int64 *)p, (__int64)val, (__int64)*expect);
+		if (old == *expect) return 1;
+		*expect = old;
+		return 0;
+	}
+	#define REPLAY_CAS(p, expect, val)	replay_cas(p, expect, val)
+#else
+	#define REPLAY_LOAD(p)				__atomic_load_n(p, __ATOMIC_ACQUIRE)
+	#define REPLAY_CAS(p, expect, val)	__atomic_compare_exchange_n(p, expect, val, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+#endif
+
+struct OAuthReplayCache {
+	uint64_t *slot;		///< REPLAY_GENERATIONS tables of mask + 1 slots
+	size_t mask;
+	long window;		///< accepted clock skew in seconds
+	long gen_seconds;	///< length of a generation
+	uint64_t seed;		///< keys the hash, so clients can't aim at one chain
+};
+
+static __inline uint64_t replay_mix(uint64_t h)
+{
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static uint64_t replay_hash(uint64_t seed, const char *c_key, long timestamp, const char *nonce)
+{
+	uint64_t h = seed ^ 0xcbf29ce484222325ULL;
+	int i;
+
+	for (; c_key && *c_key; c_key++) h = (h ^ (unsigned char)*c_key) * 0x100000001b3ULL;
+	h = (h ^ 0xff) * 0x100000001b3ULL;
+	for (i = 0; i < 8; i++) h = (h ^ (((uint64_t)timestamp >> (i * 8)) & 0xff)) * 0x100000001b3ULL;
+	for (; nonce && *nonce; nonce++) h = (h ^ (unsigned char)*nonce) * 0x100000001b3ULL;
+
+	return replay_mix(h);
+}
+
+OAuthReplayCache *oauth_replay_cache_new(size_t capacity, long window)
+{
+	OAuthReplayCache *cache;
+	size_t size = 64;
+
+	if (window < 0) window = 0;
+
+	// each generation gets twice its share of 'capacity' (load <= 50%)
+	while (size < 2 * capacity / (REPLAY_GENERATIONS - 1)) size <<= 1;
+
+	cache = (OAuthReplayCache *)xmalloc(sizeof(OAuthReplayCache));
+	cache->slot = (uint64_t *)xcalloc(REPLAY_GENERATIONS * size, sizeof(uint64_t));
+	cache->mask = size - 1;
+	cache->window = window;
+	// [now - window, now + window] must fit in REPLAY_GENERATIONS - 1 generations
+	cache->gen_seconds = (2 * window) / (REPLAY_GENERATIONS - 2) + 1;
+	cache->seed = replay_mix((uint64_t)(uintptr_t)cache ^ ((uint64_t)time(NULL) << 20) ^ (uint64_t)clock());
+	return cache;
+}
+
+void oauth_replay_cache_free(OAuthReplayCache *cache)
+{
+	if (!cache) return;
+
+	xfree(cache->slot);
+	xfree(cache);
+}
+
+OAuthReplayResult oauth_replay_check(OAuthReplayCache *cache, const char *c_key,
+	long timestamp, const char *nonce, long now)
+{
+	uint64_t *table, h, value, cur, tag;
+	unsigned long gen;
+	size_t i;
+	int n;
+
+	if (timestamp < now - cache->window || timestamp > now + cache->window || timestamp < 0) {
+		return OA_REPLAY_STALE;
+	}
+
+	gen = (unsigned long)(timestamp / cache->gen_seconds);
+	table = cache->slot + (gen % REPLAY_GENERATIONS) * (cache->mask + 1);
+	tag = (uint64_t)(gen & 0xffffffffUL);
+
+	h = replay_hash(cache->seed, c_key, timestamp, nonce);
+	value = (tag << REPLAY_TAG_SHIFT) | (replay_mix(h ^ cache->seed) & REPLAY_FP_MASK);
+	if ((value & REPLAY_FP_MASK) == 0) value |= 1; // 0 means never used
+
+	i = (size_t)h & cache->mask;
+	for (n = 0; n < REPLAY_MAX_PROBE; n++, i = (i + 1) & cache->mask) {
+		cur = REPLAY_LOAD(&table[i]);
+		for (;;) {
+			if (cur == value) return OA_REPLAY_SEEN;
+
+			// in use by this generation: try the next slot
+			if ((cur & REPLAY_FP_MASK) != 0 && (cur >> REPLAY_TAG_SHIFT) == tag) break;
+
+			// unused or left from an older generation: claim it.
+			// on failure 'cur' holds the new content, look at it again.
+			if (REPLAY_CAS(&table[i], &cur, value)) return OA_REPLAY_OK;
+		}
+	}
+
+	return OA_REPLAY_FULL;
+}
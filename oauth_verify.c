@@ -0,0 +1,382 @@
+/* oauth_verify.c -- server side verification of HMAC signed OAuth requests
+ *
+ * The signature base string is rebuilt the way oauth_sign_array2_process
+ * builds it and streamed into an HMAC context on the stack. Parameters are
+ * collected as slices of the caller's strings, then decoded and escaped
+ * once into oauth_norm keys, sorted and fed by the same code the signer
+ * uses (oauth_norm.c). Verifying a request of ordinary size does not
+ * allocate.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+
+#include "xmalloc.h"
+#include "oauth.h"
+#include "escape.h"
+#include "oauth_norm.h"
+#include "base64.h"
+#include "cpu.h"
+
+#if defined(OAUTH_X86) && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifdef WIN32
+#define strncasecmp strnicmp
+#endif
+
+#define VERIFY_KEY_SIZE		1024	///< longest escaped "c_secret&t_secret" key
+#define VERIFY_NORM_SIZE	4096	///< normalized keys kept on the stack, larger ones are allocated
+#define VERIFY_SIG_SIZE		192		///< longest accepted (encoded) oauth_signature
+
+/*
+ * one request parameter, pointing into the URL, header or body.
+ * name and value are still percent-encoded as received.
+ */
+typedef struct {
+	const char *name;
+	size_t name_len;
+	const char *value;	///< NULL for a parameter without '='
+	size_t value_len;
+	int plus;		///< '+' means ' ' (query string and form body)
+} verify_param;
+
+typedef struct {
+	verify_param *param;	///< 'local' until it overflows, then allocated
+	int count;
+	int size;
+	verify_param local[OAUTH_VERIFY_MAX_PARAMS];
+	const char *sig;	///< oauth_signature value, still encoded
+	size_t sig_len;
+	int sig_plus;
+	int sig_count;
+	const char *method;	///< oauth_signature_method value
+	size_t method_len;
+} verify_request;
+
+static int verify_is(const char *s, size_t len, const char *name)
+{
+	return strlen(name) == len && memcmp(s, name, len) == 0;
+}
+
+/*
+ * add one name[=value] parameter. oauth_signature is set aside,
+ * like oauth_split_post_paramters drops it. more parameters than
+ * the stack array holds move to the heap, doubling as they grow.
+ */
+static void verify_add(verify_request *req, const char *name, size_t name_len,
+	const char *value, size_t value_len, int plus)
+{
+	verify_param *p;
+
+	if (name_len == 0 && !value) return;
+
+	if (verify_is(name, name_len, "oauth_signature")) {
+		req->sig = value;
+		req->sig_len = value ? value_len : 0;
+		req->sig_plus = plus;
+		req->sig_count++;
+		return;
+	}
+
+	if (req->count == req->size) {
+		req->size *= 2;
+		if (req->param == req->local) {
+			req->param = (verify_param *)xmalloc(req->size * sizeof(verify_param));
+			memcpy(req->param, req->local, sizeof(req->local));
+		} else {
+			req->param = (verify_param *)xrealloc(req->param, req->size * sizeof(verify_param));
+		}
+	}
+
+	if (verify_is(name, name_len, "oauth_signature_method") && value) {
+		req->method = value;
+		req->method_len = value_len;
+	}
+
+	p = &req->param[req->count++];
+	p->name = name;
+	p->name_len = name_len;
+	p->value = value;
+	p->value_len = value_len;
+	p->plus = plus;
+}
+
+/* split an application/x-www-form-urlencoded string (query or body) */
+static void verify_add_form(verify_request *req, const char *s, const char *end)
+{
+	const char *amp, *eq;
+
+	while (s < end) {
+		for (amp = s; amp < end && *amp != '&'; amp++);
+		for (eq = s; eq < amp && *eq != '='; eq++);
+
+		if (amp > s) {
+			if (eq < amp) {
+				verify_add(req, s, eq - s, eq + 1, amp - eq - 1, 1);
+			} else {
+				verify_add(req, s, amp - s, NULL, 0, 1);
+			}
+		}
+		s = amp + 1;
+	}
+}
+
+/*
+ * parse 'OAuth realm="...", oauth_name="value", ...'.
+ * returns 0 for a malformed header.
+ */
+static int verify_add_header(verify_request *req, const char *h)
+{
+	const char *name, *value;
+	size_t name_len;
+
+	while (*h == ' ' || *h == '\t') h++;
+	if (strncasecmp(h, "OAuth", 5) != 0 || (h[5] != ' ' && h[5] != '\t' && h[5] != '\0')) return 0;
+	h += 5;
+
+	for (;;) {
+		while (*h == ' ' || *h == '\t' || *h == ',') h++;
+		if (*h == '\0') return 1;
+
+		name = h;
+		while (*h && *h != '=' && *h != ' ' && *h != '\t' && *h != ',') h++;
+		name_len = h - name;
+		while (*h == ' ' || *h == '\t') h++;
+		if (*h++ != '=') return 0;
+		while (*h == ' ' || *h == '\t') h++;
+		if (*h++ != '"') return 0;
+		value = h;
+		while (*h && *h != '"') h++;
+		if (*h != '"') return 0;
+
+		if (!verify_is(name, name_len, "realm")) {
+			verify_add(req, name, name_len, value, h - value, 0);
+		}
+		h++;
+	}
+}
+
+/*
+ * percent-decode 'len' bytes of an encoded slice into 'out', which has
+ * room for them. returns the decoded length.
+ */
+static size_t verify_decode(char *out, const char *s, size_t len, int plus)
+{
+	char *p = out;
+
+	memcpy(out, s, len);
+	while (plus && (p = (char *)memchr(p, '+', out + len - p))) {
+		*p++ = ' ';
+	}
+	return oauth_unescape_raw(out, out, len);
+}
+
+/*
+ * constant-time comparison of two digest buffers of
+ * OAUTH_HMAC_MAX_DIGEST bytes, zero padded behind shorter digests.
+ */
+static int verify_equals(const unsigned char *a, const unsigned char *b)
+{
+#if defined(OAUTH_X86) && defined(__SSE2__)
+	__m128i d = _mm_setzero_si128();
+	int i;
+
+	for (i = 0; i < OAUTH_HMAC_MAX_DIGEST; i += 16) {
+		d = _mm_or_si128(d, _mm_xor_si128(_mm_loadu_si128((const __m128i *)(a + i)),
+			_mm_loadu_si128((const __m128i *)(b + i))));
+	}
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(d, _mm_setzero_si128())) == 0xffff;
+#else
+	uint32_t wa, wb, d = 0;
+	int i;
+
+	for (i = 0; i < OAUTH_HMAC_MAX_DIGEST; i += 4) {
+		memcpy(&wa, a + i, 4);
+		memcpy(&wb, b + i, 4);
+		d |= wa ^ wb;
+	}
+	return d == 0;
+#endif
+}
+
+static const char *verify_find(const char *s, const char *end, const char *needle)
+{
+	size_t n = strlen(needle);
+
+	for (; (size_t)(end - s) >= n; s++) {
+		if (memcmp(s, needle, n) == 0) return s;
+	}
+	return NULL;
+}
+
+/*
+ * feed the escaped base URL with the rules of oauth_split_post_paramters:
+ * an empty path becomes "/" and the first ":80/" loses its port.
+ */
+static void verify_put_url(oauth_hmac_feed *f, const char *url, const char *end)
+{
+	const char *slash, *port;
+	int add_slash = 0;
+
+	if ((slash = verify_find(url, end, ":/"))) {
+		while (++slash < end && *slash == '/');
+		add_slash = !memchr(slash, '/', end - slash);
+	}
+
+	port = verify_find(url, end, ":80/");
+	if (!port && add_slash && end - url >= 3 && memcmp(end - 3, ":80", 3) == 0) {
+		port = end - 3;
+	}
+
+	if (port) {
+		oauth_feed_escaped(f, url, port - url);
+		oauth_feed_escaped(f, port + 3, end - port - 3);
+	} else {
+		oauth_feed_escaped(f, url, end - url);
+	}
+
+	if (add_slash) oauth_feed_raw(f, "%2F", 3);
+}
+
+/*
+ * check the signature of the collected parameters of a request to
+ * 'url', whose base URL ends at 'url_end'.
+ */
+static OAuthVerifyResult verify_signature(const verify_request *req, const char *http_method,
+	const char *url, const char *url_end, const char *c_secret, const char *t_secret)
+{
+	oauth_hmac_feed feed;
+	oauth_norm norm;
+	oauth_norm_param norm_param[OAUTH_VERIFY_MAX_PARAMS];
+	char norm_buf[VERIFY_NORM_SIZE];
+	OAuthMethod method;
+	const verify_param *p;
+	const char *s;
+	char key[VERIFY_KEY_SIZE], upper[16], sig[VERIFY_SIG_SIZE], *scratch;
+	size_t key_len = 0, keys = 0, longest = 0, o, n, size, given_len;
+	unsigned char digest[OAUTH_HMAC_MAX_DIGEST], given[OAUTH_HMAC_MAX_DIGEST];
+	int i, ok;
+
+	if (req->sig_count != 1 || !req->sig) return OA_VERIFY_MALFORMED;
+
+	if (req->method && verify_is(req->method, req->method_len, "HMAC-SHA1")) {
+		method = OA_HMAC;
+	} else if (req->method && verify_is(req->method, req->method_len, "HMAC-SHA256")) {
+		method = OA_HMAC_SHA256;
+	} else {
+		return OA_VERIFY_UNSUPPORTED;
+	}
+
+	// key: oauth_catenc(2, c_secret, t_secret) into the stack buffer
+	for (i = 0; i < 2; i++) {
+		s = i ? t_secret : c_secret;
+		if (!s) s = "";
+		n = strlen(s);
+		if (i) key[key_len++] = '&';
+		if (key_len + n + 2 * oauth_escape_count(s, n) >= sizeof(key)) return OA_VERIFY_TOO_LARGE;
+		key_len += oauth_escape_raw(key + key_len, s, n);
+	}
+
+	// each parameter decoded and escaped once, as oauth_base_build does.
+	// decoding never makes a slice longer to escape: %XX stays 3 chars
+	for (i = 0; i < req->count; i++) {
+		p = &req->param[i];
+		keys += p->name_len + 2 * oauth_escape_count(p->name, p->name_len) + 1;
+		if (p->value) keys += p->value_len + 2 * oauth_escape_count(p->value, p->value_len);
+		if (p->name_len + p->value_len > longest) longest = p->name_len + p->value_len;
+	}
+	norm.param = req->count <= OAUTH_VERIFY_MAX_PARAMS ? norm_param :
+		(oauth_norm_param *)xmalloc(req->count * sizeof(oauth_norm_param));
+	norm.count = req->count;
+	norm.buf = keys + longest <= sizeof(norm_buf) ? norm_buf : (char *)xmalloc(keys + longest);
+	scratch = norm.buf + keys;
+
+	for (i = 0, o = 0; i < req->count; i++) {
+		p = &req->param[i];
+		n = verify_decode(scratch, p->name, p->name_len, p->plus);
+		size = p->value ? verify_decode(scratch + n, p->value, p->value_len, p->plus) : 0;
+		norm.param[i].index = i;
+		o = oauth_norm_key(&norm, &norm.param[i], o, scratch, n, p->value ? scratch + n : NULL, size);
+	}
+	oauth_norm_sort(&norm);
+
+	// base string: METHOD&url&sorted-params, as oauth_sign_array2_process
+	oauth_hmac_start(&feed.hmac, method, key, key_len);
+	feed.len = 0;
+
+	// the method upper-cased ("get" signs as "GET"), through a small buffer
+	for (s = http_method; *s; ) {
+		for (n = 0; n < sizeof(upper) && *s; n++) upper[n] = (char)toupper((unsigned char)*s++);
+		oauth_feed_escaped(&feed, upper, n);
+	}
+	oauth_feed_raw(&feed, "&", 1);
+	verify_put_url(&feed, url, url_end);
+	oauth_feed_raw(&feed, "&", 1);
+	oauth_feed_params(&feed, &norm);
+
+	oauth_feed_flush(&feed);
+	size = oauth_hmac_finish(&feed.hmac, digest);
+
+	if (norm.buf != norm_buf) {
+		xfree(norm.buf);
+	}
+	if (norm.param != norm_param) {
+		xfree(norm.param);
+	}
+
+	// compare digests, the received one percent- and base64-decoded.
+	// only the canonical base64 of a digest is accepted, so there is one
+	// valid oauth_signature per request. both are zero padded to the
+	// same size and always compared in full; a length other than the
+	// method's digest size fails with them
+	memset(digest + size, 0, sizeof(digest) - size);
+	memset(given, 0, sizeof(given));
+	given_len = OAUTH_BASE64_ERROR;
+	if (req->sig_len <= sizeof(sig)) {
+		n = verify_decode(sig, req->sig, req->sig_len, req->sig_plus);
+		given_len = oauth_base64_decode_raw(given, sizeof(given), sig, n, OAUTH_BASE64_CANONICAL);
+	}
+
+	ok = verify_equals(digest, given) & (given_len == size);
+
+	memset(key, 0, sizeof(key));
+	memset(digest, 0, sizeof(digest));
+	memset(feed.buf, 0, sizeof(feed.buf));
+
+	return ok ? OA_VERIFY_OK : OA_VERIFY_BAD_SIGNATURE;
+}
+
+OAuthVerifyResult oauth_verify_request(const char *http_method, const char *url,
+	const char *auth_header, const char *body, size_t body_len,
+	const char *c_secret, const char *t_secret)
+{
+	verify_request req;
+	const char *url_end;
+	OAuthVerifyResult rv = OA_VERIFY_MALFORMED;
+
+	if (!http_method || !url) return OA_VERIFY_MALFORMED;
+
+	memset(&req, 0, sizeof(req));
+	req.param = req.local;
+	req.size = OAUTH_VERIFY_MAX_PARAMS;
+
+	// collect parameters: query string, Authorization header, form body
+	for (url_end = url; *url_end && *url_end != '?' && *url_end != '#'; url_end++);
+	if (*url_end == '?') {
+		const char *q = url_end + 1, *q_end = q + strcspn(q, "#");
+		verify_add_form(&req, q, q_end);
+	}
+	if (!auth_header || verify_add_header(&req, auth_header)) {
+		if (body) verify_add_form(&req, body, body + body_len);
+		rv = verify_signature(&req, http_method, url, url_end, c_secret, t_secret);
+	}
+
+	if (req.param != req.local) {
+		xfree(req.param);
+	}
+	return rv;
+}
@@ -29,7 +29,10 @@
  *
  */
 
+#include <string.h>
+
 #include "sha1.h"
+#include "cpu.h"
 
 #pragma warning(disable:4244)
 
@@ -38,6 +41,21 @@
  */
 #define SHA1CircularShift(bits,word) 	(((word) << (bits)) | ((word) >> (32-(bits))))
 
+/*
+ *  Big-endian 32 bit load; compilers turn this into a word load
+ *  plus byte swap.
+ */
+#define SHA1LoadBE32(p) \
+    (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+/*
+ *  Word t of the message schedule, kept in a 16 word circular buffer.
+ *  W[t] for t >= 16 is computed on first use.
+ */
+#define SHA1Schedule(W,t) \
+    ((t) < 16 ? W[(t)] : (W[(t) & 15] = SHA1CircularShift(1, \
+        W[((t)-3) & 15] ^ W[((t)-8) & 15] ^ W[((t)-14) & 15] ^ W[(t) & 15])))
+
 /* Local Function Prototyptes */
 void SHA1PadMessage(SHA1Context *context);
 void SHA1ProcessMessageBlock(SHA1Context *context);
@@ -136,6 +154,11 @@ int SHA1Result(SHA1Context *context, uint8_t Message_Digest[SHA1HashSize])
  *      This function accepts an array of octets as the next portion
  *      of the message.
  *
+ *      Input is first used to complete a partially filled
+ *      Message_Block.  All following whole 64 byte blocks are
+ *      compressed straight from 'message_array', and only the
+ *      remainder is copied into Message_Block for the next call.
+ *
  *  Parameters:
  *      context: [in/out]
  *          The SHA context to update
@@ -149,8 +172,11 @@ int SHA1Result(SHA1Context *context, uint8_t Message_Digest[SHA1HashSize])
  *      sha Error Code.
  *
  */
-int SHA1Input(SHA1Context *context, const uint8_t *message_array, unsigned length)
+int SHA1Input(SHA1Context *context, const uint8_t *message_array, size_t length)
 {
+    uint64_t total, bits;
+    size_t fill, nblocks;
+
     if (length == 0) {
         return shaSuccess;
     }
@@ -168,24 +194,41 @@ int SHA1Input(SHA1Context *context, const uint8_t *message_array, unsigned lengt
          return context->Corrupted;
     }
 
-    while (length-- && context->Corrupted == 0) {
-    	context->Message_Block[context->Message_Block_Index++] = (*message_array & 0xFF);
-
-        context->Length_Low += 8;
-        if (context->Length_Low == 0) {
-            context->Length_High++;
-            if (context->Length_High == 0)
-            {
-                /* Message is too long */
-                context->Corrupted = 1;
-            }
+    /* the message length in bits must fit into 64 bits */
+    total = ((uint64_t)context->Length_High << 32) | context->Length_Low;
+    bits = (uint64_t)length << 3;
+    if ((uint64_t)length > (UINT64_MAX >> 3) || total + bits < total) {
+        context->Corrupted = shaInputTooLong;
+        return shaInputTooLong;
+    }
+    total += bits;
+    context->Length_Low = (uint32_t)total;
+    context->Length_High = (uint32_t)(total >> 32);
+
+    if (context->Message_Block_Index > 0) {
+        fill = 64 - context->Message_Block_Index;
+        if (length < fill) {
+            memcpy(context->Message_Block + context->Message_Block_Index, message_array, length);
+            context->Message_Block_Index += (int_least16_t)length;
+            return shaSuccess;
         }
 
-        if (context->Message_Block_Index == 64) {
-            SHA1ProcessMessageBlock(context);
-        }
+        memcpy(context->Message_Block + context->Message_Block_Index, message_array, fill);
+        SHA1ProcessMessageBlock(context);
+        message_array += fill;
+        length -= fill;
+    }
 
-        message_array++;
+    nblocks = length / 64;
+    if (nblocks > 0) {
+        SHA1ProcessBlocks(context->Intermediate_Hash, message_array, nblocks);
+        message_array += nblocks * 64;
+        length -= nblocks * 64;
+    }
+
+    if (length > 0) {
+        memcpy(context->Message_Block, message_array, length);
+        context->Message_Block_Index = (int_least16_t)length;
     }
 
     return shaSuccess;
@@ -204,6 +247,79 @@ int SHA1Input(SHA1Context *context, const uint8_t *message_array, unsigned lengt
  *  Returns:
  *      Nothing.
  *
+ */
+void SHA1ProcessMessageBlock(SHA1Context *context)
+{
+    SHA1ProcessBlocks(context->Intermediate_Hash, context->Message_Block, 1);
+
+    context->Message_Block_Index = 0;
+}
+
+/* Selected compression backend, resolved on first use */
+static SHA1CompressFunc sha1_compress = NULL;
+static const char *sha1_backend = "generic";
+
+static void SHA1SelectBackend(void)
+{
+    SHA1CompressFunc fn = SHA1CompressGeneric;
+#ifdef OAUTH_X86
+    unsigned int features = oauth_cpu_features();
+
+    if ((features & (OAUTH_CPU_SHA | OAUTH_CPU_SSE41)) == (OAUTH_CPU_SHA | OAUTH_CPU_SSE41)) {
+        fn = SHA1CompressSHANI;
+        sha1_backend = "sha-ni";
+    } else if (features & OAUTH_CPU_SSSE3) {
+        fn = SHA1CompressSSSE3;
+        sha1_backend = "ssse3";
+    }
+#endif
+    sha1_compress = fn;
+}
+
+/*
+ *  SHA1ProcessBlocks
+ *
+ *  Description:
+ *      This function will run the compression function over 'nblocks'
+ *      consecutive 512 bit blocks.  The backend is selected on first
+ *      use, from the CPU features reported by oauth_cpu_features().
+ *
+ *  Parameters:
+ *      state: [in/out]
+ *          The five word intermediate hash.
+ *      blocks: [in]
+ *          The message blocks.
+ *      nblocks: [in]
+ *          The number of 64 byte blocks at 'blocks'.
+ *
+ *  Returns:
+ *      Nothing.
+ *
+ */
+void SHA1ProcessBlocks(uint32_t state[5], const uint8_t *blocks, size_t nblocks)
+{
+    if (sha1_compress == NULL) {
+        SHA1SelectBackend();
+    }
+
+    sha1_compress(state, blocks, nblocks);
+}
+
+const char *SHA1BackendName(void)
+{
+    if (sha1_compress == NULL) {
+        SHA1SelectBackend();
+    }
+
+    return sha1_backend;
+}
+
+/*
+ *  SHA1CompressGeneric
+ *
+ *  Description:
+ *      Portable implementation of the compression function.
+ *
  *  Comments:
  *      Many of the variable names in this code, especially the
  *      single character names, were used because those were the
@@ -211,7 +327,7 @@ int SHA1Input(SHA1Context *context, const uint8_t *message_array, unsigned lengt
  *
  *
  */
-void SHA1ProcessMessageBlock(SHA1Context *context)
+void SHA1CompressGeneric(uint32_t state[5], const uint8_t *blocks, size_t nblocks)
 {
     const uint32_t K[] =    {       /* Constants defined in SHA-1   */
                             0x5A827999,
@@ -221,72 +337,65 @@ void SHA1ProcessMessageBlock(SHA1Context *context)
                             };
     int           t;                 /* Loop counter                */
     uint32_t      temp;              /* Temporary word value        */
-    uint32_t      W[80];             /* Word sequence               */
+    uint32_t      W[16];             /* Word sequence, W[t & 15]    */
     uint32_t      A, B, C, D, E;     /* Word buffers                */
 
-    /*
-     *  Initialize the first 16 words in the array W
-     */
-    for (t = 0; t < 16; t++) {
-        W[t] = context->Message_Block[t * 4] << 24;
-        W[t] |= context->Message_Block[t * 4 + 1] << 16;
-        W[t] |= context->Message_Block[t * 4 + 2] << 8;
-        W[t] |= context->Message_Block[t * 4 + 3];
-    }
+    for (; nblocks > 0; nblocks--, blocks += 64) {
+        /*
+         *  Initialize the first 16 words in the array W
+         */
+        for (t = 0; t < 16; t++) {
+            W[t] = SHA1LoadBE32(blocks + t * 4);
+        }
 
-    for (t = 16; t < 80; t++) {
-       W[t] = SHA1CircularShift(1,W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16]);
-    }
+        A = state[0];
+        B = state[1];
+        C = state[2];
+        D = state[3];
+        E = state[4];
+
+        for (t = 0; t < 20; t++) {
+            temp =  SHA1CircularShift(5,A) + ((B & C) | ((~B) & D)) + E + SHA1Schedule(W,t) + K[0];
+            E = D;
+            D = C;
+            C = SHA1CircularShift(30,B);
+            B = A;
+            A = temp;
+        }
 
-    A = context->Intermediate_Hash[0];
-    B = context->Intermediate_Hash[1];
-    C = context->Intermediate_Hash[2];
-    D = context->Intermediate_Hash[3];
-    E = context->Intermediate_Hash[4];
-
-    for (t = 0; t < 20; t++) {
-        temp =  SHA1CircularShift(5,A) + ((B & C) | ((~B) & D)) + E + W[t] + K[0];
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
-        B = A;
-        A = temp;
-    }
+        for (t = 20; t < 40; t++) {
+            temp = SHA1CircularShift(5,A) + (B ^ C ^ D) + E + SHA1Schedule(W,t) + K[1];
+            E = D;
+            D = C;
+            C = SHA1CircularShift(30,B);
+            B = A;
+            A = temp;
+        }
 
-    for (t = 20; t < 40; t++) {
-        temp = SHA1CircularShift(5,A) + (B ^ C ^ D) + E + W[t] + K[1];
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
-        B = A;
-        A = temp;
-    }
+        for (t = 40; t < 60; t++) {
+            temp = SHA1CircularShift(5,A) + ((B & C) | (B & D) | (C & D)) + E + SHA1Schedule(W,t) + K[2];
+            E = D;
+            D = C;
+            C = SHA1CircularShift(30,B);
+            B = A;
+            A = temp;
+        }
 
-    for (t = 40; t < 60; t++) {
-        temp = SHA1CircularShift(5,A) + ((B & C) | (B & D) | (C & D)) + E + W[t] + K[2];
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
-        B = A;
-        A = temp;
-    }
+        for (t = 60; t < 80; t++) {
+            temp = SHA1CircularShift(5,A) + (B ^ C ^ D) + E + SHA1Schedule(W,t) + K[3];
+            E = D;
+            D = C;
+            C = SHA1CircularShift(30,B);
+            B = A;
+            A = temp;
+        }
 
-    for (t = 60; t < 80; t++) {
-        temp = SHA1CircularShift(5,A) + (B ^ C ^ D) + E + W[t] + K[3];
-        E = D;
-        D = C;
-        C = SHA1CircularShift(30,B);
-        B = A;
-        A = temp;
+        state[0] += A;
+        state[1] += B;
+        state[2] += C;
+        state[3] += D;
+        state[4] += E;
     }
-
-    context->Intermediate_Hash[0] += A;
-    context->Intermediate_Hash[1] += B;
-    context->Intermediate_Hash[2] += C;
-    context->Intermediate_Hash[3] += D;
-    context->Intermediate_Hash[4] += E;
-
-    context->Message_Block_Index = 0;
 }
 
 
@@ -21,13 +21,13 @@
 extern "C" {
 #endif
 
-//#include <stdint.h>
-typedef unsigned long uint32_t;
-typedef int int_least16_t;
-typedef unsigned char uint8_t;
+#include <stddef.h>
+#include <stdint.h>
 
 /*
- * If you do not have the ISO standard stdint.h header file, then you
+ * The block compression backends (see SHA1ProcessBlocks) operate on the
+ * chaining state directly, so uint32_t must really be 32 bits wide.  If
+ * you do not have the ISO standard stdint.h header file, then you
  * must typdef the following:
  *    name              meaning
  *  uint32_t         unsigned 32 bit integer
@@ -72,9 +72,48 @@ typedef struct SHA1Context
  */
 
 int SHA1Reset(SHA1Context *context);
-int SHA1Input(SHA1Context *context, const uint8_t *message_array, unsigned int length);
+int SHA1Input(SHA1Context *context, const uint8_t *message_array, size_t length);
 int SHA1Result( SHA1Context *context, uint8_t Message_Digest[SHA1HashSize]);
 
+/*
+ *  Block compression.
+ *
+ *  SHA1ProcessBlocks runs the compression function over 'nblocks'
+ *  consecutive 64 byte blocks, updating the five word chaining state.
+ *  It dispatches to the fastest backend the CPU supports: SHA
+ *  extensions, SSSE3 or the portable C code.  All backends produce
+ *  identical results.
+ */
+typedef void (*SHA1CompressFunc)(uint32_t state[5], const uint8_t *blocks, size_t nblocks);
+
+void SHA1ProcessBlocks(uint32_t state[5], const uint8_t *blocks, size_t nblocks);
+const char *SHA1BackendName(void);
+
+void SHA1CompressGeneric(uint32_t state[5], const uint8_t *blocks, size_t nblocks);
+void SHA1CompressSSSE3(uint32_t state[5], const uint8_t *blocks, size_t nblocks);
+void SHA1CompressSHANI(uint32_t state[5], const uint8_t *blocks, size_t nblocks);
+
+/*
+ *  Multi-buffer hashing (sha1_mb.c).
+ *
+ *  Hashes up to SHA1_MB_MAX_LANES independent messages per pass with
+ *  AVX2 or AVX-512, and falls back to SHA1ProcessBlocks otherwise.
+ */
+#define SHA1_MB_MAX_LANES 16
+
+typedef struct SHA1MultiJob
+{
+    uint32_t state[5];          /* in: chaining state, out: final state */
+    const uint8_t *data;        /* message                              */
+    size_t length;              /* message length in bytes              */
+    uint64_t prefix_length;     /* bytes already absorbed into 'state'  */
+    uint8_t digest[SHA1HashSize]; /* out: message digest                */
+} SHA1MultiJob;
+
+size_t SHA1MultiLanes(void);
+void SHA1MultiCompress(uint32_t *states[], const uint8_t *blocks[], size_t count);
+void SHA1MultiBuffer(SHA1MultiJob *jobs, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,456 @@
+/*
+ *  sha1_mb.c
+ *
+ *  Description:
+ *      Multi-buffer SHA-1.  Independent messages are hashed side by
+ *      side, one message per 32 bit SIMD lane: 8 lanes with AVX2 and
+ *      16 lanes with AVX-512.  This pays off for many short messages
+ *      (OAuth base strings are only a few blocks long), where a
+ *      single-stream kernel cannot keep the vector units busy.
+ *
+ *      SHA1MultiCompress is the raw primitive: one block for each of
+ *      'count' chaining states.  SHA1MultiBuffer adds padding and
+ *      schedules whole messages of different lengths over the lanes.
+ *
+ *      Without AVX2 (or with AVX2 and SHA-NI, where one SHA-NI stream
+ *      is as fast as eight AVX2 lanes) both functions fall back to
+ *      SHA1ProcessBlocks for each message.  Results never depend on
+ *      the CPU.
+ *
+ */
+
+#include <string.h>
+
+#include "sha1.h"
+#include "cpu.h"
+
+#ifdef OAUTH_X86
+#include <immintrin.h>
+
+#define SHA1_MB_K0 0x5A827999
+#define SHA1_MB_K1 0x6ED9EBA1
+#define SHA1_MB_K2 ((int)0x8F1BBCDC)
+#define SHA1_MB_K3 ((int)0xCA62C1D6)
+
+/*
+ * Load word rows [first, first+8) of eight blocks as eight vectors, vector t
+ * holding big-endian word first+t of every block (an 8x8 transpose).
+ */
+OAUTH_TARGET("avx2")
+static __inline void sha1_mb_load8(__m256i out[8], const uint8_t *blocks[8], int first)
+{
+    const __m256i bswap = _mm256_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m256i r[8], s[8], u[8];
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        r[i] = _mm256_loadu_si256((const __m256i *)(blocks[i] + first * 4));
+    }
+
+    for (i = 0; i < 8; i += 2) {
+        s[i]     = _mm256_unpacklo_epi32(r[i], r[i + 1]);
+        s[i + 1] = _mm256_unpackhi_epi32(r[i], r[i + 1]);
+    }
+
+    for (i = 0; i < 8; i += 4) {
+        u[i]     = _mm256_unpacklo_epi64(s[i],     s[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(s[i],     s[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(s[i + 1], s[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(s[i + 1], s[i + 3]);
+    }
+
+    for (i = 0; i < 4; i++) {
+        out[i]     = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[i], u[i + 4], 0x20), bswap);
+        out[i + 4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u[i], u[i + 4], 0x31), bswap);
+    }
+}
+
+/*
+ *  SHA1MultiCompressAVX2 -- one block for each of exactly eight states
+ */
+
+#define MB8_ROL(x, n)   _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32 - (n)))
+#define MB8_CH(b, c, d) _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d)))
+#define MB8_PAR(b, c, d) _mm256_xor_si256(_mm256_xor_si256(b, c), d)
+#define MB8_MAJ(b, c, d) _mm256_or_si256(_mm256_and_si256(b, c), _mm256_and_si256(d, _mm256_or_si256(b, c)))
+
+#define MB8_SCHEDULE(t) \
+    if ((t) >= 16) { \
+        W[(t) & 15] = MB8_ROL(_mm256_xor_si256(_mm256_xor_si256(W[((t) - 3) & 15], W[((t) - 8) & 15]), \
+                                               _mm256_xor_si256(W[((t) - 14) & 15], W[(t) & 15])), 1); \
+    }
+
+#define MB8_ROUND(t, F, K) \
+    MB8_SCHEDULE(t) \
+    temp = _mm256_add_epi32(_mm256_add_epi32(MB8_ROL(A, 5), F(B, C, D)), \
+                            _mm256_add_epi32(_mm256_add_epi32(E, W[(t) & 15]), K)); \
+    E = D; D = C; C = MB8_ROL(B, 30); B = A; A = temp
+
+OAUTH_TARGET("avx2")
+static void SHA1MultiCompressAVX2(uint32_t *states[8], const uint8_t *blocks[8])
+{
+    const __m256i K0 = _mm256_set1_epi32(SHA1_MB_K0);
+    const __m256i K1 = _mm256_set1_epi32(SHA1_MB_K1);
+    const __m256i K2 = _mm256_set1_epi32(SHA1_MB_K2);
+    const __m256i K3 = _mm256_set1_epi32(SHA1_MB_K3);
+    __m256i W[16];
+    __m256i A, B, C, D, E, temp;
+    __m256i H[5];
+    int t, i;
+
+    sha1_mb_load8(W, blocks, 0);
+    sha1_mb_load8(W + 8, blocks, 8);
+
+    for (i = 0; i < 5; i++) {
+        H[i] = _mm256_set_epi32((int)states[7][i], (int)states[6][i], (int)states[5][i], (int)states[4][i],
+                                (int)states[3][i], (int)states[2][i], (int)states[1][i], (int)states[0][i]);
+    }
+
+    A = H[0]; B = H[1]; C = H[2]; D = H[3]; E = H[4];
+
+    for (t = 0; t < 20; t++) {
+        MB8_ROUND(t, MB8_CH, K0);
+    }
+    for (t = 20; t < 40; t++) {
+        MB8_ROUND(t, MB8_PAR, K1);
+    }
+    for (t = 40; t < 60; t++) {
+        MB8_ROUND(t, MB8_MAJ, K2);
+    }
+    for (t = 60; t < 80; t++) {
+        MB8_ROUND(t, MB8_PAR, K3);
+    }
+
+    H[0] = _mm256_add_epi32(H[0], A);
+    H[1] = _mm256_add_epi32(H[1], B);
+    H[2] = _mm256_add_epi32(H[2], C);
+    H[3] = _mm256_add_epi32(H[3], D);
+    H[4] = _mm256_add_epi32(H[4], E);
+
+    for (i = 0; i < 5; i++) {
+        uint32_t lane[8];
+        int j;
+        _mm256_storeu_si256((__m256i *)lane, H[i]);
+        for (j = 0; j < 8; j++) {
+            states[j][i] = lane[j];
+        }
+    }
+}
+
+/*
+ *  SHA1MultiCompressAVX512 -- one block for each of exactly sixteen states
+ */
+
+#define MB16_CH(b, c, d)  _mm512_ternarylogic_epi32(b, c, d, 0xCA)
+#define MB16_PAR(b, c, d) _mm512_ternarylogic_epi32(b, c, d, 0x96)
+#define MB16_MAJ(b, c, d) _mm512_ternarylogic_epi32(b, c, d, 0xE8)
+
+#define MB16_SCHEDULE(t) \
+    if ((t) >= 16) { \
+        W[(t) & 15] = _mm512_rol_epi32(_mm512_ternarylogic_epi32(W[((t) - 3) & 15], W[((t) - 8) & 15], \
+                                       _mm512_xor_si512(W[((t) - 14) & 15], W[(t) & 15]), 0x96), 1); \
+    }
+
+#define MB16_ROUND(t, F, K) \
+    MB16_SCHEDULE(t) \
+    temp = _mm512_add_epi32(_mm512_add_epi32(_mm512_rol_epi32(A, 5), F(B, C, D)), \
+                            _mm512_add_epi32(_mm512_add_epi32(E, W[(t) & 15]), K)); \
+    E = D; D = C; C = _mm512_rol_epi32(B, 30); B = A; A = temp
+
+OAUTH_TARGET("avx2,avx512f,avx512bw,avx512vl")
+static void SHA1MultiCompressAVX512(uint32_t *states[16], const uint8_t *blocks[16])
+{
+    const __m512i K0 = _mm512_set1_epi32(SHA1_MB_K0);
+    const __m512i K1 = _mm512_set1_epi32(SHA1_MB_K1);
+    const __m512i K2 = _mm512_set1_epi32(SHA1_MB_K2);
+    const __m512i K3 = _mm512_set1_epi32(SHA1_MB_K3);
+    __m512i W[16];
+    __m512i A, B, C, D, E, temp;
+    __m512i H[5];
+    __m256i lo[16], hi[16];
+    uint32_t lane[16];
+    int t, i, j;
+
+    /* lanes 0-7 go to the low, lanes 8-15 to the high 256 bits */
+    sha1_mb_load8(lo, blocks, 0);
+    sha1_mb_load8(lo + 8, blocks, 8);
+    sha1_mb_load8(hi, blocks + 8, 0);
+    sha1_mb_load8(hi + 8, blocks + 8, 8);
+
+    for (t = 0; t < 16; t++) {
+        W[t] = _mm512_inserti64x4(_mm512_castsi256_si512(lo[t]), hi[t], 1);
+    }
+
+    for (i = 0; i < 5; i++) {
+        for (j = 0; j < 16; j++) {
+            lane[j] = states[j][i];
+        }
+        H[i] = _mm512_loadu_si512(lane);
+    }
+
+    A = H[0]; B = H[1]; C = H[2]; D = H[3]; E = H[4];
+
+    for (t = 0; t < 20; t++) {
+        MB16_ROUND(t, MB16_CH, K0);
+    }
+    for (t = 20; t < 40; t++) {
+        MB16_ROUND(t, MB16_PAR, K1);
+    }
+    for (t = 40; t < 60; t++) {
+        MB16_ROUND(t, MB16_MAJ, K2);
+    }
+    for (t = 60; t < 80; t++) {
+        MB16_ROUND(t, MB16_PAR, K3);
+    }
+
+    H[0] = _mm512_add_epi32(H[0], A);
+    H[1] = _mm512_add_epi32(H[1], B);
+    H[2] = _mm512_add_epi32(H[2], C);
+    H[3] = _mm512_add_epi32(H[3], D);
+    H[4] = _mm512_add_epi32(H[4], E);
+
+    for (i = 0; i < 5; i++) {
+        _mm512_storeu_si512(lane, H[i]);
+        for (j = 0; j < 16; j++) {
+            states[j][i] = lane[j];
+        }
+    }
+}
+
+#endif // OAUTH_X86
+
+/* kernel for exactly 'width' lanes; NULL selects the single-stream fallback */
+typedef void (*SHA1MultiFunc)(uint32_t *states[], const uint8_t *blocks[]);
+
+static SHA1MultiFunc sha1_mb_kernel = NULL;
+static size_t sha1_mb_width = 0;
+
+static void SHA1MultiSelect(void)
+{
+    SHA1MultiFunc fn = NULL;
+    size_t width = 1;
+#ifdef OAUTH_X86
+    unsigned int features = oauth_cpu_features();
+
+    /* eight AVX2 lanes do not beat one SHA-NI stream, sixteen AVX-512 do */
+    if (features & OAUTH_CPU_AVX512) {
+        fn = SHA1MultiCompressAVX512;
+        width = 16;
+    } else if ((features & OAUTH_CPU_AVX2) && !(features & OAUTH_CPU_SHA)) {
+        fn = SHA1MultiCompressAVX2;
+        width = 8;
+    }
+#endif
+    sha1_mb_kernel = fn;
+    sha1_mb_width = width;
+}
+
+/*
+ *  SHA1MultiLanes
+ *
+ *  Description:
+ *      Returns the number of messages the selected kernel hashes per
+ *      pass (16, 8 or 1).  Batches smaller than this leave lanes idle.
+ *
+ */
+size_t SHA1MultiLanes(void)
+{
+    if (sha1_mb_width == 0) {
+        SHA1MultiSelect();
+    }
+
+    return sha1_mb_width;
+}
+
+/*
+ *  SHA1MultiCompress
+ *
+ *  Description:
+ *      Compress one 64 byte block into each of 'count' chaining states.
+ *      states[i] and blocks[i] belong to the same message; the states
+ *      must not alias each other.
+ *
+ *  Parameters:
+ *      states: [in/out]
+ *          'count' pointers to five word intermediate hashes.
+ *      blocks: [in]
+ *          'count' pointers to the next message block of each state.
+ *      count: [in]
+ *          Number of messages; any value, not only multiples of the
+ *          lane count.
+ *
+ */
+void SHA1MultiCompress(uint32_t *states[], const uint8_t *blocks[], size_t count)
+{
+    uint32_t *lane_states[SHA1_MB_MAX_LANES];
+    const uint8_t *lane_blocks[SHA1_MB_MAX_LANES];
+    uint32_t scratch[SHA1_MB_MAX_LANES][5];
+    size_t width, n, i;
+
+    width = SHA1MultiLanes();
+
+    if (sha1_mb_kernel == NULL) {
+        for (i = 0; i < count; i++) {
+            SHA1ProcessBlocks(states[i], blocks[i], 1);
+        }
+        return;
+    }
+
+    while (count > 0) {
+        n = (count < width) ? count : width;
+
+        for (i = 0; i < n; i++) {
+            lane_states[i] = states[i];
+            lane_blocks[i] = blocks[i];
+        }
+
+        /* idle lanes hash a copy of lane 0 into scratch state */
+        for (; i < width; i++) {
+            memcpy(scratch[i], states[0], sizeof(scratch[i]));
+            lane_states[i] = scratch[i];
+            lane_blocks[i] = blocks[0];
+        }
+
+        sha1_mb_kernel(lane_states, lane_blocks);
+
+        states += n;
+        blocks += n;
+        count -= n;
+    }
+}
+
+/*
+ * Per lane progress of one job in SHA1MultiBuffer.  The last one or two
+ * blocks (the partial block, padding and length) are built in 'tail'.
+ */
+typedef struct SHA1MultiLane {
+    SHA1MultiJob *job;
+    size_t block;           /* next block to compress                     */
+    size_t full_blocks;     /* blocks taken directly from job->data        */
+    size_t total_blocks;    /* full_blocks plus one or two tail blocks     */
+    uint8_t tail[128];
+} SHA1MultiLane;
+
+static void SHA1MultiLaneStart(SHA1MultiLane *lane, SHA1MultiJob *job)
+{
+    size_t rest, tail_len;
+    uint64_t bits;
+    int i;
+
+    lane->job = job;
+    lane->block = 0;
+    lane->full_blocks = job->length / 64;
+
+    rest = job->length - lane->full_blocks * 64;
+    tail_len = (rest < 56) ? 64 : 128;
+    lane->total_blocks = lane->full_blocks + tail_len / 64;
+
+    memset(lane->tail, 0, tail_len);
+    if (rest > 0) {
+        memcpy(lane->tail, job->data + lane->full_blocks * 64, rest);
+    }
+    lane->tail[rest] = 0x80;
+
+    bits = (job->prefix_length + (uint64_t)job->length) * 8;
+    for (i = 0; i < 8; i++) {
+        lane->tail[tail_len - 1 - i] = (uint8_t)(bits >> (8 * i));
+    }
+}
+
+static void SHA1MultiLaneFinish(SHA1MultiLane *lane)
+{
+    SHA1MultiJob *job = lane->job;
+    int i;
+
+    for (i = 0; i < SHA1HashSize; ++i) {
+        job->digest[i] = (uint8_t)(job->state[i >> 2] >> 8 * (3 - (i & 0x03)));
+    }
+
+    memset(lane->tail, 0, sizeof(lane->tail));
+    lane->job = NULL;
+}
+
+/*
+ *  SHA1MultiBuffer
+ *
+ *  Description:
+ *      Hash 'count' independent messages.  Each job starts from the
+ *      chaining state in job->state, which has already absorbed
+ *      job->prefix_length bytes (0 together with the standard initial
+ *      state for a plain hash, or 64 when continuing from an HMAC pad
+ *      block).  On return job->digest holds the SHA-1 value.
+ *
+ *      Jobs are fed to the lanes as they become free, so messages of
+ *      different lengths do not hold each other up.
+ *
+ *  Parameters:
+ *      jobs: [in/out]
+ *          The messages to hash.
+ *      count: [in]
+ *          The number of jobs.
+ *
+ */
+void SHA1MultiBuffer(SHA1MultiJob *jobs, size_t count)
+{
+    SHA1MultiLane lanes[SHA1_MB_MAX_LANES];
+    uint32_t *states[SHA1_MB_MAX_LANES];
+    const uint8_t *blocks[SHA1_MB_MAX_LANES];
+    SHA1MultiLane *lane;
+    size_t width, next = 0, active, i;
+
+    width = SHA1MultiLanes();
+
+    if (sha1_mb_kernel == NULL) {
+        for (i = 0; i < count; i++) {
+            lane = &lanes[0];
+            SHA1MultiLaneStart(lane, &jobs[i]);
+            SHA1ProcessBlocks(jobs[i].state, jobs[i].data, lane->full_blocks);
+            SHA1ProcessBlocks(jobs[i].state, lane->tail, lane->total_blocks - lane->full_blocks);
+            SHA1MultiLaneFinish(lane);
+        }
+        return;
+    }
+
+    for (i = 0; i < width; i++) {
+        lanes[i].job = NULL;
+    }
+
+    for (;;) {
+        active = 0;
+
+        for (i = 0; i < width; i++) {
+            lane = &lanes[i];
+
+            if (lane->job == NULL && next < count) {
+                SHA1MultiLaneStart(lane, &jobs[next++]);
+            }
+
+            if (lane->job == NULL) {
+                continue;
+            }
+
+            states[active] = lane->job->state;
+            if (lane->block < lane->full_blocks) {
+                blocks[active] = lane->job->data + lane->block * 64;
+            } else {
+                blocks[active] = lane->tail + (lane->block - lane->full_blocks) * 64;
+            }
+            active++;
+        }
+
+        if (active == 0) {
+            break;
+        }
+
+        SHA1MultiCompress(states, blocks, active);
+
+        for (i = 0; i < width; i++) {
+            lane = &lanes[i];
+            if (lane->job != NULL && ++lane->block == lane->total_blocks) {
+                SHA1MultiLaneFinish(lane);
+            }
+        }
+    }
+}
@@ -0,0 +1,211 @@
+/*
+ *  sha1_x86.c
+ *
+ *  Description:
+ *      x86 implementations of the SHA-1 compression function, selected
+ *      at runtime by SHA1ProcessBlocks in sha1.c.
+ *
+ *      SHA1CompressSHANI uses the SHA extensions (sha1rnds4,
+ *      sha1nexte, sha1msg1, sha1msg2), which run four rounds per
+ *      instruction.
+ *
+ *      SHA1CompressSSSE3 computes the message schedule four words at a
+ *      time in XMM registers (with the round constant already added)
+ *      and runs the rounds themselves in scalar code.
+ *
+ *      Both functions are compiled with a per-function target
+ *      attribute and must only be called when oauth_cpu_features()
+ *      reports the matching extension.
+ *
+ */
+
+#include "sha1.h"
+#include "cpu.h"
+
+#ifdef OAUTH_X86
+
+#include <immintrin.h>
+
+#define SHA1_ROL(bits,word)     (((word) << (bits)) | ((word) >> (32-(bits))))
+
+/*
+ *  SHA1CompressSSSE3
+ */
+
+/* W[t] = ROL1(W[t-3] ^ W[t-8] ^ W[t-14] ^ W[t-16]) for four t at a time.
+ * The lane for t+3 needs W[t] which is computed in the same step, so it is
+ * patched afterwards: ROL1(x ^ ROL1(y)) == ROL1(x) ^ ROL2(y). */
+OAUTH_TARGET("ssse3")
+static __inline __m128i sha1_ssse3_schedule(const uint32_t *W)
+{
+    __m128i x, r, fix;
+
+    x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(W - 8)),
+                      _mm_loadu_si128((const __m128i *)(W - 14)));
+    x = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)(W - 16)));
+    x = _mm_xor_si128(x, _mm_srli_si128(_mm_loadu_si128((const __m128i *)(W - 4)), 4));
+
+    r = _mm_or_si128(_mm_slli_epi32(x, 1), _mm_srli_epi32(x, 31));
+
+    fix = _mm_slli_si128(x, 12);
+    fix = _mm_or_si128(_mm_slli_epi32(fix, 2), _mm_srli_epi32(fix, 30));
+
+    return _mm_xor_si128(r, fix);
+}
+
+OAUTH_TARGET("ssse3")
+void SHA1CompressSSSE3(uint32_t state[5], const uint8_t *blocks, size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    const __m128i K[4] = {
+        _mm_set1_epi32(0x5A827999),
+        _mm_set1_epi32(0x6ED9EBA1),
+        _mm_set1_epi32((int)0x8F1BBCDC),
+        _mm_set1_epi32((int)0xCA62C1D6)
+    };
+    uint32_t W[80];     /* message schedule                    */
+    uint32_t WK[80];    /* message schedule + round constant   */
+    uint32_t A, B, C, D, E, temp;
+    __m128i w;
+    int t;
+
+    for (; nblocks > 0; nblocks--, blocks += 64) {
+        for (t = 0; t < 16; t += 4) {
+            w = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + t * 4)), bswap);
+            _mm_storeu_si128((__m128i *)(W + t), w);
+            _mm_storeu_si128((__m128i *)(WK + t), _mm_add_epi32(w, K[0]));
+        }
+
+        for (t = 16; t < 80; t += 4) {
+            w = sha1_ssse3_schedule(W + t);
+            _mm_storeu_si128((__m128i *)(W + t), w);
+            _mm_storeu_si128((__m128i *)(WK + t), _mm_add_epi32(w, K[t / 20]));
+        }
+
+        A = state[0];
+        B = state[1];
+        C = state[2];
+        D = state[3];
+        E = state[4];
+
+        for (t = 0; t < 20; t++) {
+            temp = SHA1_ROL(5,A) + (D ^ (B & (C ^ D))) + E + WK[t];
+            E = D; D = C; C = SHA1_ROL(30,B); B = A; A = temp;
+        }
+
+        for (t = 20; t < 40; t++) {
+            temp = SHA1_ROL(5,A) + (B ^ C ^ D) + E + WK[t];
+            E = D; D = C; C = SHA1_ROL(30,B); B = A; A = temp;
+        }
+
+        for (t = 40; t < 60; t++) {
+            temp = SHA1_ROL(5,A) + ((B & C) | (D & (B | C))) + E + WK[t];
+            E = D; D = C; C = SHA1_ROL(30,B); B = A; A = temp;
+        }
+
+        for (t = 60; t < 80; t++) {
+            temp = SHA1_ROL(5,A) + (B ^ C ^ D) + E + WK[t];
+            E = D; D = C; C = SHA1_ROL(30,B); B = A; A = temp;
+        }
+
+        state[0] += A;
+        state[1] += B;
+        state[2] += C;
+        state[3] += D;
+        state[4] += E;
+    }
+}
+
+/*
+ *  SHA1CompressSHANI
+ *
+ *  Rounds are processed in groups of four.  Group g uses message vector
+ *  M[g % 4]; while it runs, sha1msg1/xor/sha1msg2 advance the schedule for
+ *  the groups g+1 .. g+3.  E0/E1 alternate between holding the E value for
+ *  the current group and saving ABCD for the next one.
+ */
+
+/* rounds 4g .. 4g+3 */
+#define SHANI_ROUNDS(Ecur, Enext, Mg, f) \
+    Ecur = _mm_sha1nexte_epu32(Ecur, Mg); \
+    Enext = ABCD; \
+    ABCD = _mm_sha1rnds4_epu32(ABCD, Ecur, f)
+
+/* schedule: M[g+1] = msg2(M[g+1], M[g]) */
+#define SHANI_MSG2(Mg1, Mg) Mg1 = _mm_sha1msg2_epu32(Mg1, Mg)
+/* schedule: M[g+2] ^= M[g] */
+#define SHANI_XOR(Mg2, Mg)  Mg2 = _mm_xor_si128(Mg2, Mg)
+/* schedule: M[g+3] = msg1(M[g+3], M[g]) */
+#define SHANI_MSG1(Mg3, Mg) Mg3 = _mm_sha1msg1_epu32(Mg3, Mg)
+
+OAUTH_TARGET("sha,sse4.1")
+void SHA1CompressSHANI(uint32_t state[5], const uint8_t *blocks, size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+    __m128i ABCD, ABCD_SAVE, E0, E0_SAVE, E1;
+    __m128i M0, M1, M2, M3;
+
+    ABCD = _mm_loadu_si128((const __m128i *)state);
+    ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+    E0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+    for (; nblocks > 0; nblocks--, blocks += 64) {
+        ABCD_SAVE = ABCD;
+        E0_SAVE = E0;
+
+        /* rounds 0-3 */
+        M0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 0)), bswap);
+        E0 = _mm_add_epi32(E0, M0);
+        E1 = ABCD;
+        ABCD = _mm_sha1rnds4_epu32(ABCD, E0, 0);
+
+        /* rounds 4-7 */
+        M1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 16)), bswap);
+        SHANI_ROUNDS(E1, E0, M1, 0);
+        SHANI_MSG1(M0, M1);
+
+        /* rounds 8-11 */
+        M2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 32)), bswap);
+        SHANI_ROUNDS(E0, E1, M2, 0);
+        SHANI_MSG1(M1, M2);
+        SHANI_XOR(M0, M2);
+
+        /* rounds 12-15 */
+        M3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 48)), bswap);
+        SHANI_MSG2(M0, M3);
+        SHANI_ROUNDS(E1, E0, M3, 0);
+        SHANI_MSG1(M2, M3);
+        SHANI_XOR(M1, M3);
+
+        /* rounds 16-19 */
+        SHANI_MSG2(M1, M0); SHANI_ROUNDS(E0, E1, M0, 0); SHANI_MSG1(M3, M0); SHANI_XOR(M2, M0);
+        /* rounds 20-39 */
+        SHANI_MSG2(M2, M1); SHANI_ROUNDS(E1, E0, M1, 1); SHANI_MSG1(M0, M1); SHANI_XOR(M3, M1);
+        SHANI_MSG2(M3, M2); SHANI_ROUNDS(E0, E1, M2, 1); SHANI_MSG1(M1, M2); SHANI_XOR(M0, M2);
+        SHANI_MSG2(M0, M3); SHANI_ROUNDS(E1, E0, M3, 1); SHANI_MSG1(M2, M3); SHANI_XOR(M1, M3);
+        SHANI_MSG2(M1, M0); SHANI_ROUNDS(E0, E1, M0, 1); SHANI_MSG1(M3, M0); SHANI_XOR(M2, M0);
+        SHANI_MSG2(M2, M1); SHANI_ROUNDS(E1, E0, M1, 1); SHANI_MSG1(M0, M1); SHANI_XOR(M3, M1);
+        /* rounds 40-59 */
+        SHANI_MSG2(M3, M2); SHANI_ROUNDS(E0, E1, M2, 2); SHANI_MSG1(M1, M2); SHANI_XOR(M0, M2);
+        SHANI_MSG2(M0, M3); SHANI_ROUNDS(E1, E0, M3, 2); SHANI_MSG1(M2, M3); SHANI_XOR(M1, M3);
+        SHANI_MSG2(M1, M0); SHANI_ROUNDS(E0, E1, M0, 2); SHANI_MSG1(M3, M0); SHANI_XOR(M2, M0);
+        SHANI_MSG2(M2, M1); SHANI_ROUNDS(E1, E0, M1, 2); SHANI_MSG1(M0, M1); SHANI_XOR(M3, M1);
+        SHANI_MSG2(M3, M2); SHANI_ROUNDS(E0, E1, M2, 2); SHANI_MSG1(M1, M2); SHANI_XOR(M0, M2);
+        /* rounds 60-79 */
+        SHANI_MSG2(M0, M3); SHANI_ROUNDS(E1, E0, M3, 3); SHANI_MSG1(M2, M3); SHANI_XOR(M1, M3);
+        SHANI_MSG2(M1, M0); SHANI_ROUNDS(E0, E1, M0, 3); SHANI_MSG1(M3, M0); SHANI_XOR(M2, M0);
+        SHANI_MSG2(M2, M1); SHANI_ROUNDS(E1, E0, M1, 3);                     SHANI_XOR(M3, M1);
+        SHANI_MSG2(M3, M2); SHANI_ROUNDS(E0, E1, M2, 3);
+                            SHANI_ROUNDS(E1, E0, M3, 3);
+
+        /* add the saved state; E0 holds ABCD from before rounds 76-79 */
+        E0 = _mm_sha1nexte_epu32(E0, E0_SAVE);
+        ABCD = _mm_add_epi32(ABCD, ABCD_SAVE);
+    }
+
+    ABCD = _mm_shuffle_epi32(ABCD, 0x1B);
+    _mm_storeu_si128((__m128i *)state, ABCD);
+    state[4] = (uint32_t)_mm_extract_epi32(E0, 3);
+}
+
+#endif // OAUTH_X86
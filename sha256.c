@@ -0,0 +1,339 @@
+/*
+ *  sha256.c
+ *
+ *  Description:
+ *      This file implements the Secure Hashing Algorithm SHA-256 as
+ *      defined in FIPS PUB 180-4.  It follows the structure of sha1.c:
+ *      whole blocks are compressed straight from the caller's buffer
+ *      by a backend selected at runtime (see sha256_x86.c), and only
+ *      partial blocks are buffered in the context.
+ *
+ *  Caveats:
+ *      This implementation only works with messages with a length
+ *      that is a multiple of the size of an 8-bit character.
+ *
+ */
+
+#include <string.h>
+
+#include "sha256.h"
+#include "cpu.h"
+
+#define SHA256Rotr(bits,word)   (((word) >> (bits)) | ((word) << (32-(bits))))
+
+#define SHA256LoadBE32(p) \
+    (((uint32_t)(p)[0] << 24) | ((uint32_t)(p)[1] << 16) | ((uint32_t)(p)[2] << 8) | (uint32_t)(p)[3])
+
+#define SHA256Ch(x,y,z)     ((z) ^ ((x) & ((y) ^ (z))))
+#define SHA256Maj(x,y,z)    (((x) & (y)) | ((z) & ((x) | (y))))
+#define SHA256Sigma0(x)     (SHA256Rotr(2,x) ^ SHA256Rotr(13,x) ^ SHA256Rotr(22,x))
+#define SHA256Sigma1(x)     (SHA256Rotr(6,x) ^ SHA256Rotr(11,x) ^ SHA256Rotr(25,x))
+#define SHA256sigma0(x)     (SHA256Rotr(7,x) ^ SHA256Rotr(18,x) ^ ((x) >> 3))
+#define SHA256sigma1(x)     (SHA256Rotr(17,x) ^ SHA256Rotr(19,x) ^ ((x) >> 10))
+
+const uint32_t SHA256RoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* Local Function Prototyptes */
+static void SHA256PadMessage(SHA256Context *context);
+
+/*
+ *  SHA256Reset
+ *
+ *  Description:
+ *      This function will initialize the SHA256Context in preparation
+ *      for computing a new SHA-256 message digest.
+ *
+ *  Parameters:
+ *      context: [in/out]
+ *          The context to reset.
+ *
+ *  Returns:
+ *      sha Error Code.
+ *
+ */
+int SHA256Reset(SHA256Context *context)
+{
+    if (!context) {
+        return shaNull;
+    }
+
+    context->Length_Low             = 0;
+    context->Length_High            = 0;
+    context->Message_Block_Index    = 0;
+
+    context->Intermediate_Hash[0]   = 0x6a09e667;
+    context->Intermediate_Hash[1]   = 0xbb67ae85;
+    context->Intermediate_Hash[2]   = 0x3c6ef372;
+    context->Intermediate_Hash[3]   = 0xa54ff53a;
+    context->Intermediate_Hash[4]   = 0x510e527f;
+    context->Intermediate_Hash[5]   = 0x9b05688c;
+    context->Intermediate_Hash[6]   = 0x1f83d9ab;
+    context->Intermediate_Hash[7]   = 0x5be0cd19;
+
+    context->Computed   = 0;
+    context->Corrupted  = 0;
+
+    return shaSuccess;
+}
+
+/*
+ *  SHA256Result
+ *
+ *  Description:
+ *      This function will return the 256-bit message digest into the
+ *      Message_Digest array provided by the caller.
+ *
+ *  Parameters:
+ *      context: [in/out]
+ *          The context to use to calculate the SHA-256 hash.
+ *      Message_Digest: [out]
+ *          Where the digest is returned.
+ *
+ *  Returns:
+ *      sha Error Code.
+ *
+ */
+int SHA256Result(SHA256Context *context, uint8_t Message_Digest[SHA256HashSize])
+{
+    int i;
+
+    if (!context || !Message_Digest) {
+        return shaNull;
+    }
+
+    if (context->Corrupted) {
+        return context->Corrupted;
+    }
+
+    if (!context->Computed) {
+        SHA256PadMessage(context);
+        /* message may be sensitive, clear it out */
+        memset(context->Message_Block, 0, sizeof(context->Message_Block));
+
+        context->Length_Low = 0;    /* and clear length */
+        context->Length_High = 0;
+        context->Computed = 1;
+    }
+
+    for (i = 0; i < SHA256HashSize; ++i) {
+        Message_Digest[i] = (uint8_t)(context->Intermediate_Hash[i >> 2] >> 8 * (3 - (i & 0x03)));
+    }
+
+    return shaSuccess;
+}
+
+/*
+ *  SHA256Input
+ *
+ *  Description:
+ *      This function accepts an array of octets as the next portion
+ *      of the message.  Whole blocks are compressed directly from
+ *      'message_array'.
+ *
+ *  Parameters:
+ *      context: [in/out]
+ *          The SHA context to update
+ *      message_array: [in]
+ *          An array of characters representing the next portion of
+ *          the message.
+ *      length: [in]
+ *          The length of the message in message_array
+ *
+ *  Returns:
+ *      sha Error Code.
+ *
+ */
+int SHA256Input(SHA256Context *context, const uint8_t *message_array, size_t length)
+{
+    uint64_t total, bits;
+    size_t fill, nblocks;
+
+    if (length == 0) {
+        return shaSuccess;
+    }
+
+    if (context == NULL || message_array == NULL) {
+        return shaNull;
+    }
+
+    if (context->Computed != 0) {
+        context->Corrupted = shaStateError;
+        return shaStateError;
+    }
+
+    if (context->Corrupted != 0) {
+        return context->Corrupted;
+    }
+
+    /* the message length in bits must fit into 64 bits */
+    total = ((uint64_t)context->Length_High << 32) | context->Length_Low;
+    bits = (uint64_t)length << 3;
+    if ((uint64_t)length > (UINT64_MAX >> 3) || total + bits < total) {
+        context->Corrupted = shaInputTooLong;
+        return shaInputTooLong;
+    }
+    total += bits;
+    context->Length_Low = (uint32_t)total;
+    context->Length_High = (uint32_t)(total >> 32);
+
+    if (context->Message_Block_Index > 0) {
+        fill = 64 - context->Message_Block_Index;
+        if (length < fill) {
+            memcpy(context->Message_Block + context->Message_Block_Index, message_array, length);
+            context->Message_Block_Index += (int_least16_t)length;
+            return shaSuccess;
+        }
+
+        memcpy(context->Message_Block + context->Message_Block_Index, message_array, fill);
+        SHA256ProcessBlocks(context->Intermediate_Hash, context->Message_Block, 1);
+        context->Message_Block_Index = 0;
+        message_array += fill;
+        length -= fill;
+    }
+
+    nblocks = length / 64;
+    if (nblocks > 0) {
+        SHA256ProcessBlocks(context->Intermediate_Hash, message_array, nblocks);
+        message_array += nblocks * 64;
+        length -= nblocks * 64;
+    }
+
+    if (length > 0) {
+        memcpy(context->Message_Block, message_array, length);
+        context->Message_Block_Index = (int_least16_t)length;
+    }
+
+    return shaSuccess;
+}
+
+/* Selected compression backend, resolved on first use */
+static SHA256CompressFunc sha256_compress = NULL;
+static const char *sha256_backend = "generic";
+
+static void SHA256SelectBackend(void)
+{
+    SHA256CompressFunc fn = SHA256CompressGeneric;
+#ifdef OAUTH_X86
+    unsigned int features = oauth_cpu_features();
+
+    if ((features & (OAUTH_CPU_SHA | OAUTH_CPU_SSE41)) == (OAUTH_CPU_SHA | OAUTH_CPU_SSE41)) {
+        fn = SHA256CompressSHANI;
+        sha256_backend = "sha-ni";
+    } else if ((features & (OAUTH_CPU_AVX2 | OAUTH_CPU_BMI2)) == (OAUTH_CPU_AVX2 | OAUTH_CPU_BMI2)) {
+        fn = SHA256CompressAVX2;
+        sha256_backend = "avx2";
+    }
+#endif
+    sha256_compress = fn;
+}
+
+/*
+ *  SHA256ProcessBlocks
+ *
+ *  Description:
+ *      This function will run the compression function over 'nblocks'
+ *      consecutive 512 bit blocks with the backend selected on first
+ *      use.
+ *
+ *  Parameters:
+ *      state: [in/out]
+ *          The eight word intermediate hash.
+ *      blocks: [in]
+ *          The message blocks.
+ *      nblocks: [in]
+ *          The number of 64 byte blocks at 'blocks'.
+ *
+ */
+void SHA256ProcessBlocks(uint32_t state[8], const uint8_t *blocks, size_t nblocks)
+{
+    if (sha256_compress == NULL) {
+        SHA256SelectBackend();
+    }
+
+    sha256_compress(state, blocks, nblocks);
+}
+
+const char *SHA256BackendName(void)
+{
+    if (sha256_compress == NULL) {
+        SHA256SelectBackend();
+    }
+
+    return sha256_backend;
+}
+
+/*
+ *  SHA256CompressGeneric
+ *
+ *  Description:
+ *      Portable implementation of the compression function, with the
+ *      message schedule kept in a 16 word circular buffer.
+ *
+ */
+void SHA256CompressGeneric(uint32_t state[8], const uint8_t *blocks, size_t nblocks)
+{
+    uint32_t W[16];
+    uint32_t A, B, C, D, E, F, G, H, T1, T2;
+    int t;
+
+    for (; nblocks > 0; nblocks--, blocks += 64) {
+        A = state[0]; B = state[1]; C = state[2]; D = state[3];
+        E = state[4]; F = state[5]; G = state[6]; H = state[7];
+
+        for (t = 0; t < 64; t++) {
+            if (t < 16) {
+                W[t] = SHA256LoadBE32(blocks + t * 4);
+            } else {
+                W[t & 15] += SHA256sigma1(W[(t - 2) & 15]) + W[(t - 7) & 15] + SHA256sigma0(W[(t - 15) & 15]);
+            }
+
+            T1 = H + SHA256Sigma1(E) + SHA256Ch(E, F, G) + SHA256RoundConstants[t] + W[t & 15];
+            T2 = SHA256Sigma0(A) + SHA256Maj(A, B, C);
+            H = G; G = F; F = E; E = D + T1;
+            D = C; C = B; B = A; A = T1 + T2;
+        }
+
+        state[0] += A; state[1] += B; state[2] += C; state[3] += D;
+        state[4] += E; state[5] += F; state[6] += G; state[7] += H;
+    }
+}
+
+/*
+ *  SHA256PadMessage
+ *
+ *  Description:
+ *      Pad the message to a whole number of blocks: a '1' bit, zeros
+ *      and the 64 bit message length, then process the final block(s).
+ *
+ */
+static void SHA256PadMessage(SHA256Context *context)
+{
+    int i;
+
+    context->Message_Block[context->Message_Block_Index++] = 0x80;
+
+    if (context->Message_Block_Index > 56) {
+        memset(context->Message_Block + context->Message_Block_Index, 0, 64 - context->Message_Block_Index);
+        SHA256ProcessBlocks(context->Intermediate_Hash, context->Message_Block, 1);
+        context->Message_Block_Index = 0;
+    }
+
+    memset(context->Message_Block + context->Message_Block_Index, 0, 56 - context->Message_Block_Index);
+
+    for (i = 0; i < 4; i++) {
+        context->Message_Block[56 + i] = (uint8_t)(context->Length_High >> (24 - 8 * i));
+        context->Message_Block[60 + i] = (uint8_t)(context->Length_Low >> (24 - 8 * i));
+    }
+
+    SHA256ProcessBlocks(context->Intermediate_Hash, context->Message_Block, 1);
+    context->Message_Block_Index = 0;
+}
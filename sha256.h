@@ -0,0 +1,88 @@
+/*
+ *  sha256.h
+ *
+ *  Description:
+ *      This is the header file for code which implements the Secure
+ *      Hashing Algorithm SHA-256 as defined in FIPS PUB 180-4.
+ *
+ *      The interface mirrors sha1.h: SHA256Reset, SHA256Input and
+ *      SHA256Result over a context, plus a dispatched block
+ *      compression function.
+ *
+ *      Please read the file sha256.c for more information.
+ *
+ */
+
+#ifndef _SHA256_H_
+#define _SHA256_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef _SHA_enum_
+#define _SHA_enum_
+enum
+{
+    shaSuccess = 0,
+    shaNull,            /* Null pointer parameter */
+    shaInputTooLong,    /* input data too long */
+    shaStateError       /* called Input after Result */
+};
+#endif
+#define SHA256HashSize 32
+
+/*
+ *  This structure will hold context information for the SHA-256
+ *  hashing operation
+ */
+typedef struct SHA256Context
+{
+    uint32_t Intermediate_Hash[SHA256HashSize/4]; /* Message Digest */
+
+    uint32_t Length_Low;            /* Message length in bits      */
+    uint32_t Length_High;           /* Message length in bits      */
+
+                               /* Index into message block array   */
+    int_least16_t Message_Block_Index;
+    uint8_t Message_Block[64];      /* 512-bit message blocks      */
+
+    int Computed;               /* Is the digest computed?         */
+    int Corrupted;             /* Is the message digest corrupted? */
+} SHA256Context;
+
+/*
+ *  Function Prototypes
+ */
+
+int SHA256Reset(SHA256Context *context);
+int SHA256Input(SHA256Context *context, const uint8_t *message_array, size_t length);
+int SHA256Result(SHA256Context *context, uint8_t Message_Digest[SHA256HashSize]);
+
+/*
+ *  Block compression.
+ *
+ *  SHA256ProcessBlocks runs the compression function over 'nblocks'
+ *  consecutive 64 byte blocks.  It dispatches to SHA extensions, to
+ *  AVX2 (two blocks' message schedules per ymm register, BMI2 rounds)
+ *  or to the portable C code.  All backends produce identical results.
+ */
+typedef void (*SHA256CompressFunc)(uint32_t state[8], const uint8_t *blocks, size_t nblocks);
+
+void SHA256ProcessBlocks(uint32_t state[8], const uint8_t *blocks, size_t nblocks);
+const char *SHA256BackendName(void);
+
+void SHA256CompressGeneric(uint32_t state[8], const uint8_t *blocks, size_t nblocks);
+void SHA256CompressAVX2(uint32_t state[8], const uint8_t *blocks, size_t nblocks);
+void SHA256CompressSHANI(uint32_t state[8], const uint8_t *blocks, size_t nblocks);
+
+extern const uint32_t SHA256RoundConstants[64];
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,215 @@
+/*
+ *  sha256_x86.c
+ *
+ *  Description:
+ *      x86 implementations of the SHA-256 compression function, selected
+ *      at runtime by SHA256ProcessBlocks in sha256.c.
+ *
+ *      SHA256CompressSHANI uses the SHA extensions (sha256rnds2,
+ *      sha256msg1, sha256msg2).
+ *
+ *      SHA256CompressAVX2 expands the message schedules of two blocks
+ *      at once, one block per 128 bit half of a ymm register, and runs
+ *      the rounds in scalar code built for BMI2 (rorx).
+ *
+ *      Both functions must only be called when oauth_cpu_features()
+ *      reports the matching extensions.
+ *
+ */
+
+#include "sha256.h"
+#include "cpu.h"
+
+#ifdef OAUTH_X86
+
+#include <immintrin.h>
+
+#define SHA256_ROTR(bits,word)  (((word) >> (bits)) | ((word) << (32-(bits))))
+
+/*
+ *  SHA256CompressAVX2
+ */
+
+#define AVX2_ROTR(x, n)     _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define AVX2_SIGMA0(x)      _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTR(x, 7), AVX2_ROTR(x, 18)), _mm256_srli_epi32(x, 3))
+#define AVX2_SIGMA1(x)      _mm256_xor_si256(_mm256_xor_si256(AVX2_ROTR(x, 17), AVX2_ROTR(x, 19)), _mm256_srli_epi32(x, 10))
+
+/*
+ * Next four schedule words from the previous sixteen (X0 oldest).  All byte
+ * shifts and alignr work within 128 bit lanes, i.e. within one block.
+ * sigma1 of W[t-2..t+1] needs W[t], W[t+1] from this step: it is applied
+ * to the low pair first and then to the freshly computed words, using
+ * sigma1(0) == 0 to leave the other pair untouched.
+ */
+OAUTH_TARGET("avx2")
+static __inline __m256i sha256_avx2_schedule(__m256i X0, __m256i X1, __m256i X2, __m256i X3)
+{
+    __m256i w;
+
+    w = _mm256_add_epi32(X0, AVX2_SIGMA0(_mm256_alignr_epi8(X1, X0, 4)));
+    w = _mm256_add_epi32(w, _mm256_alignr_epi8(X3, X2, 4));
+    w = _mm256_add_epi32(w, AVX2_SIGMA1(_mm256_srli_si256(X3, 8)));
+    w = _mm256_add_epi32(w, AVX2_SIGMA1(_mm256_slli_si256(w, 8)));
+
+    return w;
+}
+
+#define SHA256_ROUND(a, b, c, d, e, f, g, h, wk) \
+    do { \
+        uint32_t T1 = h + (SHA256_ROTR(6, e) ^ SHA256_ROTR(11, e) ^ SHA256_ROTR(25, e)) + (g ^ (e & (f ^ g))) + (wk); \
+        uint32_t T2 = (SHA256_ROTR(2, a) ^ SHA256_ROTR(13, a) ^ SHA256_ROTR(22, a)) + ((a & b) | (c & (a | b))); \
+        d += T1; \
+        h = T1 + T2; \
+    } while (0)
+
+OAUTH_TARGET("avx2,bmi2")
+static void sha256_avx2_rounds(uint32_t state[8], const uint32_t WK[64])
+{
+    uint32_t A = state[0], B = state[1], C = state[2], D = state[3];
+    uint32_t E = state[4], F = state[5], G = state[6], H = state[7];
+    int t;
+
+    for (t = 0; t < 64; t += 8) {
+        SHA256_ROUND(A, B, C, D, E, F, G, H, WK[t + 0]);
+        SHA256_ROUND(H, A, B, C, D, E, F, G, WK[t + 1]);
+        SHA256_ROUND(G, H, A, B, C, D, E, F, WK[t + 2]);
+        SHA256_ROUND(F, G, H, A, B, C, D, E, WK[t + 3]);
+        SHA256_ROUND(E, F, G, H, A, B, C, D, WK[t + 4]);
+        SHA256_ROUND(D, E, F, G, H, A, B, C, WK[t + 5]);
+        SHA256_ROUND(C, D, E, F, G, H, A, B, WK[t + 6]);
+        SHA256_ROUND(B, C, D, E, F, G, H, A, WK[t + 7]);
+    }
+
+    state[0] += A; state[1] += B; state[2] += C; state[3] += D;
+    state[4] += E; state[5] += F; state[6] += G; state[7] += H;
+}
+
+OAUTH_TARGET("avx2,bmi2")
+void SHA256CompressAVX2(uint32_t state[8], const uint8_t *blocks, size_t nblocks)
+{
+    const __m256i bswap = _mm256_set_epi8(
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    uint32_t WK0[64], WK1[64];
+    __m256i X[4], k, w;
+    const uint8_t *second;
+    int t;
+
+    while (nblocks > 0) {
+        /* with an odd count the last block is expanded twice, the copy is unused */
+        second = (nblocks > 1) ? blocks + 64 : blocks;
+
+        for (t = 0; t < 4; t++) {
+            X[t] = _mm256_shuffle_epi8(_mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(blocks + t * 16))),
+                _mm_loadu_si128((const __m128i *)(second + t * 16)), 1), bswap);
+        }
+
+        for (t = 0; t < 64; t += 4) {
+            if (t < 16) {
+                w = X[t / 4];
+            } else {
+                w = sha256_avx2_schedule(X[0], X[1], X[2], X[3]);
+                X[0] = X[1]; X[1] = X[2]; X[2] = X[3]; X[3] = w;
+            }
+
+            k = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(SHA256RoundConstants + t)));
+            w = _mm256_add_epi32(w, k);
+            _mm_storeu_si128((__m128i *)(WK0 + t), _mm256_castsi256_si128(w));
+            _mm_storeu_si128((__m128i *)(WK1 + t), _mm256_extracti128_si256(w, 1));
+        }
+
+        sha256_avx2_rounds(state, WK0);
+        if (nblocks > 1) {
+            sha256_avx2_rounds(state, WK1);
+            blocks += 128;
+            nblocks -= 2;
+        } else {
+            blocks += 64;
+            nblocks -= 1;
+        }
+    }
+}
+
+/*
+ *  SHA256CompressSHANI
+ *
+ *  The state is kept as ABEF/CDGH as sha256rnds2 expects.  Each group g
+ *  of four rounds uses message vector M[g % 4]; sha256msg1/sha256msg2
+ *  extend the schedule for the following groups in between.
+ */
+
+/* rounds 4g .. 4g+3 */
+#define SHANI_QROUND_A(Mg, g) \
+    MSG = _mm_add_epi32(Mg, _mm_loadu_si128((const __m128i *)(SHA256RoundConstants + 4 * (g)))); \
+    STATE1 = _mm_sha256rnds2_epu32(STATE1, STATE0, MSG)
+#define SHANI_QROUND_B() \
+    MSG = _mm_shuffle_epi32(MSG, 0x0E); \
+    STATE0 = _mm_sha256rnds2_epu32(STATE0, STATE1, MSG)
+
+/* schedule: M[g+1] = msg2(M[g+1] + (M[g-1]:M[g] >> 32), M[g]) */
+#define SHANI_MSG2(Mg1, Mg, Mgm1) \
+    TMP = _mm_alignr_epi8(Mg, Mgm1, 4); \
+    Mg1 = _mm_add_epi32(Mg1, TMP); \
+    Mg1 = _mm_sha256msg2_epu32(Mg1, Mg)
+/* schedule: M[g-1] = msg1(M[g-1], M[g]) */
+#define SHANI_MSG1(Mgm1, Mg) Mgm1 = _mm_sha256msg1_epu32(Mgm1, Mg)
+
+OAUTH_TARGET("sha,sse4.1")
+void SHA256CompressSHANI(uint32_t state[8], const uint8_t *blocks, size_t nblocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i STATE0, STATE1, ABEF_SAVE, CDGH_SAVE;
+    __m128i MSG, TMP, M0, M1, M2, M3;
+
+    TMP = _mm_loadu_si128((const __m128i *)&state[0]);
+    STATE1 = _mm_loadu_si128((const __m128i *)&state[4]);
+
+    TMP = _mm_shuffle_epi32(TMP, 0xB1);             /* CDAB */
+    STATE1 = _mm_shuffle_epi32(STATE1, 0x1B);       /* EFGH */
+    STATE0 = _mm_alignr_epi8(TMP, STATE1, 8);       /* ABEF */
+    STATE1 = _mm_blend_epi16(STATE1, TMP, 0xF0);    /* CDGH */
+
+    for (; nblocks > 0; nblocks--, blocks += 64) {
+        ABEF_SAVE = STATE0;
+        CDGH_SAVE = STATE1;
+
+        M0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 0)), bswap);
+        M1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 16)), bswap);
+        M2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 32)), bswap);
+        M3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 48)), bswap);
+
+        /* rounds 0-15 */
+        SHANI_QROUND_A(M0, 0);                      SHANI_QROUND_B();
+        SHANI_QROUND_A(M1, 1);                      SHANI_QROUND_B(); SHANI_MSG1(M0, M1);
+        SHANI_QROUND_A(M2, 2);                      SHANI_QROUND_B(); SHANI_MSG1(M1, M2);
+        SHANI_QROUND_A(M3, 3);  SHANI_MSG2(M0, M3, M2); SHANI_QROUND_B(); SHANI_MSG1(M2, M3);
+        /* rounds 16-47 */
+        SHANI_QROUND_A(M0, 4);  SHANI_MSG2(M1, M0, M3); SHANI_QROUND_B(); SHANI_MSG1(M3, M0);
+        SHANI_QROUND_A(M1, 5);  SHANI_MSG2(M2, M1, M0); SHANI_QROUND_B(); SHANI_MSG1(M0, M1);
+        SHANI_QROUND_A(M2, 6);  SHANI_MSG2(M3, M2, M1); SHANI_QROUND_B(); SHANI_MSG1(M1, M2);
+        SHANI_QROUND_A(M3, 7);  SHANI_MSG2(M0, M3, M2); SHANI_QROUND_B(); SHANI_MSG1(M2, M3);
+        SHANI_QROUND_A(M0, 8);  SHANI_MSG2(M1, M0, M3); SHANI_QROUND_B(); SHANI_MSG1(M3, M0);
+        SHANI_QROUND_A(M1, 9);  SHANI_MSG2(M2, M1, M0); SHANI_QROUND_B(); SHANI_MSG1(M0, M1);
+        SHANI_QROUND_A(M2, 10); SHANI_MSG2(M3, M2, M1); SHANI_QROUND_B(); SHANI_MSG1(M1, M2);
+        SHANI_QROUND_A(M3, 11); SHANI_MSG2(M0, M3, M2); SHANI_QROUND_B(); SHANI_MSG1(M2, M3);
+        /* rounds 48-63 */
+        SHANI_QROUND_A(M0, 12); SHANI_MSG2(M1, M0, M3); SHANI_QROUND_B(); SHANI_MSG1(M3, M0);
+        SHANI_QROUND_A(M1, 13); SHANI_MSG2(M2, M1, M0); SHANI_QROUND_B();
+        SHANI_QROUND_A(M2, 14); SHANI_MSG2(M3, M2, M1); SHANI_QROUND_B();
+        SHANI_QROUND_A(M3, 15);                      SHANI_QROUND_B();
+
+        STATE0 = _mm_add_epi32(STATE0, ABEF_SAVE);
+        STATE1 = _mm_add_epi32(STATE1, CDGH_SAVE);
+    }
+
+    TMP = _mm_shuffle_epi32(STATE0, 0x1B);          /* FEBA */
+    STATE1 = _mm_shuffle_epi32(STATE1, 0xB1);       /* DCHG */
+    STATE0 = _mm_blend_epi16(TMP, STATE1, 0xF0);    /* DCBA */
+    STATE1 = _mm_alignr_epi8(STATE1, TMP, 8);       /* HGFE */
+
+    _mm_storeu_si128((__m128i *)&state[0], STATE0);
+    _mm_storeu_si128((__m128i *)&state[4], STATE1);
+}
+
+#endif // OAUTH_X86
@@ -0,0 +1,136 @@
+/* test_replay.c -- oauth_replay_check semantics and concurrency
+ *
+ * Seen/stale answers, fresh nonces over a long simulated run through a
+ * small cache, generations far apart in one ring table, and threads
+ * inserting the same nonces at once: each must be accepted exactly once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "oauth.h"
+
+#define PER_THREAD 200000	///< nonces every thread inserts in the concurrent test
+#define MAX_THREADS 8
+#define NOW 1700000000L
+
+static int fails = 0;
+
+#define CHECK(expr, want) do { \
+	long got_ = (long)(expr); \
+	if (got_ != (long)(want)) { \
+		printf("FAIL line %d: %s = %ld, want %ld\n", __LINE__, #expr, got_, (long)(want)); \
+		fails++; \
+	} \
+} while (0)
+
+static void test_basic(void)
+{
+	OAuthReplayCache *cache = oauth_replay_cache_new(1000, 300);
+
+	CHECK(oauth_replay_check(cache, "ck", 1000, "abc", 1000), OA_REPLAY_OK);
+	CHECK(oauth_replay_check(cache, "ck", 1000, "abc", 1000), OA_REPLAY_SEEN);
+	CHECK(oauth_replay_check(cache, "ck2", 1000, "abc", 1000), OA_REPLAY_OK);
+	CHECK(oauth_replay_check(cache, "ck", 1001, "abc", 1000), OA_REPLAY_OK);
+	CHECK(oauth_replay_check(cache, "ck", 1000, "abc", 1300), OA_REPLAY_SEEN);
+	CHECK(oauth_replay_check(cache, "ck", 1000, "abc", 1301), OA_REPLAY_STALE);
+	CHECK(oauth_replay_check(cache, "ck", 1400, "abc", 1000), OA_REPLAY_STALE);
+	CHECK(oauth_replay_check(cache, "ck", -1, "abc", 0), OA_REPLAY_STALE);
+	oauth_replay_cache_free(cache);
+}
+
+/*
+ * 200k simulated seconds at 3 nonces a second, about 1800 in the window:
+ * memory is fixed, yet fresh nonces keep going in
+ */
+static void test_long_run(void)
+{
+	OAuthReplayCache *cache = oauth_replay_cache_new(2000, 300);
+	long t, fresh = 0, replay = 0;
+	char nonce[32];
+	int j;
+
+	for (t = 2000; t < 200000; t++) {
+		for (j = 0; j < 3; j++) {
+			snprintf(nonce, sizeof(nonce), "%ld/%d", t, j);
+			if (oauth_replay_check(cache, "ck", t, nonce, t) != OA_REPLAY_OK) fresh++;
+		}
+		snprintf(nonce, sizeof(nonce), "%ld/%d", t - 250, 0);
+		if (t > 2300 && oauth_replay_check(cache, "ck", t - 250, nonce, t) != OA_REPLAY_SEEN) replay++;
+	}
+	CHECK(fresh, 0);
+	CHECK(replay, 0);
+	oauth_replay_cache_free(cache);
+}
+
+/*
+ * generations 65536 apart share a ring table; the old entries must not
+ * count as current ones (they did with a 16 bit tag)
+ */
+static void test_far_generations(void)
+{
+	OAuthReplayCache *cache = oauth_replay_cache_new(1400, 0);
+	long t, ok = 0;
+	char nonce[32];
+	int i, k;
+
+	for (k = 0, t = 1000; k < 4; k++, t += 65536) {
+		for (i = 0, ok = 0; i < 200; i++) {
+			snprintf(nonce, sizeof(nonce), "%d/%d", k, i);
+			if (oauth_replay_check(cache, "ck", t, nonce, t) == OA_REPLAY_OK) ok++;
+		}
+		CHECK(ok, 200);
+	}
+	oauth_replay_cache_free(cache);
+}
+
+static OAuthReplayCache *shared;
+static long accepted[MAX_THREADS];
+
+/* every thread inserts the same nonces, each starting somewhere else */
+static void *insert_all(void *arg)
+{
+	long id = (long)arg, ok = 0;
+	char nonce[32];
+	int i;
+
+	for (i = 0; i < PER_THREAD; i++) {
+		snprintf(nonce, sizeof(nonce), "n%ld", (i + id * 7919) % PER_THREAD);
+		if (oauth_replay_check(shared, "ck", NOW, nonce, NOW) == OA_REPLAY_OK) ok++;
+	}
+	accepted[id] = ok;
+	return NULL;
+}
+
+static void test_threads(void)
+{
+	pthread_t tid[MAX_THREADS];
+	long n, total;
+	int i;
+
+	for (n = 2; n <= MAX_THREADS; n *= 2) {
+		// all at one timestamp, so one generation takes them: it gets
+		// 2/7 of the capacity in slots
+		shared = oauth_replay_cache_new(PER_THREAD * 7, 300);
+		for (i = 0; i < n; i++) pthread_create(&tid[i], NULL, insert_all, (void *)(long)i);
+		for (i = 0, total = 0; i < n; i++) {
+			pthread_join(tid[i], NULL);
+			total += accepted[i];
+		}
+		CHECK(total, PER_THREAD);
+		oauth_replay_cache_free(shared);
+	}
+}
+
+int main(void)
+{
+	test_basic();
+	test_long_run();
+	test_far_generations();
+	test_threads();
+
+	printf(fails ? "%d FAILED\n" : "all passed\n", fails);
+	return fails != 0;
+}
@@ -0,0 +1,143 @@
+/* test_signer.c -- OAuthSigner against the one-shot entry points
+ *
+ * With oauth_nonce and oauth_timestamp given in the URL, signing is
+ * deterministic: a signer must give the same requests as oauth_sign_url2
+ * for every method but RSA, also when four threads share it, and a NULL
+ * consumer key must be sent empty everywhere.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "oauth.h"
+
+/* exported by oauth.c, not declared in oauth.h */
+void oauth_add_protocol(int *argcp, char ***argvp, OAuthMethod method, const char *c_key, const char *t_key);
+
+#define THREADS 4
+#define ROUNDS 20000	///< signatures per thread
+
+static int fails = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("FAIL line %d: %s\n", __LINE__, #cond); \
+		fails++; \
+	} \
+} while (0)
+
+static const char *urls[THREADS] = {
+	"http://a.example.com/x?oauth_nonce=1&oauth_timestamp=2&a=1",
+	"http://b.example.com/?oauth_nonce=3&oauth_timestamp=4&b=2&c",
+	"http://c.example.com/p?oauth_nonce=5&oauth_timestamp=6",
+	"http://d.example.com/?oauth_nonce=7&oauth_timestamp=8&z=%20&y=a+b"
+};
+
+static OAuthSigner *shared;
+static char *expected[THREADS];
+static int mismatches[THREADS];
+
+static void *sign_shared(void *arg)
+{
+	long k = (long)arg;
+	char *url;
+	int i;
+
+	for (i = 0; i < ROUNDS; i++) {
+		url = oauth_signer_sign_url(shared, urls[k], NULL, NULL);
+		if (strcmp(url, expected[k]) != 0) mismatches[k]++;
+		free(url);
+	}
+	return NULL;
+}
+
+/* the signer's output equals oauth_sign_url2's, GET and POST, with and without token */
+static void test_same_output(OAuthMethod method)
+{
+	OAuthSigner *s;
+	char *a, *b, *post_a, *post_b;
+	int k, token;
+
+	for (token = 0; token < 2; token++) {
+		s = oauth_signer_new(method, "ck", "cs", token ? "tk" : NULL, token ? "ts" : NULL);
+		for (k = 0; k < THREADS; k++) {
+			a = oauth_sign_url2(urls[k], NULL, method, NULL, "ck", "cs", token ? "tk" : NULL, token ? "ts" : NULL);
+			b = oauth_signer_sign_url(s, urls[k], NULL, NULL);
+			CHECK(strcmp(a, b) == 0);
+			free(a);
+			free(b);
+
+			post_a = post_b = NULL;
+			a = oauth_sign_url2(urls[k], &post_a, method, NULL, "ck", "cs", token ? "tk" : NULL, token ? "ts" : NULL);
+			b = oauth_signer_sign_url(s, urls[k], &post_b, NULL);
+			CHECK(strcmp(a, b) == 0 && strcmp(post_a, post_b) == 0);
+			free(a);
+			free(b);
+			free(post_a);
+			free(post_b);
+		}
+		oauth_signer_free(s);
+	}
+}
+
+/* one signer, THREADS threads signing with it at once */
+static void test_threads(OAuthMethod method)
+{
+	pthread_t tid[THREADS];
+	long k;
+
+	shared = oauth_signer_new(method, "ck", "cs", "tk", "ts");
+	for (k = 0; k < THREADS; k++) {
+		expected[k] = oauth_sign_url2(urls[k], NULL, method, NULL, "ck", "cs", "tk", "ts");
+		mismatches[k] = 0;
+	}
+	for (k = 0; k < THREADS; k++) pthread_create(&tid[k], NULL, sign_shared, (void *)k);
+	for (k = 0; k < THREADS; k++) {
+		pthread_join(tid[k], NULL);
+		CHECK(mismatches[k] == 0);
+		free(expected[k]);
+	}
+	oauth_signer_free(shared);
+}
+
+/* a NULL consumer key is sent as an empty oauth_consumer_key */
+static void test_null_key(void)
+{
+	OAuthSigner *s = oauth_signer_new(OA_HMAC, NULL, "cs", NULL, NULL);
+	char **argv = NULL, *url;
+	int argc, i, found = 0;
+
+	url = oauth_signer_sign_url(s, urls[0], NULL, NULL);
+	CHECK(strstr(url, "oauth_consumer_key=&") != NULL);
+	free(url);
+	oauth_signer_free(s);
+
+	url = oauth_sign_url2(urls[0], NULL, OA_HMAC, NULL, NULL, "cs", NULL, NULL);
+	CHECK(strstr(url, "oauth_consumer_key=&") != NULL);
+	free(url);
+
+	argc = oauth_split_url_parameters(urls[0], &argv);
+	oauth_add_protocol(&argc, &argv, OA_HMAC, NULL, NULL);
+	for (i = 0; i < argc; i++) {
+		if (!strcmp(argv[i], "oauth_consumer_key=")) found++;
+	}
+	CHECK(found == 1);
+	oauth_free_array(&argc, &argv);
+}
+
+int main(void)
+{
+	static const OAuthMethod methods[] = { OA_HMAC, OA_HMAC_SHA256, OA_PLAINTEXT };
+	size_t m;
+
+	for (m = 0; m < sizeof(methods) / sizeof(methods[0]); m++) {
+		test_same_output(methods[m]);
+		test_threads(methods[m]);
+	}
+	test_null_key();
+
+	printf(fails ? "%d FAILED\n" : "all passed\n", fails);
+	return fails != 0;
+}
@@ -0,0 +1,180 @@
+/* test_verify.c -- oauth_verify_request against the signer
+ *
+ * Requests signed by oauth_sign_url2 and oauth_sign_array2_process must
+ * verify in every place the parameters can travel (query string,
+ * Authorization header, form body), and any change to them must not.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "oauth.h"
+
+static int fails = 0;
+
+#define CHECK(expr, want) do { \
+	int got_ = (expr); \
+	if (got_ != (want)) { \
+		printf("FAIL line %d: %s = %d, want %d\n", __LINE__, #expr, got_, (want)); \
+		fails++; \
+	} \
+} while (0)
+
+static const char *c_secret = "kd94hf93k423kf44";
+static const char *t_secret = "pfkkdhi9sl3r4s00";
+
+/* all parameters in the query string */
+static void test_query(OAuthMethod method)
+{
+	const char *url = "http://photos.example.net:80/photos?file=vacation%20pic.jpg&size=original"
+		"&x=a+b&flag&e=&utf=%E2%82%AC";
+	char *signed_url = oauth_sign_url2(url, NULL, method, "GET", "dpf43f3p2l4k3l03", c_secret,
+		"nnch734d00sl2jdk", t_secret);
+
+	CHECK(oauth_verify_request("GET", signed_url, NULL, NULL, 0, c_secret, t_secret), OA_VERIFY_OK);
+	CHECK(oauth_verify_request("get", signed_url, NULL, NULL, 0, c_secret, t_secret), OA_VERIFY_OK);
+	CHECK(oauth_verify_request("POST", signed_url, NULL, NULL, 0, c_secret, t_secret), OA_VERIFY_BAD_SIGNATURE);
+	CHECK(oauth_verify_request("GET", signed_url, NULL, NULL, 0, c_secret, "wrong"), OA_VERIFY_BAD_SIGNATURE);
+	free(signed_url);
+}
+
+/* oauth_ parameters in the Authorization header, the others in the URL */
+static void test_header(OAuthMethod method)
+{
+	const char *url = "http://photos.example.net/photos?file=vacation.jpg&size=original";
+	char **argv = NULL, *params, *query, *tampered, header[2048];
+	int argc = oauth_split_url_parameters(url, &argv);
+
+	oauth_sign_array2_process(&argc, &argv, NULL, method, "GET", "dpf43f3p2l4k3l03", c_secret,
+		"nnch734d00sl2jdk", t_secret);
+	params = oauth_serialize_url_sep(argc, 1, argv, ", ", 6);
+	query = oauth_serialize_url_sep(argc, 0, argv, "&", 1);
+	snprintf(header, sizeof(header), "OAuth realm=\"Photos\", %s", params);
+
+	CHECK(oauth_verify_request("GET", query, header, NULL, 0, c_secret, t_secret), OA_VERIFY_OK);
+
+	tampered = strdup(query);
+	tampered[strlen(tampered) - 1] ^= 1;
+	CHECK(oauth_verify_request("GET", tampered, header, NULL, 0, c_secret, t_secret), OA_VERIFY_BAD_SIGNATURE);
+
+	CHECK(oauth_verify_request("GET", query, "Basic abc", NULL, 0, c_secret, t_secret), OA_VERIFY_MALFORMED);
+	CHECK(oauth_verify_request("GET", query, "OAuth a=\"b", NULL, 0, c_secret, t_secret), OA_VERIFY_MALFORMED);
+	CHECK(oauth_verify_request("GET", query, NULL, NULL, 0, c_secret, t_secret), OA_VERIFY_MALFORMED);
+
+	free(tampered);
+	free(params);
+	free(query);
+	oauth_free_array(&argc, &argv);
+}
+
+/* parameters in a form body */
+static void test_body(OAuthMethod method)
+{
+	char *postargs = NULL;
+	char *url = oauth_sign_url2("https://api.example.com/1/update.json?status=hello%20world%21&n=1",
+		&postargs, method, NULL, "ck", c_secret, "tk", t_secret);
+	size_t len = strlen(postargs);
+
+	CHECK(oauth_verify_request("POST", url, NULL, postargs, len, c_secret, t_secret), OA_VERIFY_OK);
+	CHECK(oauth_verify_request("POST", url, NULL, postargs, len - 1, c_secret, t_secret), OA_VERIFY_BAD_SIGNATURE);
+	free(url);
+	free(postargs);
+}
+
+/*
+ * only the signer's own base64 of the digest is accepted: not without
+ * padding, with a changed unused bit, with whitespace or extra padding
+ */
+static void test_canonical(OAuthMethod method)
+{
+	char *url = oauth_sign_url2("http://x.example/p?a=1", NULL, method, "GET", "ck", c_secret, "tk", t_secret);
+	char *sig = strstr(url, "oauth_signature=") + 16;
+	char *end = sig + strcspn(sig, "&");
+	char *pad = strstr(sig, "%3D");
+	char buf[2048];
+
+	CHECK(oauth_verify_request("GET", url, NULL, NULL, 0, c_secret, t_secret), OA_VERIFY_OK);
+
+	// no padding
+	snprintf(buf, sizeof(buf), "%.*s%s", (int)(pad - url), url, end);
+	CHECK(oauth_verify_request("GET", buf, NULL, NULL, 0, c_secret, t_secret), OA_VERIFY_BAD_SIGNATURE);
+
+	// lowest unused bit of the last char set
+	snprintf(buf, sizeof(buf), "%s", url);
+	buf[pad - url - 1] ^= 1;
+	CHECK(oauth_verify_request("GET", buf, NULL, NULL, 0, c_secret, t_secret), OA_VERIFY_BAD_SIGNATURE);
+
+	// leading space
+	snprintf(buf, sizeof(buf), "%.*s%%20%s", (int)(sig - url), url, sig);
+	CHECK(oauth_verify_request("GET", buf, NULL, NULL, 0, c_secret, t_secret), OA_VERIFY_BAD_SIGNATURE);
+
+	// one '=' too many
+	snprintf(buf, sizeof(buf), "%.*s%%3D%s", (int)(end - url), url, end);
+	CHECK(oauth_verify_request("GET", buf, NULL, NULL, 0, c_secret, t_secret), OA_VERIFY_BAD_SIGNATURE);
+
+	free(url);
+}
+
+/* more parameters than OAUTH_VERIFY_MAX_PARAMS, and more than 4 KB of them */
+static void test_large(OAuthMethod method)
+{
+	static const int counts[] = { 1, OAUTH_VERIFY_MAX_PARAMS - 1, OAUTH_VERIFY_MAX_PARAMS,
+		OAUTH_VERIFY_MAX_PARAMS + 1, 200, 1000 };
+	static char url[64 << 10];
+	char *signed_url, *postargs, param[64];
+	size_t i;
+	int n, post;
+
+	for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+		strcpy(url, "http://ex.com/x?");
+		for (n = 0; n < counts[i]; n++) {
+			snprintf(param, sizeof(param), "%sp%d=v%%20%d%s", n ? "&" : "", n * 7919 % 1000, n,
+				n % 5 ? "" : "%E2%82%AC%E2%82%AC%E2%82%AC");
+			strcat(url, param);
+		}
+
+		for (post = 0; post < 2; post++) {
+			postargs = NULL;
+			signed_url = oauth_sign_url2(url, post ? &postargs : NULL, method, post ? "POST" : "GET",
+				"ck", c_secret, "tk", t_secret);
+			CHECK(oauth_verify_request(post ? "POST" : "GET", signed_url, NULL, postargs,
+				postargs ? strlen(postargs) : 0, c_secret, t_secret), OA_VERIFY_OK);
+			CHECK(oauth_verify_request(post ? "POST" : "GET", signed_url, NULL, postargs,
+				postargs ? strlen(postargs) : 0, c_secret, "wrong"), OA_VERIFY_BAD_SIGNATURE);
+			free(signed_url);
+			free(postargs);
+		}
+	}
+}
+
+int main(void)
+{
+	char secret[2048];
+	int m;
+
+	for (m = 0; m < 2; m++) {
+		OAuthMethod method = m ? OA_HMAC_SHA256 : OA_HMAC;
+
+		test_query(method);
+		test_header(method);
+		test_body(method);
+		test_canonical(method);
+		test_large(method);
+	}
+
+	CHECK(oauth_verify_request("GET", "http://x/?oauth_signature_method=PLAINTEXT&oauth_signature=a",
+		NULL, NULL, 0, "a", NULL), OA_VERIFY_UNSUPPORTED);
+	CHECK(oauth_verify_request("GET", "http://x/?oauth_signature_method=HMAC-SHA1&oauth_signature=a&oauth_signature=b",
+		NULL, NULL, 0, "a", NULL), OA_VERIFY_MALFORMED);
+	CHECK(oauth_verify_request("GET", "http://x/?oauth_signature_method=HMAC-SHA1",
+		NULL, NULL, 0, "a", NULL), OA_VERIFY_MALFORMED);
+
+	memset(secret, 'a', sizeof(secret) - 1);
+	secret[sizeof(secret) - 1] = '\0';
+	CHECK(oauth_verify_request("GET", "http://x/?oauth_signature_method=HMAC-SHA1&oauth_signature=a",
+		NULL, NULL, 0, secret, NULL), OA_VERIFY_TOO_LARGE);
+
+	printf(fails ? "%d FAILED\n" : "all passed\n", fails);
+	return fails != 0;
+}
@@ -28,6 +28,64 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "oauth.h"
+#include "xmalloc.h"
+
+/*
+ * Every allocation of the library goes through the allocator of the
+ * calling thread if one is set, else through the process wide one
+ * (libc by default). Out of memory still ends the process.
+ */
+
+/* no thread local storage on PSP; the thread allocator is shared there. */
+#if defined(_MSC_VER)
+	#define XMALLOC_TLS __declspec(thread)
+#elif defined(PSP)
+	#define XMALLOC_TLS
+#else
+	#define XMALLOC_TLS __thread
+#endif
+
+#define ARENA_ALIGN			16			///< alignment of arena allocations, and size of their header
+#define ARENA_BLOCK_SIZE	(16 * 1024)	///< default size of an arena block
+
+static void *libc_alloc(void *ctx, size_t size)
+{
+	return malloc(size);
+}
+
+static void *libc_resize(void *ctx, void *ptr, size_t size)
+{
+	return realloc(ptr, size);
+}
+
+static void libc_release(void *ctx, void *ptr)
+{
+	free(ptr);
+}
+
+static const OAuthAllocator xmalloc_libc = { libc_alloc, libc_resize, libc_release, NULL };
+static const OAuthAllocator *xmalloc_global = &xmalloc_libc;
+static XMALLOC_TLS const OAuthAllocator *xmalloc_thread = NULL;
+
+static __inline const OAuthAllocator *xmalloc_current(void)
+{
+	return xmalloc_thread ? xmalloc_thread : xmalloc_global;
+}
+
+void oauth_set_allocator(const OAuthAllocator *a)
+{
+	xmalloc_global = a ? a : &xmalloc_libc;
+}
+
+const OAuthAllocator *oauth_set_thread_allocator(const OAuthAllocator *a)
+{
+	const OAuthAllocator *prev = xmalloc_thread;
+
+	xmalloc_thread = a;
+	return prev;
+}
+
 static __inline
 void *xmalloc_fatal(size_t size)
 {
@@ -43,7 +101,8 @@ void *xmalloc_fatal(size_t size)
 
 void *xmalloc(size_t size)
 {
-	void *ptr = malloc(size);
+	const OAuthAllocator *a = xmalloc_current();
+	void *ptr = a->alloc(a->ctx, size);
 
 	if (ptr == NULL) {
 		return xmalloc_fatal(size);
@@ -54,10 +113,15 @@ void *xmalloc(size_t size)
 
 void *xcalloc(size_t nmemb, size_t size)
 {
-	void *ptr = calloc(nmemb, size);
+	void *ptr;
 
-	if (ptr == NULL) {
-		return xmalloc_fatal(nmemb * size);
+	if (size && nmemb > (size_t)-1 / size) {
+		return xmalloc_fatal(1);
+	}
+
+	ptr = xmalloc(nmemb * size);
+	if (ptr) {
+		memset(ptr, 0, nmemb * size);
 	}
 
 	return ptr;
@@ -65,7 +129,8 @@ void *xcalloc(size_t nmemb, size_t size)
 
 void *xrealloc(void *ptr, size_t size)
 {
-	void *p = realloc(ptr, size);
+	const OAuthAllocator *a = xmalloc_current();
+	void *p = a->resize(a->ctx, ptr, size);
 
 	if (p == NULL) {
 		return xmalloc_fatal(size);
@@ -76,9 +141,167 @@ void *xrealloc(void *ptr, size_t size)
 
 char *xstrdup(const char *s)
 {
-	void *ptr = xmalloc(strlen(s) + sizeof(char));
+	size_t len = strlen(s) + sizeof(char);
+	void *ptr = xmalloc(len);
 
-	strcpy(ptr, s);
+	memcpy(ptr, s, len);
 
 	return (char *)ptr;
 }
+
+void xfree(void *ptr)
+{
+	const OAuthAllocator *a;
+
+	if (ptr) {
+		a = xmalloc_current();
+		a->release(a->ctx, ptr);
+	}
+}
+
+/*
+ * bump-pointer arena: allocations are carved from a chain of blocks,
+ * each behind an ARENA_ALIGN sized header holding its capacity. realloc
+ * grows the latest allocation in place and moves others to twice their
+ * capacity, so arrays grown one element at a time are not copied every
+ * time. free() only gives back the latest allocation; everything else is
+ * released at once by resetting the arena, which keeps its blocks.
+ */
+typedef struct arena_block {
+	struct arena_block *next;
+	size_t size;			///< usable bytes after the (aligned) block header
+} arena_block;
+
+struct OAuthArena {
+	OAuthAllocator allocator;
+	arena_block *first;
+	arena_block *cur;
+	char *ptr;				///< next free byte in cur
+	char *end;				///< end of cur
+	size_t block_size;
+};
+
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+#define ARENA_BLOCK_DATA(b) ((char *)(b) + ARENA_ROUND(sizeof(arena_block)))
+#define ARENA_CAP(p) (*(size_t *)((char *)(p) - ARENA_ALIGN))
+
+static arena_block *arena_block_new(size_t size)
+{
+	arena_block *b = (arena_block *)malloc(ARENA_ROUND(sizeof(arena_block)) + size);
+
+	if (b) {
+		b->next = NULL;
+		b->size = size;
+	}
+	return b;
+}
+
+static void *arena_alloc(void *ctx, size_t size)
+{
+	OAuthArena *arena = (OAuthArena *)ctx;
+	size_t cap = ARENA_ROUND(size), need = ARENA_ALIGN + cap;
+	arena_block *b;
+	char *p;
+
+	if (size > (size_t)-1 - 2 * ARENA_ALIGN) return NULL;
+
+	if ((size_t)(arena->end - arena->ptr) < need) {
+		// next kept block if it is large enough, else a new one in front of it
+		b = arena->cur->next;
+		if (!b || b->size < need) {
+			b = arena_block_new(need > arena->block_size ? need : arena->block_size);
+			if (!b) return NULL;
+			b->next = arena->cur->next;
+			arena->cur->next = b;
+		}
+		arena->cur = b;
+		arena->ptr = ARENA_BLOCK_DATA(b);
+		arena->end = arena->ptr + b->size;
+	}
+
+	p = arena->ptr + ARENA_ALIGN;
+	ARENA_CAP(p) = cap;
+	arena->ptr += need;
+	return p;
+}
+
+static void *arena_resize(void *ctx, void *ptr, size_t size)
+{
+	OAuthArena *arena = (OAuthArena *)ctx;
+	size_t cap;
+	void *p;
+
+	if (!ptr) return arena_alloc(ctx, size);
+
+	cap = ARENA_CAP(ptr);
+	if (size <= cap) return ptr;
+	if (size > (size_t)-1 - 2 * ARENA_ALIGN) return NULL;
+
+	// the latest allocation grows in place
+	if ((char *)ptr + cap == arena->ptr
+		&& (size_t)(arena->end - (char *)ptr) >= ARENA_ROUND(size))
+	{
+		ARENA_CAP(ptr) = ARENA_ROUND(size);
+		arena->ptr = (char *)ptr + ARENA_CAP(ptr);
+		return ptr;
+	}
+
+	if ((p = arena_alloc(ctx, size < cap * 2 ? cap * 2 : size))) {
+		memcpy(p, ptr, cap);
+	}
+	return p;
+}
+
+static void arena_release(void *ctx, void *ptr)
+{
+	OAuthArena *arena = (OAuthArena *)ctx;
+
+	if ((char *)ptr + ARENA_CAP(ptr) == arena->ptr) {
+		arena->ptr = (char *)ptr - ARENA_ALIGN;
+	}
+}
+
+OAuthArena *oauth_arena_new(size_t block_size)
+{
+	// from libc, not from whichever allocator is current
+	OAuthArena *arena = (OAuthArena *)malloc(sizeof(OAuthArena));
+
+	block_size = block_size ? ARENA_ROUND(block_size) : ARENA_BLOCK_SIZE;
+	if (!arena || !(arena->first = arena_block_new(block_size))) {
+		free(arena);
+		return (OAuthArena *)xmalloc_fatal(block_size);
+	}
+	arena->block_size = block_size;
+
+	arena->allocator.alloc = arena_alloc;
+	arena->allocator.resize = arena_resize;
+	arena->allocator.release = arena_release;
+	arena->allocator.ctx = arena;
+	oauth_arena_reset(arena);
+	return arena;
+}
+
+const OAuthAllocator *oauth_arena_allocator(OAuthArena *arena)
+{
+	return &arena->allocator;
+}
+
+void oauth_arena_reset(OAuthArena *arena)
+{
+	arena->cur = arena->first;
+	arena->ptr = ARENA_BLOCK_DATA(arena->first);
+	arena->end = arena->ptr + arena->first->size;
+}
+
+void oauth_arena_free(OAuthArena *arena)
+{
+	arena_block *b, *next;
+
+	if (!arena) return;
+
+	for (b = arena->first; b; b = next) {
+		next = b->next;
+		free(b);
+	}
+	free(arena);
+}
@@ -10,8 +10,7 @@ void *xmalloc(size_t size);
 void *xcalloc(size_t nmemb, size_t size);
 void *xrealloc(void *ptr, size_t size);
 char *xstrdup(const char *s);
-
-#define xfree(x) free(x)
+void xfree(void *ptr);
 
 #ifdef __cplusplus
 }